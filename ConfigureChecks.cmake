@@ -120,6 +120,7 @@ check_function_exists("inet_pton"        HAVE_INET_PTON)
 check_function_exists("issetugid"        HAVE_ISSETUGID)
 check_function_exists("mkdtemp"          HAVE_MKDTEMP)
 check_function_exists("mkstemps"         HAVE_MKSTEMPS)
+check_function_exists("mmap"             HAVE_MMAP)
 check_function_exists("popcount"         HAVE_POPCOUNT)
 check_function_exists("setresgid"        HAVE_SETRESGID)
 check_function_exists("setresuid"        HAVE_SETRESUID)
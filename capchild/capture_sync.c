@@ -207,6 +207,7 @@ sync_pipe_start(capture_options *capture_opts, capture_session *cap_session, inf
     char sautostop_files[ARGV_NUMBER_LEN];
     char sautostop_filesize[ARGV_NUMBER_LEN];
     char sautostop_duration[ARGV_NUMBER_LEN];
+    char supdate_interval[ARGV_NUMBER_LEN];
 #ifdef HAVE_PCAP_REMOTE
     char sauth[256];
 #endif
@@ -278,6 +279,12 @@ sync_pipe_start(capture_options *capture_opts, capture_session *cap_session, inf
         argv = sync_pipe_add_arg(argv, &argc, capture_opts->capture_comment);
     }
 
+    if (capture_opts->update_interval != DEFAULT_UPDATE_INTERVAL) {
+        argv = sync_pipe_add_arg(argv, &argc, "--update-interval");
+        g_snprintf(supdate_interval, ARGV_NUMBER_LEN, "%u", capture_opts->update_interval);
+        argv = sync_pipe_add_arg(argv, &argc, supdate_interval);
+    }
+
     if (capture_opts->multi_files_on) {
         if (capture_opts->has_autostop_filesize) {
             argv = sync_pipe_add_arg(argv, &argc, "-b");
@@ -1801,6 +1808,10 @@ sync_pipe_input_cb(gint source, gpointer user_data)
     case SP_DROPS:
         capture_input_drops(cap_session, (guint32)strtoul(buffer, NULL, 10));
         break;
+    case SP_QUEUE_USAGE:
+        /* Nothing displays this yet */
+        g_log(LOG_DOMAIN_CAPTURE, G_LOG_LEVEL_DEBUG, "sync_pipe_input_cb: buffer usage %s", buffer);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -151,6 +151,8 @@ static gboolean cap_packet_size    = TRUE;  /* Report average packet size */
 static gboolean cap_packet_rate    = TRUE;  /* Report average packet rate */
 static gboolean cap_order          = TRUE;  /* Report if packets are in chronological order (True/False) */
 
+#define CAPINFOS_BATCH_SIZE 1024  /* Records to read at a time */
+
 #ifdef HAVE_LIBGCRYPT
 static gboolean cap_file_hashes    = TRUE;  /* Calculate file hashes */
 
@@ -1056,7 +1058,8 @@ process_cap_file(wtap *wth, const char *filename)
   int                   err;
   gchar                *err_info;
   gint64                size;
-  gint64                data_offset;
+  wtap_batch_t         *batch;
+  guint                 rec;
 
   guint32               packet = 0;
   gint64                bytes  = 0;
@@ -1099,98 +1102,101 @@ process_cap_file(wtap *wth, const char *filename)
   g_array_set_size(cf_info.interface_packet_counts, cf_info.num_interfaces);
   cf_info.pkt_interface_id_unknown = 0;
 
-  g_free(idb_info);
+  wtap_file_free_idb_info(idb_info);
   idb_info = NULL;
 
   /* Tally up data that we need to parse through the file to find */
-  while (wtap_read(wth, &err, &err_info, &data_offset))  {
-    phdr = wtap_phdr(wth);
-    if (phdr->presence_flags & WTAP_HAS_TS) {
-      prev_time = cur_time;
-      cur_time = phdr->ts;
-      if (packet == 0) {
-        start_time = phdr->ts;
-        start_time_tsprec = phdr->pkt_tsprec;
-        stop_time  = phdr->ts;
-        stop_time_tsprec = phdr->pkt_tsprec;
-        prev_time  = phdr->ts;
-      }
-      if (nstime_cmp(&cur_time, &prev_time) < 0) {
-        order = NOT_IN_ORDER;
-      }
-      if (nstime_cmp(&cur_time, &start_time) < 0) {
-        start_time = cur_time;
-        start_time_tsprec = phdr->pkt_tsprec;
-      }
-      if (nstime_cmp(&cur_time, &stop_time) > 0) {
-        stop_time = cur_time;
-        stop_time_tsprec = phdr->pkt_tsprec;
-      }
-    } else {
-      have_times = FALSE; /* at least one packet has no time stamp */
-      if (order != NOT_IN_ORDER)
-        order = ORDER_UNKNOWN;
-    }
-
-    if (phdr->rec_type == REC_TYPE_PACKET) {
-      bytes+=phdr->len;
-      packet++;
-
-      /* If caplen < len for a rcd, then presumably           */
-      /* 'Limit packet capture length' was done for this rcd. */
-      /* Keep track as to the min/max actual snapshot lengths */
-      /*  seen for this file.                                 */
-      if (phdr->caplen < phdr->len) {
-        if (phdr->caplen < snaplen_min_inferred)
-          snaplen_min_inferred = phdr->caplen;
-        if (phdr->caplen > snaplen_max_inferred)
-          snaplen_max_inferred = phdr->caplen;
-      }
-
-      if ((phdr->pkt_encap > 0) && (phdr->pkt_encap < WTAP_NUM_ENCAP_TYPES)) {
-        cf_info.encap_counts[phdr->pkt_encap] += 1;
+  batch = wtap_batch_new(CAPINFOS_BATCH_SIZE);
+  while (wtap_read_batch(wth, batch, &err, &err_info) != 0)  {
+    for (rec = 0; rec < batch->count; rec++) {
+      phdr = &batch->phdrs[rec];
+      if (phdr->presence_flags & WTAP_HAS_TS) {
+        prev_time = cur_time;
+        cur_time = phdr->ts;
+        if (packet == 0) {
+          start_time = phdr->ts;
+          start_time_tsprec = phdr->pkt_tsprec;
+          stop_time  = phdr->ts;
+          stop_time_tsprec = phdr->pkt_tsprec;
+          prev_time  = phdr->ts;
+        }
+        if (nstime_cmp(&cur_time, &prev_time) < 0) {
+          order = NOT_IN_ORDER;
+        }
+        if (nstime_cmp(&cur_time, &start_time) < 0) {
+          start_time = cur_time;
+          start_time_tsprec = phdr->pkt_tsprec;
+        }
+        if (nstime_cmp(&cur_time, &stop_time) > 0) {
+          stop_time = cur_time;
+          stop_time_tsprec = phdr->pkt_tsprec;
+        }
       } else {
-        fprintf(stderr, "capinfos: Unknown packet encapsulation %d in frame %u of file \"%s\"\n",
-                phdr->pkt_encap, packet, filename);
+        have_times = FALSE; /* at least one packet has no time stamp */
+        if (order != NOT_IN_ORDER)
+          order = ORDER_UNKNOWN;
       }
 
-      /* Packet interface_id info */
-      if (phdr->presence_flags & WTAP_HAS_INTERFACE_ID) {
-        /* cf_info.num_interfaces is size, not index, so it's one more than max index */
-        if (phdr->interface_id >= cf_info.num_interfaces) {
-          /*
-           * OK, re-fetch the number of interfaces, as there might have
-           * been an interface that was in the middle of packets, and
-           * grow the array to be big enough for the new number of
-           * interfaces.
-           */
-          idb_info = wtap_file_get_idb_info(wth);
-
-          cf_info.num_interfaces = idb_info->interface_data->len;
-          g_array_set_size(cf_info.interface_packet_counts, cf_info.num_interfaces);
-
-          g_free(idb_info);
-          idb_info = NULL;
-        }
-        if (phdr->interface_id < cf_info.num_interfaces) {
-          g_array_index(cf_info.interface_packet_counts, guint32, phdr->interface_id) += 1;
+      if (phdr->rec_type == REC_TYPE_PACKET) {
+        bytes+=phdr->len;
+        packet++;
+
+        /* If caplen < len for a rcd, then presumably           */
+        /* 'Limit packet capture length' was done for this rcd. */
+        /* Keep track as to the min/max actual snapshot lengths */
+        /*  seen for this file.                                 */
+        if (phdr->caplen < phdr->len) {
+          if (phdr->caplen < snaplen_min_inferred)
+            snaplen_min_inferred = phdr->caplen;
+          if (phdr->caplen > snaplen_max_inferred)
+            snaplen_max_inferred = phdr->caplen;
         }
-        else {
-          cf_info.pkt_interface_id_unknown += 1;
+
+        if ((phdr->pkt_encap > 0) && (phdr->pkt_encap < WTAP_NUM_ENCAP_TYPES)) {
+          cf_info.encap_counts[phdr->pkt_encap] += 1;
+        } else {
+          fprintf(stderr, "capinfos: Unknown packet encapsulation %d in frame %u of file \"%s\"\n",
+                  phdr->pkt_encap, packet, filename);
         }
-      }
-      else {
-        /* it's for interface_id 0 */
-        if (cf_info.num_interfaces != 0) {
-          g_array_index(cf_info.interface_packet_counts, guint32, 0) += 1;
+
+        /* Packet interface_id info */
+        if (phdr->presence_flags & WTAP_HAS_INTERFACE_ID) {
+          /* cf_info.num_interfaces is size, not index, so it's one more than max index */
+          if (phdr->interface_id >= cf_info.num_interfaces) {
+            /*
+             * OK, re-fetch the number of interfaces, as there might have
+             * been an interface that was in the middle of packets, and
+             * grow the array to be big enough for the new number of
+             * interfaces.
+             */
+            idb_info = wtap_file_get_idb_info(wth);
+
+            cf_info.num_interfaces = idb_info->interface_data->len;
+            g_array_set_size(cf_info.interface_packet_counts, cf_info.num_interfaces);
+
+            wtap_file_free_idb_info(idb_info);
+            idb_info = NULL;
+          }
+          if (phdr->interface_id < cf_info.num_interfaces) {
+            g_array_index(cf_info.interface_packet_counts, guint32, phdr->interface_id) += 1;
+          }
+          else {
+            cf_info.pkt_interface_id_unknown += 1;
+          }
         }
         else {
-          cf_info.pkt_interface_id_unknown += 1;
+          /* it's for interface_id 0 */
+          if (cf_info.num_interfaces != 0) {
+            g_array_index(cf_info.interface_packet_counts, guint32, 0) += 1;
+          }
+          else {
+            cf_info.pkt_interface_id_unknown += 1;
+          }
         }
       }
     }
-
   } /* while */
+  wtap_batch_free(batch);
 
   /*
    * Get IDB info strings.
@@ -1207,7 +1213,7 @@ process_cap_file(wtap *wth, const char *filename)
     g_array_append_val(cf_info.idb_info_strings, s);
   }
 
-  g_free(idb_info);
+  wtap_file_free_idb_info(idb_info);
   idb_info = NULL;
 
   if (err != 0) {
@@ -58,12 +58,13 @@ extern "C" {
  * values outside the range of ASCII graphic characters.
  */
 #define LONGOPT_NUM_CAP_COMMENT 128
+#define LONGOPT_NUM_UPDATE_INTERVAL 129
 
 /*
  * Non-capture long-only options should start here, to avoid collision
  * with capture options.
  */
-#define MIN_NON_CAPTURE_LONGOPT  129
+#define MIN_NON_CAPTURE_LONGOPT  130
 #define LONGOPT_DISABLE_PROTOCOL  130
 #define LONGOPT_ENABLE_HEURISTIC  131
 #define LONGOPT_DISABLE_HEURISTIC 132
@@ -96,6 +97,7 @@ extern "C" {
 
 #define LONGOPT_CAPTURE_COMMON \
     {"capture-comment",      required_argument, NULL, LONGOPT_NUM_CAP_COMMENT}, \
+    {"update-interval",      required_argument, NULL, LONGOPT_NUM_UPDATE_INTERVAL}, \
     {"autostop",             required_argument, NULL, 'a'}, \
     {"ring-buffer",          required_argument, NULL, 'b'}, \
     LONGOPT_BUFFER_SIZE \
@@ -325,6 +327,9 @@ typedef struct capture_options_tag {
 
     gchar             *capture_comment;       /** capture comment to write to the
                                                   output file */
+    guint              update_interval;       /**< Time in milliseconds after which
+                                                   dumpcap flushes the capture file and
+                                                   reports the packets written to it */
 
     /* internally used (don't touch from outside) */
     gboolean           output_to_pipe;        /**< save_file is a pipe (named or stdout) */
@@ -377,6 +382,9 @@ capture_opts_free_interface_t(interface_t *device);
 /* Default capture buffer size in Mbytes. */
 #define DEFAULT_CAPTURE_BUFFER_SIZE 2
 
+/* Default interval, in milliseconds, at which dumpcap reports new packets. */
+#define DEFAULT_UPDATE_INTERVAL 500
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
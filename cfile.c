@@ -43,7 +43,7 @@ cap_file_get_interface_name(void *data, guint32 interface_id)
   if (interface_id < idb_info->interface_data->len)
     wtapng_if_descr = g_array_index(idb_info->interface_data, wtap_block_t, interface_id);
 
-  g_free(idb_info);
+  wtap_file_free_idb_info(idb_info);
 
   if (wtapng_if_descr) {
     if (wtap_block_get_string_option_value(wtapng_if_descr, OPT_IDB_NAME, &interface_name) == WTAP_OPTTYPE_SUCCESS)
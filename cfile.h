@@ -28,6 +28,7 @@
 #include <epan/dfilter/dfilter.h>
 #include <epan/frame_data.h>
 #include <epan/frame_data_sequence.h>
+#include <epan/field_cache.h>
 #include <wiretap/wtap.h>
 
 #ifdef __cplusplus
@@ -113,6 +114,7 @@ typedef struct _capture_file {
   Buffer       buf;                  /* Packet data */
   /* frames */
   frame_data_sequence *frames;       /* Sequence of frames, if we're keeping that information */
+  field_cache_t *field_cache;        /* Values of filtered-on fields, for refiltering without dissecting */
   guint32      first_displayed;      /* Frame number of first frame displayed */
   guint32      last_displayed;       /* Frame number of last frame displayed */
   column_info  cinfo;                /* Column formatting information */
@@ -51,6 +51,13 @@
 #include <sys/utsname.h>
 #endif
 
+#ifdef __linux__
+#include <linux/if_packet.h>    /* PACKET_FANOUT */
+#if defined(PACKET_FANOUT) && defined(SOL_PACKET)
+#define HAVE_PACKET_FANOUT
+#endif
+#endif
+
 #include <signal.h>
 #include <errno.h>
 
@@ -138,9 +145,8 @@ FILE *debug_log;   /* for logging debug messages to  */
                    /*  is defined                    */
 #endif
 
-static GAsyncQueue *pcap_queue;
-static gint64 pcap_queue_bytes;
-static gint64 pcap_queue_packets;
+static GAsyncQueue *pcap_queue_wakeup;          /* wakes up the writer thread */
+static volatile gint pcap_queue_writer_waiting; /* TRUE if it's waiting for packets */
 static gint64 pcap_queue_byte_limit = 0;
 static gint64 pcap_queue_packet_limit = 0;
 
@@ -264,6 +270,40 @@ typedef enum {
     PIPNEXIST
 } cap_pipe_err_t;
 
+/*
+ * A ring of packets captured on one interface, when using a separate
+ * thread per interface.  The interface's thread is the only one that
+ * puts packets into the ring, and the main thread is the only one that
+ * takes them out, so no lock is needed; "head" and "packets_in" are only
+ * changed by the former, and "tail" and "packets_out" only by the latter.
+ *
+ * The buffer is allocated when the capture starts.  Each packet is a
+ * struct pcap_pkthdr followed by the packet data, padded to a multiple
+ * of PCAP_RING_ALIGN bytes.  A packet is never split at the end of the
+ * buffer; it's put at the start instead, and, if there's room for a
+ * header at the end, one with a caplen of PCAP_RING_WRAP is put there.
+ * The buffer has room for two of the largest packets more than the
+ * byte limit, so that, while the ring is under that limit, the free
+ * space at its end or at its start can always hold another packet.
+ * No buffer is bigger than PCAP_RING_MAX_SIZE; a larger -C is reduced.
+ */
+#define PCAP_RING_ALIGN             8
+#define PCAP_RING_MAX_SIZE          (G_GUINT64_CONSTANT(256) * 1024 * 1024)
+#define PCAP_RING_WRAP              G_MAXUINT32
+#define PCAP_RING_RECORD_LEN(caplen) \
+    ((guint)((sizeof(struct pcap_pkthdr) + (caplen) + PCAP_RING_ALIGN - 1) & ~(PCAP_RING_ALIGN - 1)))
+
+typedef struct _pcap_ring {
+    u_char                      *buf;
+    guint                        size;                   /**< size of buf, in bytes */
+    guint                        byte_limit;             /**< bytes in use at which packets are dropped */
+    volatile gint                head;                   /**< offset at which the next packet is put */
+    volatile gint                tail;                   /**< offset of the next packet to be written */
+    volatile gint                packets_in;             /**< number of packets put into the ring */
+    volatile gint                packets_out;            /**< number of packets taken out of the ring */
+    volatile gint                high_water;             /**< most packets that were in the ring at once */
+} pcap_ring;
+
 typedef struct _pcap_options {
     guint32                      received;
     guint32                      dropped;
@@ -275,6 +315,11 @@ typedef struct _pcap_options {
     gboolean                     pcap_err;
     guint                        interface_id;
     GThread                     *tid;
+    pcap_ring                    ring;                   /**< packets captured by tid, not yet written */
+    guint32                      batches;                /**< pcap_dispatch() calls that returned packets, with --batch */
+    guint64                      batch_packets;          /**< packets they returned */
+    guint64                      batch_usecs;            /**< time they took */
+    guint64                      batch_max_usecs;        /**< time the slowest one took */
     int                          snaplen;
     int                          linktype;
     gboolean                     ts_nsec;                /**< TRUE if we're using nanosecond precision. */
@@ -324,12 +369,6 @@ typedef struct _loop_data {
     guint32   autostop_files;
 } loop_data;
 
-typedef struct _pcap_queue_element {
-    pcap_options       *pcap_opts;
-    struct pcap_pkthdr  phdr;
-    u_char             *pd;
-} pcap_queue_element;
-
 /*
  * Standard secondary message for unexpected errors.
  */
@@ -389,6 +428,31 @@ static gboolean quiet = FALSE;
 static gboolean use_threads = FALSE;
 static guint64 start_time;
 
+/*
+ * High-throughput mode, set with --batch: the most packets to process
+ * per pcap_dispatch() call, or 0 if not in that mode, and the buffer
+ * through which the capture file is written in that mode, so that
+ * packets are written with one write() per OUTPUT_BUFFER_SIZE bytes.
+ */
+#define LONGOPT_BATCH       (LONGOPT_DISABLE_HEURISTIC + 1)
+#define OUTPUT_BUFFER_SIZE  (1024 * 1024)
+static int dispatch_batch = 0;
+static char *output_buffer = NULL;
+
+#ifdef HAVE_PACKET_FANOUT
+/*
+ * Linux packet fanout, set with --fanout: the fanout group that the
+ * socket for the first interface joins (the socket for the Nth joins
+ * the group after that, as a group can only have one interface), or -1
+ * for none, and how packets are spread across the sockets in a group.
+ * Several dumpcaps capturing on an interface in the same group each get
+ * a share of its packets, rather than all of them.
+ */
+#define LONGOPT_FANOUT      (LONGOPT_DISABLE_HEURISTIC + 2)
+static int fanout_group = -1;
+static int fanout_mode = PACKET_FANOUT_HASH;
+#endif
+
 static void capture_loop_write_packet_cb(u_char *pcap_opts_p, const struct pcap_pkthdr *phdr,
                                          const u_char *pd);
 static void capture_loop_queue_packet_cb(u_char *pcap_opts_p, const struct pcap_pkthdr *phdr,
@@ -401,6 +465,8 @@ static void WS_NORETURN exit_main(int err);
 static void report_new_capture_file(const char *filename);
 static void report_packet_count(unsigned int packet_count);
 static void report_packet_drops(guint32 received, guint32 pcap_drops, guint32 drops, guint32 flushed, guint32 ps_ifdrop, gchar *name);
+static void report_queue_usage(guint interface_id, guint packets, guint bytes, guint high_water);
+static void report_batch_latency(pcap_options *pcap_opts, gchar *name);
 static void report_capture_error(const char *error_msg, const char *secondary_error_msg);
 static void report_cfilter_error(capture_options *capture_opts, guint i, const char *errmsg);
 
@@ -516,12 +582,25 @@ print_usage(FILE *output)
     fprintf(output, "  --capture-comment <comment>\n");
     fprintf(output, "                           add a capture comment to the output file\n");
     fprintf(output, "                           (only for pcapng)\n");
+    fprintf(output, "  --update-interval <interval>\n");
+    fprintf(output, "                           time in milliseconds between flushes of the\n");
+    fprintf(output, "                           output file and reports of new packets to the\n");
+    fprintf(output, "                           parent process (def: %dms)\n", DEFAULT_UPDATE_INTERVAL);
     fprintf(output, "\n");
     fprintf(output, "Miscellaneous:\n");
     fprintf(output, "  -N <packet_limit>        maximum number of packets buffered within dumpcap\n");
+    fprintf(output, "                           for each interface\n");
     fprintf(output, "  -C <byte_limit>          maximum number of bytes used for buffering packets\n");
-    fprintf(output, "                           within dumpcap\n");
+    fprintf(output, "                           within dumpcap for each interface\n");
     fprintf(output, "  -t                       use a separate thread per interface\n");
+    fprintf(output, "  --batch <packets>        read up to <packets> packets at a time from each\n");
+    fprintf(output, "                           interface and write them in large blocks\n");
+#ifdef HAVE_PACKET_FANOUT
+    fprintf(output, "  --fanout <group>[:<mode>]\n");
+    fprintf(output, "                           share the packets of each interface with the other\n");
+    fprintf(output, "                           members of packet fanout group <group>;\n");
+    fprintf(output, "                           mode: hash (default), lb, or cpu\n");
+#endif
     fprintf(output, "  -q                       don't report packet capture counts\n");
     fprintf(output, "  -v                       print version information and exit\n");
     fprintf(output, "  -h                       display this help and exit\n");
@@ -2064,6 +2143,68 @@ cap_pipe_dispatch(loop_data *ld, pcap_options *pcap_opts, guchar *data, char *er
 }
 
 
+#ifdef HAVE_PACKET_FANOUT
+/*
+ * Handle the argument to --fanout: "<group>[:<mode>]".
+ */
+static gboolean
+set_fanout_arg(char *arg)
+{
+    char *p, *mode;
+
+    mode = strchr(arg, ':');
+    if (mode != NULL)
+        *mode++ = '\0';
+
+    fanout_group = (int)strtol(arg, &p, 10);
+    if (p == arg || *p != '\0' || fanout_group < 0 || fanout_group > G_MAXUINT16) {
+        cmdarg_err("The fanout group \"%s\" isn't a number between 0 and %u", arg, G_MAXUINT16);
+        return FALSE;
+    }
+
+    if (mode == NULL || strcmp(mode, "hash") == 0) {
+        fanout_mode = PACKET_FANOUT_HASH;
+    } else if (strcmp(mode, "lb") == 0) {
+        fanout_mode = PACKET_FANOUT_LB;
+    } else if (strcmp(mode, "cpu") == 0) {
+        fanout_mode = PACKET_FANOUT_CPU;
+    } else {
+        cmdarg_err("Unknown fanout mode \"%s\"; it must be hash, lb, or cpu", mode);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Join the socket for the interface_index'th interface to its fanout
+ * group, if --fanout was given.
+ */
+static gboolean
+set_pcap_fanout(pcap_t *pcap_h, guint interface_index, const char *name,
+                char *errmsg, size_t errmsg_len,
+                char *secondary_errmsg, size_t secondary_errmsg_len)
+{
+    int group, fanout_arg;
+
+    if (fanout_group == -1)
+        return TRUE;
+
+    group = (fanout_group + interface_index) & G_MAXUINT16;
+    fanout_arg = group | (fanout_mode << 16);
+    if (setsockopt(pcap_fileno(pcap_h), SOL_PACKET, PACKET_FANOUT,
+                   &fanout_arg, sizeof(fanout_arg)) == -1) {
+        g_snprintf(errmsg, (gulong) errmsg_len,
+                   "Unable to join packet fanout group %d on interface '%s': %s.",
+                   group, name, g_strerror(errno));
+        g_snprintf(secondary_errmsg, (gulong) secondary_errmsg_len,
+                   "All the members of a group must capture on the same interface,\n"
+                   "with the same fanout mode.");
+        return FALSE;
+    }
+    return TRUE;
+}
+#endif
+
 /** Open the capture input file (pcap or capture pipe).
  *  Returns TRUE if it succeeds, FALSE otherwise. */
 static gboolean
@@ -2154,6 +2295,11 @@ capture_loop_open_input(capture_options *capture_opts, loop_data *ld,
         pcap_opts->pcap_err = FALSE;
         pcap_opts->interface_id = i;
         pcap_opts->tid = NULL;
+        memset(&pcap_opts->ring, 0, sizeof(pcap_ring));
+        pcap_opts->batches = 0;
+        pcap_opts->batch_packets = 0;
+        pcap_opts->batch_usecs = 0;
+        pcap_opts->batch_max_usecs = 0;
         pcap_opts->snaplen = 0;
         pcap_opts->linktype = -1;
         pcap_opts->ts_nsec = FALSE;
@@ -2237,6 +2383,13 @@ capture_loop_open_input(capture_options *capture_opts, loop_data *ld,
                 return FALSE;
             }
             pcap_opts->linktype = get_pcap_datalink(pcap_opts->pcap_h, interface_opts.name);
+#ifdef HAVE_PACKET_FANOUT
+            if (!set_pcap_fanout(pcap_opts->pcap_h, i, interface_opts.name,
+                                 errmsg, errmsg_len,
+                                 secondary_errmsg, secondary_errmsg_len)) {
+                return FALSE;
+            }
+#endif
         } else {
             /* We couldn't open "iface" as a network device. */
             /* Try to open it as a pipe */
@@ -2381,6 +2534,25 @@ capture_loop_init_filter(pcap_t *pcap_h, gboolean from_cap_pipe,
 
 
 /* set up to write to the already-opened capture output file/files */
+/*
+ * In --batch mode, write the capture file through a large buffer, so
+ * that the small writes for each packet's headers and data turn into a
+ * single write() per OUTPUT_BUFFER_SIZE bytes.  This is for a single
+ * capture file; ringbuffer files each get a buffer of their own from
+ * the ringbuffer code, as an old file is closed in the background,
+ * possibly still writing from its buffer, while the next one is in use.
+ */
+static void
+capture_loop_set_output_buffer(FILE *pdh)
+{
+    if (dispatch_batch == 0)
+        return;
+
+    if (output_buffer == NULL)
+        output_buffer = (char *)g_malloc(OUTPUT_BUFFER_SIZE);
+    setvbuf(pdh, output_buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+}
+
 static gboolean
 capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *errmsg, int errmsg_len)
 {
@@ -2401,11 +2573,15 @@ capture_loop_init_output(capture_options *capture_opts, loop_data *ld, char *err
 
     /* Set up to write to the capture file. */
     if (capture_opts->multi_files_on) {
+        if (dispatch_batch != 0)
+            ringbuf_set_buffer_size(OUTPUT_BUFFER_SIZE);
         ld->pdh = ringbuf_init_libpcap_fdopen(&err);
     } else {
         ld->pdh = ws_fdopen(ld->save_file_fd, "wb");
         if (ld->pdh == NULL) {
             err = errno;
+        } else {
+            capture_loop_set_output_buffer(ld->pdh);
         }
     }
     if (ld->pdh) {
@@ -2543,6 +2719,35 @@ capture_loop_close_output(capture_options *capture_opts, loop_data *ld, int *err
     }
 }
 
+/*
+ * Call pcap_dispatch() for up to cnt packets, handing them to the
+ * writer or, with a thread per interface, queueing them.  In --batch
+ * mode, also keep track of how long each batch of packets takes.
+ */
+static int
+capture_loop_pcap_dispatch(pcap_options *pcap_opts, int cnt)
+{
+    pcap_handler callback;
+    guint64      batch_start, batch_usecs;
+    int          inpkts;
+
+    callback = use_threads ? capture_loop_queue_packet_cb : capture_loop_write_packet_cb;
+    if (dispatch_batch == 0)
+        return pcap_dispatch(pcap_opts->pcap_h, cnt, callback, (u_char *)pcap_opts);
+
+    batch_start = create_timestamp();
+    inpkts = pcap_dispatch(pcap_opts->pcap_h, cnt, callback, (u_char *)pcap_opts);
+    if (inpkts > 0) {
+        batch_usecs = create_timestamp() - batch_start;
+        pcap_opts->batches++;
+        pcap_opts->batch_packets += inpkts;
+        pcap_opts->batch_usecs += batch_usecs;
+        if (batch_usecs > pcap_opts->batch_max_usecs)
+            pcap_opts->batch_max_usecs = batch_usecs;
+    }
+    return inpkts;
+}
+
 /* dispatch incoming packets (pcap or capture pipe)
  *
  * Waits for incoming packets to be available, and calls pcap_dispatch()
@@ -2624,12 +2829,15 @@ capture_loop_dispatch(loop_data *ld,
                  * per pcap_dispatch() call, to allow a signal to stop the
                  * processing immediately, rather than processing all packets
                  * in a batch before quitting.
+                 *
+                 * If we do have it, capture_loop_stop() will break out of
+                 * a batch, so, in --batch mode, we process several.
                  */
-                if (use_threads) {
-                    inpkts = pcap_dispatch(pcap_opts->pcap_h, 1, capture_loop_queue_packet_cb, (u_char *)pcap_opts);
-                } else {
-                    inpkts = pcap_dispatch(pcap_opts->pcap_h, 1, capture_loop_write_packet_cb, (u_char *)pcap_opts);
-                }
+#ifdef HAVE_PCAP_BREAKLOOP
+                inpkts = capture_loop_pcap_dispatch(pcap_opts, dispatch_batch > 0 ? dispatch_batch : 1);
+#else
+                inpkts = capture_loop_pcap_dispatch(pcap_opts, 1);
+#endif
                 if (inpkts < 0) {
                     if (inpkts == -1) {
                         /* Error, rather than pcap_breakloop(). */
@@ -2661,17 +2869,9 @@ capture_loop_dispatch(loop_data *ld,
              * after processing packets.  We therefore process only one packet
              * at a time, so that we can check the pipe after every packet.
              */
-            if (use_threads) {
-                inpkts = pcap_dispatch(pcap_opts->pcap_h, 1, capture_loop_queue_packet_cb, (u_char *)pcap_opts);
-            } else {
-                inpkts = pcap_dispatch(pcap_opts->pcap_h, 1, capture_loop_write_packet_cb, (u_char *)pcap_opts);
-            }
+            inpkts = capture_loop_pcap_dispatch(pcap_opts, 1);
 #else
-            if (use_threads) {
-                inpkts = pcap_dispatch(pcap_opts->pcap_h, -1, capture_loop_queue_packet_cb, (u_char *)pcap_opts);
-            } else {
-                inpkts = pcap_dispatch(pcap_opts->pcap_h, -1, capture_loop_write_packet_cb, (u_char *)pcap_opts);
-            }
+            inpkts = capture_loop_pcap_dispatch(pcap_opts, dispatch_batch > 0 ? dispatch_batch : -1);
 #endif
             if (inpkts < 0) {
                 if (inpkts == -1) {
@@ -2978,6 +3178,245 @@ do_file_switch_or_stop(capture_options *capture_opts,
     return TRUE;
 }
 
+/*
+ * Allocate the ring for an interface whose packets are at most
+ * max_caplen bytes long.  The byte limit is the one given with -C or,
+ * if there's none, room for the packet limit of the largest packets.
+ */
+static gboolean
+pcap_ring_init(pcap_ring *ring, guint max_caplen, char *errmsg, int errmsg_len)
+{
+    guint64 max_rec_len = PCAP_RING_RECORD_LEN(max_caplen);
+    guint64 byte_limit, size;
+
+    byte_limit = (guint64)pcap_queue_packet_limit * max_rec_len;
+    if ((pcap_queue_byte_limit != 0) &&
+        ((pcap_queue_packet_limit == 0) || ((guint64)pcap_queue_byte_limit < byte_limit)))
+        byte_limit = (guint64)pcap_queue_byte_limit;
+    size = byte_limit + 2 * max_rec_len + PCAP_RING_ALIGN;
+    if (size > PCAP_RING_MAX_SIZE) {
+        size = PCAP_RING_MAX_SIZE;
+        byte_limit = size - 2 * max_rec_len - PCAP_RING_ALIGN;
+    }
+
+    ring->size = (guint)size;
+    ring->byte_limit = (guint)byte_limit;
+    ring->buf = (u_char *)g_try_malloc(ring->size);
+    if (ring->buf == NULL) {
+        g_snprintf(errmsg, errmsg_len,
+                   "Couldn't allocate %u bytes to buffer packets; try a smaller -C or -N.",
+                   ring->size);
+        return FALSE;
+    }
+    ring->head = 0;
+    ring->tail = 0;
+    ring->packets_in = 0;
+    ring->packets_out = 0;
+    ring->high_water = 0;
+    return TRUE;
+}
+
+static void
+pcap_ring_free(pcap_ring *ring)
+{
+    g_free(ring->buf);
+    ring->buf = NULL;
+}
+
+/* Number of bytes in use, as seen from the main thread */
+static guint
+pcap_ring_bytes_used(pcap_ring *ring)
+{
+    guint head = (guint)g_atomic_int_get(&ring->head);
+    guint tail = (guint)ring->tail;
+
+    return (head >= tail) ? head - tail : ring->size - tail + head;
+}
+
+/*
+ * Called by the interface's thread; returns FALSE, without queueing
+ * the packet, if the ring is full or the packet limits are reached.
+ */
+static gboolean
+pcap_ring_put(pcap_ring *ring, const struct pcap_pkthdr *phdr, const u_char *pd)
+{
+    guint               rec_len = PCAP_RING_RECORD_LEN(phdr->caplen);
+    guint               head, tail, used, offset;
+    gint                packets;
+    struct pcap_pkthdr *rec;
+
+    packets = ring->packets_in - g_atomic_int_get(&ring->packets_out);
+    if ((pcap_queue_packet_limit != 0) && (packets >= pcap_queue_packet_limit))
+        return FALSE;
+
+    head = (guint)ring->head;
+    tail = (guint)g_atomic_int_get(&ring->tail);
+    used = (head >= tail) ? head - tail : ring->size - tail + head;
+    if (used >= ring->byte_limit)
+        return FALSE;
+
+    /*
+     * Find room for the packet, keeping head != tail unless the ring
+     * is empty.
+     */
+    if (head >= tail) {
+        if ((ring->size - head > rec_len) ||
+            ((ring->size - head == rec_len) && (tail != 0)))
+            offset = head;
+        else if (tail > rec_len)
+            offset = 0;
+        else
+            return FALSE;
+    } else {
+        if (tail - head > rec_len)
+            offset = head;
+        else
+            return FALSE;
+    }
+
+    if ((offset != head) && (ring->size - head >= sizeof(struct pcap_pkthdr))) {
+        /* Send the main thread back to the start of the buffer */
+        ((struct pcap_pkthdr *)(void *)(ring->buf + head))->caplen = PCAP_RING_WRAP;
+    }
+    rec = (struct pcap_pkthdr *)(void *)(ring->buf + offset);
+    *rec = *phdr;
+    memcpy(rec + 1, pd, phdr->caplen);
+
+    head = offset + rec_len;
+    if (head == ring->size)
+        head = 0;
+    /* This makes the packet, and the wrap marker, visible to the main thread */
+    g_atomic_int_set(&ring->head, (gint)head);
+    g_atomic_int_inc(&ring->packets_in);
+    if (packets + 1 > ring->high_water)
+        g_atomic_int_set(&ring->high_water, packets + 1);
+    return TRUE;
+}
+
+/*
+ * Called by the main thread; returns the oldest packet in the ring,
+ * which stays there until pcap_ring_release() is called, or NULL if
+ * the ring is empty.
+ */
+static struct pcap_pkthdr *
+pcap_ring_peek(pcap_ring *ring)
+{
+    guint head = (guint)g_atomic_int_get(&ring->head);
+    guint tail = (guint)ring->tail;
+
+    if (tail == head)
+        return NULL;
+    if ((ring->size - tail < sizeof(struct pcap_pkthdr)) ||
+        (((struct pcap_pkthdr *)(void *)(ring->buf + tail))->caplen == PCAP_RING_WRAP)) {
+        /* The packet is at the start of the buffer */
+        tail = 0;
+        g_atomic_int_set(&ring->tail, 0);
+    }
+    return (struct pcap_pkthdr *)(void *)(ring->buf + tail);
+}
+
+static void
+pcap_ring_release(pcap_ring *ring, const struct pcap_pkthdr *rec)
+{
+    guint tail = (guint)((const u_char *)rec - ring->buf) + PCAP_RING_RECORD_LEN(rec->caplen);
+
+    if (tail == ring->size)
+        tail = 0;
+    g_atomic_int_set(&ring->tail, (gint)tail);
+    g_atomic_int_inc(&ring->packets_out);
+}
+
+/* Is time stamp a earlier than time stamp b? */
+static gboolean
+pcap_ts_before(const pcap_options *pcap_opts_a, const struct pcap_pkthdr *a,
+               const pcap_options *pcap_opts_b, const struct pcap_pkthdr *b)
+{
+    guint64 frac_a, frac_b;
+
+    if (a->ts.tv_sec != b->ts.tv_sec)
+        return a->ts.tv_sec < b->ts.tv_sec;
+    /* Compare the fractions of a second in nanoseconds */
+    frac_a = (guint64)a->ts.tv_usec * (pcap_opts_a->ts_nsec ? 1 : 1000);
+    frac_b = (guint64)b->ts.tv_usec * (pcap_opts_b->ts_nsec ? 1 : 1000);
+    return frac_a < frac_b;
+}
+
+/*
+ * Find the queued packet with the earliest time stamp; as each
+ * interface's packets are queued in the order they were captured, that's
+ * the oldest packet of one of the rings.  Returns the interface, or NULL
+ * if no packets are queued.
+ */
+static pcap_options *
+capture_loop_next_queued_packet(struct pcap_pkthdr **phdrp)
+{
+    pcap_options       *pcap_opts, *next_opts = NULL;
+    struct pcap_pkthdr *phdr, *next_phdr = NULL;
+    guint               i;
+
+    for (i = 0; i < global_ld.pcaps->len; i++) {
+        pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, i);
+        phdr = pcap_ring_peek(&pcap_opts->ring);
+        if (phdr != NULL &&
+            (next_phdr == NULL || pcap_ts_before(pcap_opts, phdr, next_opts, next_phdr))) {
+            next_opts = pcap_opts;
+            next_phdr = phdr;
+        }
+    }
+    *phdrp = next_phdr;
+    return next_opts;
+}
+
+/*
+ * Wait for an interface's thread to queue a packet, or for the writer
+ * thread timeout to expire.  The interface threads only wake us up if
+ * we've said we're waiting, so that queueing a packet normally takes
+ * no lock.
+ */
+static void
+capture_loop_wait_for_packets(void)
+{
+    struct pcap_pkthdr *phdr;
+#if !GLIB_CHECK_VERSION(2,31,18)
+    GTimeVal            write_thread_time;
+#endif
+
+    g_atomic_int_set(&pcap_queue_writer_waiting, TRUE);
+    /* A packet might have been queued before we said we're waiting */
+    if (capture_loop_next_queued_packet(&phdr) == NULL) {
+#if GLIB_CHECK_VERSION(2,31,18)
+        g_async_queue_timeout_pop(pcap_queue_wakeup, WRITER_THREAD_TIMEOUT);
+#else
+        g_get_current_time(&write_thread_time);
+        g_time_val_add(&write_thread_time, WRITER_THREAD_TIMEOUT);
+        g_async_queue_timed_pop(pcap_queue_wakeup, &write_thread_time);
+#endif
+    }
+    g_atomic_int_set(&pcap_queue_writer_waiting, FALSE);
+    /* Discard any further wakeups */
+    while (g_async_queue_try_pop(pcap_queue_wakeup) != NULL)
+        ;
+}
+
+/* Write the oldest queued packet; returns FALSE if there are none */
+static gboolean
+capture_loop_write_queued_packet(void)
+{
+    pcap_options       *pcap_opts;
+    struct pcap_pkthdr *phdr;
+
+    pcap_opts = capture_loop_next_queued_packet(&phdr);
+    if (pcap_opts == NULL)
+        return FALSE;
+
+    g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
+          "Dequeued a packet of length %d captured on interface %d.",
+          phdr->caplen, pcap_opts->interface_id);
+    capture_loop_write_packet_cb((u_char *)pcap_opts, phdr, (const u_char *)(phdr + 1));
+    pcap_ring_release(&pcap_opts->ring, phdr);
+    return TRUE;
+}
+
 static void *
 pcap_read_handler(void* arg)
 {
@@ -3151,9 +3590,24 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
     /* WOW, everything is prepared! */
     /* please fasten your seat belts, we will enter now the actual capture loop */
     if (use_threads) {
-        pcap_queue = g_async_queue_new();
-        pcap_queue_bytes = 0;
-        pcap_queue_packets = 0;
+        pcap_queue_wakeup = g_async_queue_new();
+        pcap_queue_writer_waiting = FALSE;
+        for (i = 0; i < global_ld.pcaps->len; i++) {
+            guint max_caplen;
+
+            pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, i);
+            /* A pipe's header may not give a snapshot length we can trust */
+            max_caplen = WTAP_MAX_PACKET_SIZE;
+            if ((pcap_opts->snaplen > 0) && (pcap_opts->snaplen < WTAP_MAX_PACKET_SIZE))
+                max_caplen = (guint)pcap_opts->snaplen;
+            if (!pcap_ring_init(&pcap_opts->ring, max_caplen, errmsg, (int)sizeof(errmsg))) {
+                while (i-- > 0)
+                    pcap_ring_free(&g_array_index(global_ld.pcaps, pcap_options *, i)->ring);
+                g_async_queue_unref(pcap_queue_wakeup);
+                pcap_queue_wakeup = NULL;
+                goto error;
+            }
+        }
         for (i = 0; i < global_ld.pcaps->len; i++) {
             pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, i);
 #if GLIB_CHECK_VERSION(2,31,0)
@@ -3167,37 +3621,10 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
     while (global_ld.go) {
         /* dispatch incoming packets */
         if (use_threads) {
-            pcap_queue_element *queue_element;
-#if GLIB_CHECK_VERSION(2,31,18)
-
-            g_async_queue_lock(pcap_queue);
-            queue_element = (pcap_queue_element *)g_async_queue_timeout_pop_unlocked(pcap_queue, WRITER_THREAD_TIMEOUT);
-#else
-            GTimeVal write_thread_time;
-
-            g_get_current_time(&write_thread_time);
-            g_time_val_add(&write_thread_time, WRITER_THREAD_TIMEOUT);
-            g_async_queue_lock(pcap_queue);
-            queue_element = (pcap_queue_element *)g_async_queue_timed_pop_unlocked(pcap_queue, &write_thread_time);
-#endif
-            if (queue_element) {
-                pcap_queue_bytes -= queue_element->phdr.caplen;
-                pcap_queue_packets -= 1;
-            }
-            g_async_queue_unlock(pcap_queue);
-            if (queue_element) {
-                g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-                      "Dequeued a packet of length %d captured on interface %d.",
-                      queue_element->phdr.caplen, queue_element->pcap_opts->interface_id);
-
-                capture_loop_write_packet_cb((u_char *) queue_element->pcap_opts,
-                                             &queue_element->phdr,
-                                             queue_element->pd);
-                g_free(queue_element->pd);
-                g_free(queue_element);
-                inpkts = 1;
-            } else {
-                inpkts = 0;
+            inpkts = capture_loop_write_queued_packet() ? 1 : 0;
+            if (inpkts == 0) {
+                capture_loop_wait_for_packets();
+                inpkts = capture_loop_write_queued_packet() ? 1 : 0;
             }
         } else {
             pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, 0);
@@ -3236,19 +3663,17 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
             }
         } /* inpkts */
 
-        /* Only update once every 500ms so as not to overload slow displays.
-         * This also prevents too much context-switching between the dumpcap
-         * and wireshark processes.
+        /* Only update once every update_interval ms (500ms by default) so
+         * as not to overload slow displays.  This also prevents too much
+         * context-switching between the dumpcap and wireshark processes.
          */
-#define DUMPCAP_UPD_TIME 500
-
 #ifdef _WIN32
         cur_time = GetTickCount();  /* Note: wraps to 0 if sys runs for 49.7 days */
-        if ((cur_time - upd_time) > DUMPCAP_UPD_TIME) { /* wrap just causes an extra update */
+        if ((cur_time - upd_time) > capture_opts->update_interval) { /* wrap just causes an extra update */
 #else
         gettimeofday(&cur_time, NULL);
         if (((guint64)cur_time.tv_sec * 1000000 + cur_time.tv_usec) >
-            ((guint64)upd_time.tv_sec * 1000000 + upd_time.tv_usec + DUMPCAP_UPD_TIME*1000)) {
+            ((guint64)upd_time.tv_sec * 1000000 + upd_time.tv_usec + (guint64)capture_opts->update_interval*1000)) {
 #endif
 
             upd_time = cur_time;
@@ -3271,6 +3696,17 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
                 global_ld.inpkts_to_sync_pipe = 0;
             }
 
+            /* Let the parent know how full the packet buffers are. */
+            if (use_threads && !quiet) {
+                for (i = 0; i < global_ld.pcaps->len; i++) {
+                    pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, i);
+                    report_queue_usage(pcap_opts->interface_id,
+                                       (guint)(g_atomic_int_get(&pcap_opts->ring.packets_in) - pcap_opts->ring.packets_out),
+                                       pcap_ring_bytes_used(&pcap_opts->ring),
+                                       (guint)g_atomic_int_get(&pcap_opts->ring.high_water));
+                }
+            }
+
             /* check capture duration condition */
             if (cnd_autostop_duration != NULL && cnd_eval(cnd_autostop_duration)) {
                 /* The maximum capture time has elapsed; stop the capture. */
@@ -3290,8 +3726,6 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
 
     g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO, "Capture loop stopping ...");
     if (use_threads) {
-        pcap_queue_element *queue_element;
-
         for (i = 0; i < global_ld.pcaps->len; i++) {
             pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, i);
             g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO, "Waiting for thread of interface %u...",
@@ -3300,30 +3734,17 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
             g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO, "Thread of interface %u terminated.",
                   pcap_opts->interface_id);
         }
-        while (1) {
-            g_async_queue_lock(pcap_queue);
-            queue_element = (pcap_queue_element *)g_async_queue_try_pop_unlocked(pcap_queue);
-            if (queue_element) {
-                pcap_queue_bytes -= queue_element->phdr.caplen;
-                pcap_queue_packets -= 1;
-            }
-            g_async_queue_unlock(pcap_queue);
-            if (queue_element == NULL) {
-                break;
-            }
-            g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-                  "Dequeued a packet of length %d captured on interface %d.",
-                  queue_element->phdr.caplen, queue_element->pcap_opts->interface_id);
-            capture_loop_write_packet_cb((u_char *)queue_element->pcap_opts,
-                                         &queue_element->phdr,
-                                         queue_element->pd);
-            g_free(queue_element->pd);
-            g_free(queue_element);
+        while (capture_loop_write_queued_packet()) {
             global_ld.inpkts_to_sync_pipe += 1;
             if (capture_opts->output_to_pipe) {
                 fflush(global_ld.pdh);
             }
         }
+        for (i = 0; i < global_ld.pcaps->len; i++) {
+            pcap_opts = g_array_index(global_ld.pcaps, pcap_options *, i);
+            pcap_ring_free(&pcap_opts->ring);
+        }
+        g_async_queue_unref(pcap_queue_wakeup);
     }
 
 
@@ -3391,6 +3812,8 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
         close_ok = capture_loop_close_output(capture_opts, &global_ld, &err_close);
     } else
         close_ok = TRUE;
+    g_free(output_buffer);
+    output_buffer = NULL;
 
     /* there might be packets not yet notified to the parent */
     /* (do this after closing the file, so all packets are already flushed) */
@@ -3447,6 +3870,8 @@ capture_loop_start(capture_options *capture_opts, gboolean *stats_known, struct
             }
         }
         report_packet_drops(received, pcap_dropped, pcap_opts->dropped, pcap_opts->flushed, stats->ps_ifdrop, interface_opts.console_display_name);
+        if (dispatch_batch > 0 && pcap_opts->batches > 0)
+            report_batch_latency(pcap_opts, interface_opts.console_display_name);
     }
 
     /* close the input file (pcap or capture pipe) */
@@ -3616,9 +4041,7 @@ static void
 capture_loop_queue_packet_cb(u_char *pcap_opts_p, const struct pcap_pkthdr *phdr,
                              const u_char *pd)
 {
-    pcap_options       *pcap_opts = (pcap_options *) (void *) pcap_opts_p;
-    pcap_queue_element *queue_element;
-    gboolean            limit_reached;
+    pcap_options *pcap_opts = (pcap_options *) (void *) pcap_opts_p;
 
     /* We may be called multiple times from pcap_dispatch(); if we've set
        the "stop capturing" flag, ignore this packet, as we're not
@@ -3628,49 +4051,22 @@ capture_loop_queue_packet_cb(u_char *pcap_opts_p, const struct pcap_pkthdr *phdr
         return;
     }
 
-    queue_element = (pcap_queue_element *)g_malloc(sizeof(pcap_queue_element));
-    if (queue_element == NULL) {
-       pcap_opts->dropped++;
-       return;
-    }
-    queue_element->pcap_opts = pcap_opts;
-    queue_element->phdr = *phdr;
-    queue_element->pd = (u_char *)g_malloc(phdr->caplen);
-    if (queue_element->pd == NULL) {
-        pcap_opts->dropped++;
-        g_free(queue_element);
-        return;
-    }
-    memcpy(queue_element->pd, pd, phdr->caplen);
-    g_async_queue_lock(pcap_queue);
-    if (((pcap_queue_byte_limit == 0) || (pcap_queue_bytes < pcap_queue_byte_limit)) &&
-        ((pcap_queue_packet_limit == 0) || (pcap_queue_packets < pcap_queue_packet_limit))) {
-        limit_reached = FALSE;
-        g_async_queue_push_unlocked(pcap_queue, queue_element);
-        pcap_queue_bytes += phdr->caplen;
-        pcap_queue_packets += 1;
-    } else {
-        limit_reached = TRUE;
-    }
-    g_async_queue_unlock(pcap_queue);
-    if (limit_reached) {
+    if (!pcap_ring_put(&pcap_opts->ring, phdr, pd)) {
         pcap_opts->dropped++;
-        g_free(queue_element->pd);
-        g_free(queue_element);
         g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
               "Dropped a packet of length %d captured on interface %u.",
               phdr->caplen, pcap_opts->interface_id);
-    } else {
-        pcap_opts->received++;
-        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-              "Queued a packet of length %d captured on interface %u.",
-              phdr->caplen, pcap_opts->interface_id);
+        return;
+    }
+    pcap_opts->received++;
+
+    /* Wake up the main thread if it's waiting for packets */
+    if (g_atomic_int_get(&pcap_queue_writer_waiting)) {
+        g_async_queue_push(pcap_queue_wakeup, GINT_TO_POINTER(1));
     }
-    /* I don't want to hold the mutex over the debug output. So the
-       output may be wrong */
     g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_INFO,
-          "Queue size is now %" G_GINT64_MODIFIER "d bytes (%" G_GINT64_MODIFIER "d packets)",
-          pcap_queue_bytes, pcap_queue_packets);
+          "Queued a packet of length %d captured on interface %u.",
+          phdr->caplen, pcap_opts->interface_id);
 }
 
 static int
@@ -3753,6 +4149,10 @@ main(int argc, char *argv[])
     static const struct option long_options[] = {
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'v'},
+        {"batch", required_argument, NULL, LONGOPT_BATCH},
+#ifdef HAVE_PACKET_FANOUT
+        {"fanout", required_argument, NULL, LONGOPT_FANOUT},
+#endif
         LONGOPT_CAPTURE_COMMON
         {0, 0, 0, 0 }
     };
@@ -4122,6 +4522,7 @@ main(int argc, char *argv[])
         case 'w':        /* Write to capture file x */
         case 'y':        /* Set the pcap data link type */
         case  LONGOPT_NUM_CAP_COMMENT: /* add a capture comment */
+        case  LONGOPT_NUM_UPDATE_INTERVAL: /* how often to report packets */
 #ifdef HAVE_PCAP_REMOTE
         case 'u':        /* Use UDP for data transfer */
         case 'r':        /* Capture own RPCAP traffic too */
@@ -4218,6 +4619,15 @@ main(int argc, char *argv[])
         case 'N':
             pcap_queue_packet_limit = get_positive_int(optarg, "packet_limit");
             break;
+        case LONGOPT_BATCH:
+            dispatch_batch = get_positive_int(optarg, "batch size");
+            break;
+#ifdef HAVE_PACKET_FANOUT
+        case LONGOPT_FANOUT:
+            if (!set_fanout_arg(optarg))
+                arg_error = TRUE;
+            break;
+#endif
         default:
             cmdarg_err("Invalid Option: %s", argv[optind-1]);
             /* FALLTHROUGH */
@@ -4251,8 +4661,10 @@ main(int argc, char *argv[])
     if ((pcap_queue_byte_limit == 0) && (pcap_queue_packet_limit == 0)) {
         /* Use some default if the user hasn't specified some */
         /* XXX: Are these defaults good enough? */
-        pcap_queue_byte_limit = 1000 * 1000;
         pcap_queue_packet_limit = 1000;
+        /* The packet buffers are allocated up front; don't make them
+           room for 1000 packets of the largest size */
+        pcap_queue_byte_limit = 1000 * 1000;
     }
     if (arg_error) {
         print_usage(stderr);
@@ -4691,6 +5103,40 @@ report_packet_drops(guint32 received, guint32 pcap_drops, guint32 drops, guint32
     }
 }
 
+static void
+report_batch_latency(pcap_options *pcap_opts, gchar *name)
+{
+    guint64 avg_packets = pcap_opts->batch_packets / pcap_opts->batches;
+    guint64 avg_usecs = pcap_opts->batch_usecs / pcap_opts->batches;
+
+    if (capture_child) {
+        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG,
+            "Batches read on interface '%s': %u (%" G_GINT64_MODIFIER "u packets per batch, %" G_GINT64_MODIFIER "u us average, %" G_GINT64_MODIFIER "u us maximum)",
+            name, pcap_opts->batches, avg_packets, avg_usecs, pcap_opts->batch_max_usecs);
+    } else {
+        fprintf(stderr,
+            "Batches read on interface '%s': %u (%" G_GINT64_MODIFIER "u packets per batch, %" G_GINT64_MODIFIER "u us average, %" G_GINT64_MODIFIER "u us maximum)\n",
+            name, pcap_opts->batches, avg_packets, avg_usecs, pcap_opts->batch_max_usecs);
+        /* stderr could be line buffered */
+        fflush(stderr);
+    }
+}
+
+static void
+report_queue_usage(guint interface_id, guint packets, guint bytes, guint high_water)
+{
+    char tmp[4*(SP_DECISIZE+1)+1];
+
+    /* Only of interest to a parent; the standard error has the packet count */
+    if (capture_child) {
+        g_snprintf(tmp, sizeof(tmp), "%u:%u:%u:%u", interface_id, packets, bytes, high_water);
+        g_log(LOG_DOMAIN_CAPTURE_CHILD, G_LOG_LEVEL_DEBUG,
+            "Packets/bytes buffered for interface %u: %u/%u (at most %u packets)",
+            interface_id, packets, bytes, high_water);
+        pipe_write_block(2, SP_QUEUE_USAGE, tmp);
+    }
+}
+
 
 /************************************************************************************************/
 /* signal_pipe handling */
@@ -107,14 +107,32 @@ typedef struct _fd_hash_t {
     md5_byte_t digest[16];
     guint32    len;
     nstime_t   frame_time;
+    guint64    seq;         /* packet sequence number; 0 if unused */
+    int        prev;        /* previous entry with the same digest and length, or -1 */
+    guint64    prev_seq;    /* its sequence number, to tell whether it's been reused */
 } fd_hash_t;
 
 #define DEFAULT_DUP_DEPTH       5   /* Used with -d */
-#define MAX_DUP_DEPTH     1000000   /* the maximum window (and actual size of fd_hash[]) for de-duplication */
+#define MAX_DUP_DEPTH     1000000   /* the maximum window (and size of fd_hash[]) for de-duplication */
 
-static fd_hash_t fd_hash[MAX_DUP_DEPTH];
-static int       dup_window    = DEFAULT_DUP_DEPTH;
-static int       cur_dup_entry = 0;
+static fd_hash_t *fd_hash       = NULL;
+static int        dup_window    = DEFAULT_DUP_DEPTH;
+static int        cur_dup_entry = 0;
+static guint64    dup_seq       = 0;
+static gboolean   fast_dup_hash = FALSE;  /* Used with --fast-dup-hash */
+
+#define LONGOPT_FAST_DUP_HASH   0x10000   /* not a valid short option */
+
+/*
+ * Index of fd_hash[] by digest and length, so that a packet can be
+ * checked against the window without comparing it with every entry.
+ * It's an open-addressing table with linear probing, at most half
+ * full; each bucket holds the fd_hash[] entry of the most recent packet
+ * with a given digest and length, or -1, and earlier packets with the
+ * same digest and length are chained through fd_hash[].prev.
+ */
+static int       *fd_hash_index      = NULL;
+static guint32    fd_hash_index_mask = 0;
 
 static int       ignored_bytes  = 0;  /* Used with -I */
 
@@ -572,47 +590,175 @@ remove_vlan_info(const struct wtap_pkthdr *phdr, guint8* fd, guint32* len) {
     }
 }
 
-static gboolean
-is_duplicate(guint8* fd, guint32 len) {
-    int i;
-    md5_state_t ms;
+/*
+ * MurmurHash3_x64_128, by Austin Appleby, who placed it in the public
+ * domain.  It's much faster than MD5, and used instead of it with
+ * --fast-dup-hash.
+ */
+static inline guint64
+rotl64(guint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
 
-    /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
-    guint32 new_len;
-    guint8 *new_fd;
+static inline guint64
+fmix64(guint64 k)
+{
+    k ^= k >> 33;
+    k *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= G_GUINT64_CONSTANT(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
 
-    new_fd  = &fd[ignored_bytes];
-    new_len = len - (ignored_bytes);
+static void
+murmur3_128(const guint8 *data, guint32 len, guint8 digest[16])
+{
+    const guint64 c1 = G_GUINT64_CONSTANT(0x87c37b91114253d5);
+    const guint64 c2 = G_GUINT64_CONSTANT(0x4cf5ad432745937f);
+    guint64 h1 = 0, h2 = 0, k1, k2;
+    guint8  tail[16];
+    guint32 rest = len & 15;
+    guint32 i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        k1 = pletoh64(data + i);
+        k2 = pletoh64(data + i + 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
 
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
+    /* The last, partial, block, padded with zeroes */
+    memset(tail, 0, sizeof tail);
+    memcpy(tail, data + i, rest);
+    k1 = pletoh64(tail);
+    k2 = pletoh64(tail + 8);
+    if (rest > 8) {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (rest > 0) {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
 
-    /* Calculate our digest */
-    md5_init(&ms);
-    md5_append(&ms, new_fd, new_len);
-    md5_finish(&ms, fd_hash[cur_dup_entry].digest);
+    h1 ^= len;
+    h2 ^= len;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    for (i = 0; i < 8; i++) {
+        digest[i] = (guint8)(h1 >> (8 * i));
+        digest[i + 8] = (guint8)(h2 >> (8 * i));
+    }
+}
 
-    fd_hash[cur_dup_entry].len = len;
+static const char *
+dup_hash_name(void)
+{
+    return fast_dup_hash ? "MurmurHash3" : "MD5";
+}
 
-    /* Look for duplicates */
-    for (i = 0; i < dup_window; i++) {
-        if (i == cur_dup_entry)
-            continue;
+static void
+fd_hash_init(void)
+{
+    guint32 size = 16;
+    int     n    = dup_window > 0 ? dup_window : 1;
+    guint32 b;
+    int     i;
+
+    fd_hash = g_new(fd_hash_t, n);
+    for (i = 0; i < n; i++) {
+        memset(&fd_hash[i].digest, 0, 16);
+        fd_hash[i].len = 0;
+        nstime_set_unset(&fd_hash[i].frame_time);
+        fd_hash[i].seq = 0;
+        fd_hash[i].prev = -1;
+        fd_hash[i].prev_seq = 0;
+    }
 
-        if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-            && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return TRUE;
-        }
+    while (size < 2 * (guint32)n)
+        size <<= 1;
+    fd_hash_index = (int *)g_malloc(size * sizeof (int));
+    fd_hash_index_mask = size - 1;
+    for (b = 0; b < size; b++)
+        fd_hash_index[b] = -1;
+}
+
+static guint32
+fd_hash_home(const fd_hash_t *entry)
+{
+    /* The digest is already well mixed */
+    return (pletoh32(entry->digest) ^ entry->len) & fd_hash_index_mask;
+}
+
+/*
+ * Find the bucket holding the most recent entry with the same digest
+ * and length as this one, or else the empty bucket where it would go.
+ */
+static guint32
+fd_hash_find(const fd_hash_t *entry)
+{
+    guint32 b = fd_hash_home(entry);
+    int     i;
+
+    while ((i = fd_hash_index[b]) != -1) {
+        if (fd_hash[i].len == entry->len
+            && memcmp(fd_hash[i].digest, entry->digest, 16) == 0)
+            break;
+        b = (b + 1) & fd_hash_index_mask;
     }
+    return b;
+}
 
-    return FALSE;
+/* Forget an fd_hash[] entry that's about to be reused */
+static void
+fd_hash_evict(int i)
+{
+    guint32 hole, b;
+
+    if (fd_hash[i].seq == 0)
+        return;
+
+    hole = fd_hash_find(&fd_hash[i]);
+    if (fd_hash_index[hole] != i) {
+        /* A later packet had the same digest, and is still indexed */
+        return;
+    }
+
+    /*
+     * Close up the gap, moving back any following entry that can't
+     * otherwise be found from its home bucket.
+     */
+    for (b = (hole + 1) & fd_hash_index_mask;
+         fd_hash_index[b] != -1;
+         b = (b + 1) & fd_hash_index_mask) {
+        guint32 home = fd_hash_home(&fd_hash[fd_hash_index[b]]);
+
+        if (((b - home) & fd_hash_index_mask) >= ((b - hole) & fd_hash_index_mask)) {
+            fd_hash_index[hole] = fd_hash_index[b];
+            hole = b;
+        }
+    }
+    fd_hash_index[hole] = -1;
 }
 
-static gboolean
-is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
-    int i;
-    md5_state_t ms;
+/*
+ * Put a packet's digest in the next fd_hash[] entry, and index it.
+ * Afterwards, fd_hash[cur_dup_entry].prev is the most recent earlier
+ * entry in the window with the same digest and length, if any.
+ */
+static void
+fd_hash_add(guint8* fd, guint32 len) {
+    fd_hash_t *entry;
+    guint32    b;
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     guint32 new_len;
@@ -625,59 +771,70 @@ is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
     if (cur_dup_entry >= dup_window)
         cur_dup_entry = 0;
 
+    /* The oldest entry drops out of the window */
+    fd_hash_evict(cur_dup_entry);
+    entry = &fd_hash[cur_dup_entry];
+
     /* Calculate our digest */
-    md5_init(&ms);
-    md5_append(&ms, new_fd, new_len);
-    md5_finish(&ms, fd_hash[cur_dup_entry].digest);
+    if (fast_dup_hash) {
+        murmur3_128(new_fd, new_len, entry->digest);
+    } else {
+        md5_state_t ms;
+
+        md5_init(&ms);
+        md5_append(&ms, new_fd, new_len);
+        md5_finish(&ms, entry->digest);
+    }
+
+    entry->len = len;
+    nstime_set_unset(&entry->frame_time);
+    entry->seq = ++dup_seq;
+
+    b = fd_hash_find(entry);
+    entry->prev = fd_hash_index[b];
+    entry->prev_seq = entry->prev != -1 ? fd_hash[entry->prev].seq : 0;
+    fd_hash_index[b] = cur_dup_entry;
+}
+
+static gboolean
+is_duplicate(guint8* fd, guint32 len) {
+    fd_hash_add(fd, len);
+
+    /* Any earlier entry still indexed is in the window */
+    return fd_hash[cur_dup_entry].prev != -1;
+}
+
+static gboolean
+is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
+    int     i;
+    guint64 seq;
 
-    fd_hash[cur_dup_entry].len = len;
+    fd_hash_add(fd, len);
     fd_hash[cur_dup_entry].frame_time.secs = current->secs;
     fd_hash[cur_dup_entry].frame_time.nsecs = current->nsecs;
 
     /*
      * Look for relative time related duplicates.
-     * This is hopefully a reasonably efficient mechanism for
-     * finding duplicates by rel time in the fd_hash[] cache.
-     * We check starting from the most recently added hash
-     * entries and work backwards towards older packets.
-     * This approach allows the dup test to be terminated
-     * when the relative time of a cached entry is found to
-     * be beyond the dup time window.
+     * We check the earlier packets with the same digest and length,
+     * starting from the most recent and working backwards towards
+     * older packets, until we come to one that's beyond the dup time
+     * window or has dropped out of the fd_hash[] cache.
      *
      * Of course this assumes that the input trace file is
      * "well-formed" in the sense that the packet timestamps are
      * in strict chronologically increasing order (which is NOT
      * always the case!!).
      *
-     * The fd_hash[] table was deliberately created large (1,000,000).
-     * Looking for time related duplicates in large trace files with
-     * non-fractional dup time window values can potentially take
-     * a long time to complete.
+     * Only packets with the same digest and length are visited, so
+     * the cost doesn't grow with the size of the window.
      */
 
-    for (i = cur_dup_entry - 1;; i--) {
+    for (i = fd_hash[cur_dup_entry].prev, seq = fd_hash[cur_dup_entry].prev_seq;
+         i != -1 && fd_hash[i].seq == seq;
+         seq = fd_hash[i].prev_seq, i = fd_hash[i].prev) {
         nstime_t delta;
         int cmp;
 
-        if (i < 0)
-            i = dup_window - 1;
-
-        if (i == cur_dup_entry) {
-            /*
-             * We've decremented back to where we started.
-             * Check no more!
-             */
-            break;
-        }
-
-        if (nstime_is_unset(&(fd_hash[i].frame_time))) {
-            /*
-             * We've decremented to an unused fd_hash[] entry.
-             * Check no more!
-             */
-            break;
-        }
-
         nstime_delta(&delta, current, &fd_hash[i].frame_time);
 
         if (delta.secs < 0 || delta.nsecs < 0) {
@@ -711,8 +868,7 @@ is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
              * Check no more!
              */
             break;
-        } else if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-                   && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
+        } else {
             return TRUE;
         }
     }
@@ -743,6 +899,8 @@ print_usage(FILE *output)
     fprintf(output, "                         Valid <dup window> values are 0 to %d.\n", MAX_DUP_DEPTH);
     fprintf(output, "                         NOTE: A <dup window> of 0 with -v (verbose option) is\n");
     fprintf(output, "                         useful to print MD5 hashes.\n");
+    fprintf(output, "  --fast-dup-hash        compare packets by a 128-bit MurmurHash3 of their\n");
+    fprintf(output, "                         contents rather than by MD5; much faster.\n");
     fprintf(output, "  -w <dup time window>   remove packet if duplicate packet is found EQUAL TO OR\n");
     fprintf(output, "                         LESS THAN <dup time window> prior to current packet.\n");
     fprintf(output, "                         A <dup time window> is specified in relative seconds\n");
@@ -936,6 +1094,7 @@ main(int argc, char *argv[])
     int           opt;
     static const struct option long_options[] = {
         {"novlan", no_argument, NULL, 0x8100},
+        {"fast-dup-hash", no_argument, NULL, LONGOPT_FAST_DUP_HASH},
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'V'},
         {0, 0, 0, 0 }
@@ -1028,6 +1187,10 @@ main(int argc, char *argv[])
             break;
         }
 
+        case LONGOPT_FAST_DUP_HASH:
+            fast_dup_hash = TRUE;
+            break;
+
         case 'a':
         {
             guint frame_number;
@@ -1350,11 +1513,7 @@ main(int argc, char *argv[])
             max_packet_number = G_MAXUINT;
 
         if (dup_detect || dup_detect_by_time) {
-            for (i = 0; i < dup_window; i++) {
-                memset(&fd_hash[i].digest, 0, 16);
-                fd_hash[i].len = 0;
-                nstime_set_unset(&fd_hash[i].frame_time);
-            }
+            fd_hash_init();
         }
 
         /* Read all of the packets in turn */
@@ -1610,8 +1769,8 @@ main(int argc, char *argv[])
                 if (dup_detect) {
                     if (is_duplicate(buf, phdr->caplen)) {
                         if (verbose) {
-                            fprintf(stderr, "Skipped: %u, Len: %u, MD5 Hash: ",
-                                    count, phdr->caplen);
+                            fprintf(stderr, "Skipped: %u, Len: %u, %s Hash: ",
+                                    count, phdr->caplen, dup_hash_name());
                             for (i = 0; i < 16; i++)
                                 fprintf(stderr, "%02x",
                                         (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1622,8 +1781,8 @@ main(int argc, char *argv[])
                         continue;
                     } else {
                         if (verbose) {
-                            fprintf(stderr, "Packet: %u, Len: %u, MD5 Hash: ",
-                                    count, phdr->caplen);
+                            fprintf(stderr, "Packet: %u, Len: %u, %s Hash: ",
+                                    count, phdr->caplen, dup_hash_name());
                             for (i = 0; i < 16; i++)
                                 fprintf(stderr, "%02x",
                                         (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1642,8 +1801,8 @@ main(int argc, char *argv[])
 
                         if (is_duplicate_rel_time(buf, phdr->caplen, &current)) {
                             if (verbose) {
-                                fprintf(stderr, "Skipped: %u, Len: %u, MD5 Hash: ",
-                                        count, phdr->caplen);
+                                fprintf(stderr, "Skipped: %u, Len: %u, %s Hash: ",
+                                        count, phdr->caplen, dup_hash_name());
                                 for (i = 0; i < 16; i++)
                                     fprintf(stderr, "%02x",
                                             (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1654,8 +1813,8 @@ main(int argc, char *argv[])
                             continue;
                         } else {
                             if (verbose) {
-                                fprintf(stderr, "Packet: %u, Len: %u, MD5 Hash: ",
-                                        count, phdr->caplen);
+                                fprintf(stderr, "Packet: %u, Len: %u, %s Hash: ",
+                                        count, phdr->caplen, dup_hash_name());
                                 for (i = 0; i < 16; i++)
                                     fprintf(stderr, "%02x",
                                             (unsigned char)fd_hash[cur_dup_entry].digest[i]);
@@ -1834,7 +1993,7 @@ main(int argc, char *argv[])
             }
         }
 
-        g_free(idb_inf);
+        wtap_file_free_idb_info(idb_inf);
         idb_inf = NULL;
 
         if (!wtap_dump_close(pdh, &write_err)) {
@@ -1851,6 +2010,9 @@ main(int argc, char *argv[])
         if (frames_user_comments) {
             g_tree_destroy(frames_user_comments);
         }
+
+        g_free(fd_hash);
+        g_free(fd_hash_index);
     }
 
     if (dup_detect) {
@@ -1870,7 +2032,7 @@ main(int argc, char *argv[])
 error_on_exit:
     wtap_block_array_free(shb_hdrs);
     wtap_block_array_free(nrb_hdrs);
-    g_free(idb_inf);
+    wtap_file_free_idb_info(idb_inf);
     exit(2);
 }
 
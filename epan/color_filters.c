@@ -65,6 +65,35 @@ static gboolean filters_enabled = TRUE;
  */
 static gboolean tmp_colors_set = FALSE;
 
+/* The compiled filters of color_filter_list, as a set, so that the
+ * filters share the work of testing a packet; built when first needed,
+ * and thrown away whenever the list or its filters change. */
+static dfilter_set_t *color_filter_set = NULL;
+
+static void
+color_filter_set_invalidate(void)
+{
+    dfilter_set_free(color_filter_set);
+    color_filter_set = NULL;
+}
+
+static dfilter_set_t *
+color_filter_set_get(void)
+{
+    GSList         *curr;
+    color_filter_t *colorf;
+
+    if (color_filter_set == NULL) {
+        color_filter_set = dfilter_set_new();
+        /* One entry per filter, in list order */
+        for (curr = color_filter_list; curr != NULL; curr = g_slist_next(curr)) {
+            colorf = (color_filter_t *)curr->data;
+            dfilter_set_add(color_filter_set, colorf->c_colorfilter);
+        }
+    }
+    return color_filter_set;
+}
+
 /* Create a new filter */
 color_filter_t *
 color_filter_new(const gchar *name,          /* The name of the filter to create */
@@ -174,6 +203,7 @@ color_filters_set_tmp(guint8 filt_nr, const gchar *filter, gboolean disabled, gc
                 g_free(local_err_msg);
                 return FALSE;
             } else {
+                color_filter_set_invalidate();
                 if (colorf->filter_text != NULL)
                     g_free(colorf->filter_text);
                 if (colorf->c_colorfilter != NULL)
@@ -226,6 +256,8 @@ color_filters_reset_tmp(gchar **err_msg)
 void
 color_filter_delete(color_filter_t *colorf)
 {
+    if (colorf->c_colorfilter != NULL)
+        color_filter_set_invalidate();
     if (colorf->filter_name != NULL)
         g_free(colorf->filter_name);
     if (colorf->filter_text != NULL)
@@ -298,6 +330,7 @@ gboolean
 color_filters_init(gchar** err_msg, color_filter_add_cb_func add_cb)
 {
     /* delete all currently existing filters */
+    color_filter_set_invalidate();
     color_filter_list_delete(&color_filter_list);
 
     /* start the list with the temporary colorizing rules */
@@ -324,6 +357,7 @@ color_filters_reload(gchar** err_msg, color_filter_add_cb_func add_cb)
 {
     /* "move" old entries to the deleted list
      * we must keep them until the dissection no longer needs them */
+    color_filter_set_invalidate();
     color_filter_deleted_list = g_slist_concat(color_filter_deleted_list, color_filter_list);
     color_filter_list = NULL;
 
@@ -424,6 +458,7 @@ color_filters_apply(GSList *tmp_cfl, GSList *edit_cfl, gchar** err_msg)
 
     /* "move" old entries to the deleted list
      * we must keep them until the dissection no longer needs them */
+    color_filter_set_invalidate();
     color_filter_deleted_list = g_slist_concat(color_filter_deleted_list, color_filter_list);
     color_filter_list = NULL;
 
@@ -489,16 +524,20 @@ color_filters_colorize_packet(epan_dissect_t *edt)
 {
     GSList         *curr;
     color_filter_t *colorf;
+    dfilter_set_t  *set;
+    guint           i;
 
     /* If we have color filters, "search" for the matching one. */
     if ((edt->tree != NULL) && (color_filters_used())) {
+        set = color_filter_set_get();
+        dfilter_set_begin(set, edt->tree);
         curr = color_filter_list;
 
-        while(curr != NULL) {
+        for (i = 0; curr != NULL; i++) {
             colorf = (color_filter_t *)curr->data;
             if ( (!colorf->disabled) &&
                  (colorf->c_colorfilter != NULL) &&
-                 dfilter_apply_edt(colorf->c_colorfilter, edt)) {
+                 dfilter_set_apply_nth(set, i)) {
                 return colorf;
             }
             curr = g_slist_next(curr);
@@ -645,6 +684,7 @@ read_filters_file(const gchar *path, FILE *f, gpointer user_data, color_filter_a
                 GSList **cfl = (GSList **)user_data;
 
                 /* internal call */
+                color_filter_set_invalidate();
                 colorf->c_colorfilter = temp_dfilter;
                 *cfl = g_slist_append(*cfl, colorf);
             } else {
@@ -37,9 +37,35 @@ struct epan_dfilter {
 	gboolean	*attempted_load;
 	int		*interesting_fields;
 	int		num_interesting_fields;
+	int		*protocols;
+	int		num_protocols;
 	GPtrArray	*deprecated;
 };
 
+/* A dfilter in a dfilter_set_t */
+typedef struct {
+	dfilter_t	*df;
+	int		*reg_load;	/* shared load into each register, or -1 */
+	int		*insn_test;	/* shared result of each insn, or -1 */
+	int		result;		/* for this packet, or -1 if not run yet */
+} dfilter_set_member_t;
+
+/* Passed back to user */
+struct epan_dfilter_set {
+	GPtrArray	*members;
+	GHashTable	*load_ids;	/* first hfinfo id -> load number + 1 */
+	GHashTable	*test_keys;	/* test description -> test number + 1 */
+	guint		num_loads;
+	guint		num_tests;
+
+	/* Run-time state, for the packet being filtered */
+	proto_tree	*tree;
+	GList		**loads;
+	gboolean	*attempted_loads;
+	gint8		*results;	/* -1 if not done yet */
+	guint32		*matches;
+};
+
 typedef struct {
 	/* Syntax Tree stuff */
 	stnode_t	*st_root;
@@ -142,6 +142,7 @@ dfilter_free(dfilter_t *df)
 	}
 
 	g_free(df->interesting_fields);
+	g_free(df->protocols);
 
 	/* clear registers */
 	for (i = 0; i < df->max_registers; i++) {
@@ -205,6 +206,30 @@ dfwork_free(dfwork_t *dfw)
 	g_free(dfw);
 }
 
+/* Find the protocols of the dfilter's interesting fields */
+static void
+dfilter_find_protocols(dfilter_t *df)
+{
+	int	i, j, proto_id;
+
+	df->protocols = g_new(int, df->num_interesting_fields);
+	df->num_protocols = 0;
+	for (i = 0; i < df->num_interesting_fields; i++) {
+		proto_id = proto_registrar_get_parent(df->interesting_fields[i]);
+		if (proto_id == -1) {
+			/* It's a protocol itself */
+			proto_id = df->interesting_fields[i];
+		}
+		for (j = 0; j < df->num_protocols; j++) {
+			if (df->protocols[j] == proto_id)
+				break;
+		}
+		if (j == df->num_protocols) {
+			df->protocols[df->num_protocols++] = proto_id;
+		}
+	}
+}
+
 gboolean
 dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
 {
@@ -352,6 +377,7 @@ dfilter_compile(const gchar *text, dfilter_t **dfp, gchar **err_msg)
 		dfw->consts = NULL;
 		dfilter->interesting_fields = dfw_interesting_fields(dfw,
 			&dfilter->num_interesting_fields);
+		dfilter_find_protocols(dfilter);
 
 		/* Initialize run-time space */
 		dfilter->num_registers = dfw->first_constant;
@@ -426,12 +452,216 @@ dfilter_prime_proto_tree(const dfilter_t *df, proto_tree *tree)
 	}
 }
 
+const int *
+dfilter_get_protocols(const dfilter_t *df, int *num_protocols)
+{
+	*num_protocols = df->num_protocols;
+	return df->protocols;
+}
+
 gboolean
 dfilter_has_interesting_fields(const dfilter_t *df)
 {
 	return (df->num_interesting_fields > 0);
 }
 
+const int *
+dfilter_get_interesting_fields(const dfilter_t *df, int *num_fields)
+{
+	*num_fields = df->num_interesting_fields;
+	return df->interesting_fields;
+}
+
+gboolean
+dfilter_uses_field_value(const dfilter_t *df, int hfid)
+{
+	header_field_info	*hfinfo;
+	dfvm_insn_t		*insn;
+	guint			i;
+
+	hfinfo = proto_registrar_get_nth(hfid);
+
+	for (i = 0; i < df->insns->len; i++) {
+		insn = (dfvm_insn_t *)g_ptr_array_index(df->insns, i);
+		switch (insn->op) {
+			case READ_TREE:
+			case FIELD_CMP_UINT:
+			case FIELD_CMP_SINT:
+			case FIELD_CMP_IPV4:
+			case FIELD_CMP_SLICE:
+				/* arg1 may be any of the fields with the
+				 * name, so compare names, not ids. */
+				if (strcmp(insn->arg1->value.hfinfo->abbrev,
+				    hfinfo->abbrev) == 0)
+					return TRUE;
+				break;
+			default:
+				break;
+		}
+	}
+	return FALSE;
+}
+
+dfilter_set_t *
+dfilter_set_new(void)
+{
+	dfilter_set_t	*set;
+
+	set = g_new0(dfilter_set_t, 1);
+	set->members = g_ptr_array_new();
+	set->load_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+	set->test_keys = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+
+	return set;
+}
+
+void
+dfilter_set_free(dfilter_set_t *set)
+{
+	dfilter_set_member_t	*member;
+	guint			i;
+
+	if (!set)
+		return;
+
+	for (i = 0; i < set->members->len; i++) {
+		member = (dfilter_set_member_t *)g_ptr_array_index(set->members, i);
+		g_free(member->reg_load);
+		g_free(member->insn_test);
+		g_free(member);
+	}
+	g_ptr_array_free(set->members, TRUE);
+	g_hash_table_destroy(set->load_ids);
+	g_hash_table_destroy(set->test_keys);
+
+	for (i = 0; i < set->num_loads; i++) {
+		g_list_free(set->loads[i]);
+	}
+	g_free(set->loads);
+	g_free(set->attempted_loads);
+	g_free(set->results);
+	g_free(set->matches);
+	g_free(set);
+}
+
+guint
+dfilter_set_add(dfilter_set_t *set, dfilter_t *df)
+{
+	dfilter_set_member_t	*member;
+	guint			idx = set->members->len;
+	guint			num_loads = set->num_loads;
+	guint			num_tests = set->num_tests;
+
+	member = g_new0(dfilter_set_member_t, 1);
+	member->df = df;
+	member->result = -1;
+	if (df) {
+		dfvm_share(set, member);
+	}
+	g_ptr_array_add(set->members, member);
+
+	/* Make room for any new loads and tests */
+	if (set->num_loads > num_loads) {
+		set->loads = g_renew(GList *, set->loads, set->num_loads);
+		set->attempted_loads = g_renew(gboolean, set->attempted_loads, set->num_loads);
+		memset(&set->loads[num_loads], 0,
+			(set->num_loads - num_loads) * sizeof *set->loads);
+		memset(&set->attempted_loads[num_loads], 0,
+			(set->num_loads - num_loads) * sizeof *set->attempted_loads);
+	}
+	if (set->num_tests > num_tests) {
+		set->results = g_renew(gint8, set->results, set->num_tests);
+		memset(&set->results[num_tests], -1, set->num_tests - num_tests);
+	}
+	if (idx % 32 == 0) {
+		set->matches = g_renew(guint32, set->matches, idx / 32 + 1);
+		set->matches[idx / 32] = 0;
+	}
+
+	return idx;
+}
+
+guint
+dfilter_set_count(const dfilter_set_t *set)
+{
+	return set->members->len;
+}
+
+void
+dfilter_set_begin(dfilter_set_t *set, proto_tree *tree)
+{
+	dfilter_set_member_t	*member;
+	guint			i;
+
+	set->tree = tree;
+
+	for (i = 0; i < set->num_loads; i++) {
+		if (set->loads[i]) {
+			g_list_free(set->loads[i]);
+			set->loads[i] = NULL;
+		}
+		set->attempted_loads[i] = FALSE;
+	}
+	if (set->num_tests > 0) {
+		memset(set->results, -1, set->num_tests);
+	}
+	for (i = 0; i < set->members->len; i++) {
+		member = (dfilter_set_member_t *)g_ptr_array_index(set->members, i);
+		member->result = -1;
+	}
+	if (set->members->len > 0) {
+		memset(set->matches, 0,
+			((set->members->len + 31) / 32) * sizeof *set->matches);
+	}
+}
+
+gboolean
+dfilter_set_apply_nth(dfilter_set_t *set, guint idx)
+{
+	dfilter_set_member_t	*member;
+
+	g_assert(idx < set->members->len);
+	member = (dfilter_set_member_t *)g_ptr_array_index(set->members, idx);
+	if (member->df == NULL) {
+		return FALSE;
+	}
+
+	if (member->result < 0) {
+		member->result = dfvm_apply_shared(set, member);
+		if (member->result) {
+			set->matches[idx / 32] |= 1U << (idx % 32);
+		}
+	}
+	return member->result;
+}
+
+const guint32 *
+dfilter_set_apply_edt(dfilter_set_t *set, epan_dissect_t *edt)
+{
+	guint	i;
+
+	dfilter_set_begin(set, edt->tree);
+	for (i = 0; i < set->members->len; i++) {
+		dfilter_set_apply_nth(set, i);
+	}
+	return set->matches;
+}
+
+void
+dfilter_set_prime_proto_tree(const dfilter_set_t *set, proto_tree *tree)
+{
+	dfilter_set_member_t	*member;
+	guint			i;
+
+	for (i = 0; i < set->members->len; i++) {
+		member = (dfilter_set_member_t *)g_ptr_array_index(set->members, i);
+		if (member->df) {
+			dfilter_prime_proto_tree(member->df, tree);
+		}
+	}
+}
+
 GPtrArray *
 dfilter_deprecated_tokens(dfilter_t *df) {
 	if (df->deprecated && df->deprecated->len > 0) {
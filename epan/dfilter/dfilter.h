@@ -26,6 +26,7 @@
 
 /* Passed back to user */
 typedef struct epan_dfilter dfilter_t;
+typedef struct epan_dfilter_set dfilter_set_t;
 
 #include <epan/proto.h>
 
@@ -80,14 +81,87 @@ dfilter_apply(dfilter_t *df, proto_tree *tree);
 void
 dfilter_prime_proto_tree(const dfilter_t *df, proto_tree *tree);
 
+/* The protocols of the fields that the dfilter tests, or that it tests
+ * for the presence of; no other protocol can affect its result, except
+ * by leading to one of these.  Sets *num_protocols. */
+WS_DLL_PUBLIC
+const int *
+dfilter_get_protocols(const dfilter_t *df, int *num_protocols);
+
 /* Check if dfilter has interesting fields */
 gboolean
 dfilter_has_interesting_fields(const dfilter_t *df);
 
+/* The fields that the dfilter looks at, including the other fields with
+ * the same names.  Sets *num_fields. */
+WS_DLL_PUBLIC
+const int *
+dfilter_get_interesting_fields(const dfilter_t *df, int *num_fields);
+
+/* Does the dfilter look at the value of this field, or of a field with
+ * the same name, rather than only checking whether it's present? */
+WS_DLL_PUBLIC
+gboolean
+dfilter_uses_field_value(const dfilter_t *df, int hfid);
+
 WS_DLL_PUBLIC
 GPtrArray *
 dfilter_deprecated_tokens(dfilter_t *df);
 
+/* A set of dfilters run over the same packets, such as the coloring
+ * rules or the tap listeners' filters.  Filters in a set share the
+ * loading of fields from the tree, and any tests that several of them
+ * make (e.g. "tcp" or "ip.addr == 10.0.0.1") are done only once per
+ * packet, so adding filters that look at the same fields costs little.
+ *
+ * The set doesn't own its dfilters; they must not be freed, or
+ * recompiled, while the set is in use. */
+WS_DLL_PUBLIC
+dfilter_set_t *
+dfilter_set_new(void);
+
+WS_DLL_PUBLIC
+void
+dfilter_set_free(dfilter_set_t *set);
+
+/* Add a dfilter to the set; returns its index in the set.  A NULL
+ * dfilter never matches. */
+WS_DLL_PUBLIC
+guint
+dfilter_set_add(dfilter_set_t *set, dfilter_t *df);
+
+/* Number of dfilters in the set */
+WS_DLL_PUBLIC
+guint
+dfilter_set_count(const dfilter_set_t *set);
+
+/* Start filtering a new packet; forgets the results for the last one. */
+WS_DLL_PUBLIC
+void
+dfilter_set_begin(dfilter_set_t *set, proto_tree *tree);
+
+/* Apply the dfilter with this index to the packet given to
+ * dfilter_set_begin().  Only what the filter needs, and hasn't already
+ * been done for another filter in the set, is done. */
+WS_DLL_PUBLIC
+gboolean
+dfilter_set_apply_nth(dfilter_set_t *set, guint idx);
+
+/* Apply all of the dfilters in the set to the packet.  Returns a bitmask
+ * with bit (idx % 32) of word (idx / 32) set if the dfilter with that
+ * index matched; it's valid until the next packet. */
+WS_DLL_PUBLIC
+const guint32 *
+dfilter_set_apply_edt(dfilter_set_t *set, struct epan_dissect *edt);
+
+#define DFILTER_SET_MATCHED(matches, idx) \
+	(((matches)[(idx) / 32] & (1U << ((idx) % 32))) != 0)
+
+/* Prime a proto_tree using the fields/protocols used in the set. */
+WS_DLL_PUBLIC
+void
+dfilter_set_prime_proto_tree(const dfilter_set_t *set, proto_tree *tree);
+
 /* Print bytecode of dfilter to stdout */
 WS_DLL_PUBLIC
 void
@@ -20,6 +20,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "dfvm.h"
 
 #include <ftypes/ftypes-int.h>
@@ -84,6 +86,49 @@ dfvm_value_new(dfvm_value_type_t type)
 	return v;
 }
 
+static const char *
+relation_str(dfvm_opcode_t relation)
+{
+	switch (relation) {
+		case ANY_EQ:
+			return "==";
+		case ANY_NE:
+			return "!=";
+		case ANY_GT:
+			return ">";
+		case ANY_GE:
+			return ">=";
+		case ANY_LT:
+			return "<";
+		case ANY_LE:
+			return "<=";
+		case ANY_BITWISE_AND:
+			return "&";
+		default:
+			g_assert_not_reached();
+			return "?";
+	}
+}
+
+static void
+dump_field_cmp(FILE *f, int id, const char *opname, dfvm_insn_t *insn)
+{
+	char		*value_str;
+	drange_node	*range_item;
+
+	value_str = fvalue_to_string_repr(NULL, insn->arg2->value.fvalue,
+		FTREPR_DFILTER, BASE_NONE);
+	fprintf(f, "%05d %s\t%s", id, opname, insn->arg1->value.hfinfo->abbrev);
+	if (insn->arg4) {
+		range_item = (drange_node *)insn->arg4->value.drange->range_list->data;
+		fprintf(f, "[%d:%d]", range_item->start_offset, range_item->length);
+	}
+	fprintf(f, " %s %s <%s>\n",
+		relation_str((dfvm_opcode_t)insn->arg3->value.numeric),
+		value_str, fvalue_type_name(insn->arg2->value.fvalue));
+	wmem_free(NULL, value_str);
+}
+
 
 void
 dfvm_dump(FILE *f, dfilter_t *df)
@@ -134,6 +179,10 @@ dfvm_dump(FILE *f, dfilter_t *df)
 			case RETURN:
 			case IF_TRUE_GOTO:
 			case IF_FALSE_GOTO:
+			case FIELD_CMP_UINT:
+			case FIELD_CMP_SINT:
+			case FIELD_CMP_IPV4:
+			case FIELD_CMP_SLICE:
 			default:
 				g_assert_not_reached();
 				break;
@@ -282,6 +331,22 @@ dfvm_dump(FILE *f, dfilter_t *df)
 						id, arg1->value.numeric);
 				break;
 
+			case FIELD_CMP_UINT:
+				dump_field_cmp(f, id, "FIELD_CMP_UINT", insn);
+				break;
+
+			case FIELD_CMP_SINT:
+				dump_field_cmp(f, id, "FIELD_CMP_SINT", insn);
+				break;
+
+			case FIELD_CMP_IPV4:
+				dump_field_cmp(f, id, "FIELD_CMP_IPV4", insn);
+				break;
+
+			case FIELD_CMP_SLICE:
+				dump_field_cmp(f, id, "FIELD_CMP_SLICE", insn);
+				break;
+
 			default:
 				g_assert_not_reached();
 				break;
@@ -289,28 +354,15 @@ dfvm_dump(FILE *f, dfilter_t *df)
 	}
 }
 
-/* Reads a field from the proto_tree and loads the fvalues into a register,
- * if that field has not already been read. */
-static gboolean
-read_tree(dfilter_t *df, proto_tree *tree, header_field_info *hfinfo, int reg)
+/* Gets the fvalues of a field, and of any others with the same name,
+ * from the proto_tree; NULL if there are none. */
+static GList *
+load_fvalues(proto_tree *tree, header_field_info *hfinfo)
 {
 	GPtrArray	*finfos;
 	field_info	*finfo;
 	int		i, len;
 	GList		*fvalues = NULL;
-	gboolean	found_something = FALSE;
-
-	/* Already loaded in this run of the dfilter? */
-	if (df->attempted_load[reg]) {
-		if (df->registers[reg]) {
-			return TRUE;
-		}
-		else {
-			return FALSE;
-		}
-	}
-
-	df->attempted_load[reg] = TRUE;
 
 	while (hfinfo) {
 		finfos = proto_get_finfo_ptr_array(tree, hfinfo->id);
@@ -318,9 +370,6 @@ read_tree(dfilter_t *df, proto_tree *tree, header_field_info *hfinfo, int reg)
 			hfinfo = hfinfo->same_name_next;
 			continue;
 		}
-		else {
-			found_something = TRUE;
-		}
 
 		len = finfos->len;
 		for (i = 0; i < len; i++) {
@@ -331,12 +380,44 @@ read_tree(dfilter_t *df, proto_tree *tree, header_field_info *hfinfo, int reg)
 		hfinfo = hfinfo->same_name_next;
 	}
 
-	if (!found_something) {
-		return FALSE;
+	return fvalues;
+}
+
+/* Reads a field from the proto_tree and loads the fvalues into a register,
+ * if that field has not already been read. */
+static gboolean
+read_tree(dfilter_t *df, proto_tree *tree, header_field_info *hfinfo, int reg)
+{
+	/* Already loaded in this run of the dfilter? */
+	if (df->attempted_load[reg]) {
+		if (df->registers[reg]) {
+			return TRUE;
+		}
+		else {
+			return FALSE;
+		}
 	}
 
-	df->registers[reg] = fvalues;
-	return TRUE;
+	df->attempted_load[reg] = TRUE;
+
+	df->registers[reg] = load_fvalues(tree, hfinfo);
+	return df->registers[reg] != NULL;
+}
+
+/* As read_tree(), but the values are loaded into the dfilter_set_t, for
+ * any of its dfilters to use, and the register just points to them. */
+static gboolean
+read_tree_shared(dfilter_set_t *set, dfilter_t *df,
+		header_field_info *hfinfo, int reg, int load)
+{
+	if (!set->attempted_loads[load]) {
+		set->attempted_loads[load] = TRUE;
+		set->loads[load] = load_fvalues(set->tree, hfinfo);
+	}
+
+	df->attempted_load[reg] = TRUE;
+	df->registers[reg] = set->loads[load];
+	return df->registers[reg] != NULL;
 }
 
 
@@ -370,6 +451,178 @@ any_test(dfilter_t *df, FvalueCmpFunc cmp, int reg1, int reg2)
 }
 
 
+/* The typed FIELD_CMP_xxx tests.  Rather than loading the field's values
+ * into a register list and calling the ftype's comparison function on
+ * each one, they go through the field's values where the tree keeps
+ * them, comparing the raw values inline.  Each relation gets its own
+ * loop, so there's no per-value dispatch either. */
+#define FOREACH_FIELD_VALUE(hfinfo, tree, fv, test)			\
+	do {								\
+		header_field_info	*hf_;				\
+		GPtrArray		*finfos_;			\
+		guint			i_;				\
+									\
+		for (hf_ = (hfinfo); hf_; hf_ = hf_->same_name_next) {	\
+			finfos_ = proto_get_finfo_ptr_array((tree), hf_->id); \
+			if (finfos_ == NULL)				\
+				continue;				\
+			for (i_ = 0; i_ < finfos_->len; i_++) {		\
+				const fvalue_t *fv = &((field_info *)g_ptr_array_index(finfos_, i_))->value; \
+				if (test)				\
+					return TRUE;			\
+			}						\
+		}							\
+	} while (0)
+
+static gboolean
+field_cmp_uint(proto_tree *tree, header_field_info *hfinfo,
+		dfvm_opcode_t relation, guint32 b)
+{
+	switch (relation) {
+		case ANY_EQ:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.uinteger == b);
+			break;
+		case ANY_NE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.uinteger != b);
+			break;
+		case ANY_GT:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.uinteger > b);
+			break;
+		case ANY_GE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.uinteger >= b);
+			break;
+		case ANY_LT:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.uinteger < b);
+			break;
+		case ANY_LE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.uinteger <= b);
+			break;
+		case ANY_BITWISE_AND:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, (a->value.uinteger & b) != 0);
+			break;
+		default:
+			g_assert_not_reached();
+	}
+	return FALSE;
+}
+
+static gboolean
+field_cmp_sint(proto_tree *tree, header_field_info *hfinfo,
+		dfvm_opcode_t relation, gint32 b)
+{
+	switch (relation) {
+		case ANY_EQ:
+		case ANY_NE:
+		case ANY_BITWISE_AND:
+			/* Same as for unsigned values */
+			return field_cmp_uint(tree, hfinfo, relation, (guint32)b);
+		case ANY_GT:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.sinteger > b);
+			break;
+		case ANY_GE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.sinteger >= b);
+			break;
+		case ANY_LT:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.sinteger < b);
+			break;
+		case ANY_LE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a, a->value.sinteger <= b);
+			break;
+		default:
+			g_assert_not_reached();
+	}
+	return FALSE;
+}
+
+/* As ipv4_addr_and_mask_xx(), comparing under the shorter netmask */
+#define IPV4_MASKED(a, b)	((a)->addr & MIN((a)->nmask, (b)->nmask))
+
+static gboolean
+field_cmp_ipv4(proto_tree *tree, header_field_info *hfinfo,
+		dfvm_opcode_t relation, const ipv4_addr_and_mask *b)
+{
+	guint32		b_masked = b->addr & b->nmask;
+
+	switch (relation) {
+		case ANY_EQ:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				IPV4_MASKED(&a->value.ipv4, b) == IPV4_MASKED(b, &a->value.ipv4));
+			break;
+		case ANY_NE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				IPV4_MASKED(&a->value.ipv4, b) != IPV4_MASKED(b, &a->value.ipv4));
+			break;
+		case ANY_GT:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				IPV4_MASKED(&a->value.ipv4, b) > IPV4_MASKED(b, &a->value.ipv4));
+			break;
+		case ANY_GE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				IPV4_MASKED(&a->value.ipv4, b) >= IPV4_MASKED(b, &a->value.ipv4));
+			break;
+		case ANY_LT:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				IPV4_MASKED(&a->value.ipv4, b) < IPV4_MASKED(b, &a->value.ipv4));
+			break;
+		case ANY_LE:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				IPV4_MASKED(&a->value.ipv4, b) <= IPV4_MASKED(b, &a->value.ipv4));
+			break;
+		case ANY_BITWISE_AND:
+			FOREACH_FIELD_VALUE(hfinfo, tree, a,
+				((a->value.ipv4.addr & a->value.ipv4.nmask) & b_masked) != 0);
+			break;
+		default:
+			g_assert_not_reached();
+	}
+	return FALSE;
+}
+
+/* Compare field[start:length] with a byte string, as MK_RANGE followed
+ * by ANY_EQ or ANY_NE would, but without making the slices; a slice
+ * that runs off the end of the value is empty. */
+static gboolean
+field_cmp_slice(proto_tree *tree, header_field_info *hfinfo,
+		dfvm_opcode_t relation, guint start, guint length,
+		const GByteArray *b)
+{
+	gboolean	want = (relation == ANY_EQ);
+
+	g_assert(relation == ANY_EQ || relation == ANY_NE);
+	FOREACH_FIELD_VALUE(hfinfo, tree, a,
+		(start + length <= a->value.bytes->len ?
+			(length == b->len &&
+			 memcmp(a->value.bytes->data + start, b->data, length) == 0) :
+			b->len == 0) == want);
+	return FALSE;
+}
+
+static gboolean
+field_cmp(dfvm_insn_t *insn, proto_tree *tree)
+{
+	header_field_info	*hfinfo = insn->arg1->value.hfinfo;
+	fvalue_t		*b = insn->arg2->value.fvalue;
+	dfvm_opcode_t		relation = (dfvm_opcode_t)insn->arg3->value.numeric;
+	drange_node		*range_item;
+
+	switch (insn->op) {
+		case FIELD_CMP_UINT:
+			return field_cmp_uint(tree, hfinfo, relation, b->value.uinteger);
+		case FIELD_CMP_SINT:
+			return field_cmp_sint(tree, hfinfo, relation, b->value.sinteger);
+		case FIELD_CMP_IPV4:
+			return field_cmp_ipv4(tree, hfinfo, relation, &b->value.ipv4);
+		case FIELD_CMP_SLICE:
+			range_item = (drange_node *)insn->arg4->value.drange->range_list->data;
+			return field_cmp_slice(tree, hfinfo, relation,
+				range_item->start_offset, range_item->length,
+				b->value.bytes);
+		default:
+			g_assert_not_reached();
+			return FALSE;
+	}
+}
+
 /* Free the list nodes w/o freeing the memory that each
  * list node points to. */
 static void
@@ -415,19 +668,90 @@ mk_range(dfilter_t *df, int from_reg, int to_reg, drange_t *d_range)
 
 
 
-gboolean
-dfvm_apply(dfilter_t *df, proto_tree *tree)
+/* Does an instruction that tests the tree, or registers already loaded
+ * from it, and returns the result. */
+static gboolean
+run_test(dfilter_t *df, proto_tree *tree, dfvm_insn_t *insn)
 {
-	int		id, length;
+	dfvm_value_t	*arg1 = insn->arg1;
+	dfvm_value_t	*arg2 = insn->arg2;
+	header_field_info	*hfinfo;
+
+	switch (insn->op) {
+		case CHECK_EXISTS:
+			for (hfinfo = arg1->value.hfinfo; hfinfo; hfinfo = hfinfo->same_name_next) {
+				if (proto_check_for_protocol_or_field(tree, hfinfo->id)) {
+					return TRUE;
+				}
+			}
+			return FALSE;
+
+		case ANY_EQ:
+			return any_test(df, fvalue_eq,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_NE:
+			return any_test(df, fvalue_ne,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_GT:
+			return any_test(df, fvalue_gt,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_GE:
+			return any_test(df, fvalue_ge,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_LT:
+			return any_test(df, fvalue_lt,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_LE:
+			return any_test(df, fvalue_le,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_BITWISE_AND:
+			return any_test(df, fvalue_bitwise_and,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_CONTAINS:
+			return any_test(df, fvalue_contains,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case ANY_MATCHES:
+			return any_test(df, fvalue_matches,
+					arg1->value.numeric, arg2->value.numeric);
+
+		case FIELD_CMP_UINT:
+		case FIELD_CMP_SINT:
+		case FIELD_CMP_IPV4:
+		case FIELD_CMP_SLICE:
+			return field_cmp(insn, tree);
+
+		default:
+			g_assert_not_reached();
+			return FALSE;
+	}
+}
+
+/* Runs a dfilter.  If it's in a dfilter_set_t, set and member are
+ * non-NULL, and field loads and tests shared with other dfilters in
+ * the set are taken from the set if they have already been done. */
+static gboolean
+dfvm_run(dfilter_t *df, proto_tree *tree, dfilter_set_t *set,
+		dfilter_set_member_t *member)
+{
+	int		id, length, reg;
 	gboolean	accum = TRUE;
 	dfvm_insn_t	*insn;
 	dfvm_value_t	*arg1;
 	dfvm_value_t	*arg2;
 	dfvm_value_t	*arg3 = NULL;
 	dfvm_value_t	*arg4 = NULL;
-	header_field_info	*hfinfo;
 	GList		*param1;
 	GList		*param2;
+	gint8		*result;
+	guint		i;
 
 	g_assert(tree);
 
@@ -440,24 +764,44 @@ dfvm_apply(dfilter_t *df, proto_tree *tree)
 		arg1 = insn->arg1;
 		arg2 = insn->arg2;
 
+		if (member && member->insn_test[id] >= 0) {
+			result = &set->results[member->insn_test[id]];
+			if (*result < 0) {
+				*result = run_test(df, tree, insn);
+			}
+			accum = *result;
+			continue;
+		}
+
 		switch (insn->op) {
 			case CHECK_EXISTS:
-				hfinfo = arg1->value.hfinfo;
-				while(hfinfo) {
-					accum = proto_check_for_protocol_or_field(tree,
-							hfinfo->id);
-					if (accum) {
-						break;
-					}
-					else {
-						hfinfo = hfinfo->same_name_next;
-					}
-				}
+			case ANY_EQ:
+			case ANY_NE:
+			case ANY_GT:
+			case ANY_GE:
+			case ANY_LT:
+			case ANY_LE:
+			case ANY_BITWISE_AND:
+			case ANY_CONTAINS:
+			case ANY_MATCHES:
+			case FIELD_CMP_UINT:
+			case FIELD_CMP_SINT:
+			case FIELD_CMP_IPV4:
+			case FIELD_CMP_SLICE:
+				accum = run_test(df, tree, insn);
 				break;
 
 			case READ_TREE:
-				accum = read_tree(df, tree,
-						arg1->value.hfinfo, arg2->value.numeric);
+				reg = arg2->value.numeric;
+				if (member && member->reg_load[reg] >= 0) {
+					accum = read_tree_shared(set, df,
+							arg1->value.hfinfo, reg,
+							member->reg_load[reg]);
+				}
+				else {
+					accum = read_tree(df, tree,
+							arg1->value.hfinfo, reg);
+				}
 				break;
 
 			case CALL_FUNCTION:
@@ -482,56 +826,19 @@ dfvm_apply(dfilter_t *df, proto_tree *tree)
 						arg3->value.drange);
 				break;
 
-			case ANY_EQ:
-				accum = any_test(df, fvalue_eq,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_NE:
-				accum = any_test(df, fvalue_ne,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_GT:
-				accum = any_test(df, fvalue_gt,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_GE:
-				accum = any_test(df, fvalue_ge,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_LT:
-				accum = any_test(df, fvalue_lt,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_LE:
-				accum = any_test(df, fvalue_le,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_BITWISE_AND:
-				accum = any_test(df, fvalue_bitwise_and,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_CONTAINS:
-				accum = any_test(df, fvalue_contains,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
-			case ANY_MATCHES:
-				accum = any_test(df, fvalue_matches,
-						arg1->value.numeric, arg2->value.numeric);
-				break;
-
 			case NOT:
 				accum = !accum;
 				break;
 
 			case RETURN:
+				if (member) {
+					/* The set owns the lists in these */
+					for (i = 0; i < df->num_registers; i++) {
+						if (member->reg_load[i] >= 0) {
+							df->registers[i] = NULL;
+						}
+					}
+				}
 				free_register_overhead(df);
 				return accum;
 
@@ -567,6 +874,203 @@ dfvm_apply(dfilter_t *df, proto_tree *tree)
 	return FALSE; /* to appease the compiler */
 }
 
+gboolean
+dfvm_apply(dfilter_t *df, proto_tree *tree)
+{
+	return dfvm_run(df, tree, NULL, NULL);
+}
+
+gboolean
+dfvm_apply_shared(dfilter_set_t *set, dfilter_set_member_t *member)
+{
+	return dfvm_run(member->df, set->tree, set, member);
+}
+
+/* A description of a constant, such that two constants with the same
+ * description are equal for any relation; NULL for the types where the
+ * string representation isn't exact enough for that, which just means
+ * that tests using them aren't shared. */
+static gchar *
+const_key(fvalue_t *fv)
+{
+	enum ftenum	ftype = fvalue_type_ftenum(fv);
+	GString		*key;
+	guint		i;
+
+	switch (ftype) {
+		case FT_UINT8:
+		case FT_UINT16:
+		case FT_UINT24:
+		case FT_UINT32:
+		case FT_FRAMENUM:
+		case FT_IPXNET:
+			return g_strdup_printf("u%d:%u", ftype, fv->value.uinteger);
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+			return g_strdup_printf("s%d:%d", ftype, fv->value.sinteger);
+		case FT_IPv4:
+			return g_strdup_printf("a%d:%08x/%08x", ftype,
+				fv->value.ipv4.addr, fv->value.ipv4.nmask);
+		case FT_BYTES:
+		case FT_UINT_BYTES:
+		case FT_AX25:
+		case FT_VINES:
+		case FT_ETHER:
+		case FT_OID:
+		case FT_REL_OID:
+		case FT_SYSTEM_ID:
+		case FT_FCWWN:
+			key = g_string_new(NULL);
+			g_string_printf(key, "b%d:", ftype);
+			for (i = 0; i < fv->value.bytes->len; i++) {
+				g_string_append_printf(key, "%02x", fv->value.bytes->data[i]);
+			}
+			return g_string_free(key, FALSE);
+		case FT_STRING:
+		case FT_STRINGZ:
+		case FT_UINT_STRING:
+		case FT_STRINGZPAD:
+			/* With the length, as it could contain anything */
+			return g_strdup_printf("t%d:%u:%s", ftype,
+				(guint)strlen(fv->value.string), fv->value.string);
+		default:
+			return NULL;
+	}
+}
+
+/* A description of a test instruction that's the same for any other
+ * instruction, in any dfilter, that always gets the same result; NULL if
+ * the instruction can't be shared.  reg_key has a description of what's
+ * in each register, or NULL. */
+static gchar *
+test_key(dfvm_insn_t *insn, gchar **reg_key)
+{
+	gchar		*value_key, *key;
+	drange_node	*range_item;
+
+	switch (insn->op) {
+		case CHECK_EXISTS:
+			return g_strdup_printf("E%d", insn->arg1->value.hfinfo->id);
+
+		case ANY_EQ:
+		case ANY_NE:
+		case ANY_GT:
+		case ANY_GE:
+		case ANY_LT:
+		case ANY_LE:
+		case ANY_BITWISE_AND:
+		case ANY_CONTAINS:
+		case ANY_MATCHES:
+			if (reg_key[insn->arg1->value.numeric] == NULL ||
+			    reg_key[insn->arg2->value.numeric] == NULL) {
+				return NULL;
+			}
+			return g_strdup_printf("A%d:%s:%s", insn->op,
+				reg_key[insn->arg1->value.numeric],
+				reg_key[insn->arg2->value.numeric]);
+
+		case FIELD_CMP_UINT:
+		case FIELD_CMP_SINT:
+		case FIELD_CMP_IPV4:
+		case FIELD_CMP_SLICE:
+			value_key = const_key(insn->arg2->value.fvalue);
+			if (value_key == NULL) {
+				return NULL;
+			}
+			if (insn->arg4) {
+				range_item = (drange_node *)insn->arg4->value.drange->range_list->data;
+				key = g_strdup_printf("C%d:%d:%u:%d:%d:%s", insn->op,
+					insn->arg1->value.hfinfo->id,
+					insn->arg3->value.numeric,
+					range_item->start_offset, range_item->length,
+					value_key);
+			}
+			else {
+				key = g_strdup_printf("C%d:%d:%u:%s", insn->op,
+					insn->arg1->value.hfinfo->id,
+					insn->arg3->value.numeric, value_key);
+			}
+			g_free(value_key);
+			return key;
+
+		default:
+			return NULL;
+	}
+}
+
+/* Find the field loads and tests of a dfilter that are shared with other
+ * dfilters in the set, numbering any new ones. */
+void
+dfvm_share(dfilter_set_t *set, dfilter_set_member_t *member)
+{
+	dfilter_t	*df = member->df;
+	dfvm_insn_t	*insn;
+	gchar		**reg_key;
+	gchar		*key;
+	gpointer	num;
+	guint		id, reg;
+	int		hfid;
+
+	member->reg_load = g_new(int, df->max_registers);
+	for (reg = 0; reg < df->max_registers; reg++) {
+		member->reg_load[reg] = -1;
+	}
+	member->insn_test = g_new(int, df->insns->len);
+	for (id = 0; id < df->insns->len; id++) {
+		member->insn_test[id] = -1;
+	}
+	reg_key = g_new0(gchar *, df->max_registers);
+
+	for (id = 0; id < df->consts->len; id++) {
+		insn = (dfvm_insn_t *)g_ptr_array_index(df->consts, id);
+		reg = insn->arg2->value.numeric;
+		reg_key[reg] = const_key(insn->arg1->value.fvalue);
+	}
+
+	for (id = 0; id < df->insns->len; id++) {
+		insn = (dfvm_insn_t *)g_ptr_array_index(df->insns, id);
+		if (insn->op != READ_TREE) {
+			continue;
+		}
+		reg = insn->arg2->value.numeric;
+		if (member->reg_load[reg] >= 0) {
+			continue;
+		}
+		hfid = insn->arg1->value.hfinfo->id;
+		num = g_hash_table_lookup(set->load_ids, GINT_TO_POINTER(hfid));
+		if (num == NULL) {
+			num = GUINT_TO_POINTER(++set->num_loads);
+			g_hash_table_insert(set->load_ids, GINT_TO_POINTER(hfid), num);
+		}
+		member->reg_load[reg] = GPOINTER_TO_UINT(num) - 1;
+		reg_key[reg] = g_strdup_printf("f%d", hfid);
+	}
+
+	for (id = 0; id < df->insns->len; id++) {
+		insn = (dfvm_insn_t *)g_ptr_array_index(df->insns, id);
+		key = test_key(insn, reg_key);
+		if (key == NULL) {
+			continue;
+		}
+		num = g_hash_table_lookup(set->test_keys, key);
+		if (num == NULL) {
+			num = GUINT_TO_POINTER(++set->num_tests);
+			g_hash_table_insert(set->test_keys, key, num);
+		}
+		else {
+			g_free(key);
+		}
+		member->insn_test[id] = GPOINTER_TO_UINT(num) - 1;
+	}
+
+	for (reg = 0; reg < df->max_registers; reg++) {
+		g_free(reg_key[reg]);
+	}
+	g_free(reg_key);
+}
+
 void
 dfvm_init_const(dfilter_t *df)
 {
@@ -605,6 +1109,10 @@ dfvm_init_const(dfilter_t *df)
 			case RETURN:
 			case IF_TRUE_GOTO:
 			case IF_FALSE_GOTO:
+			case FIELD_CMP_UINT:
+			case FIELD_CMP_SINT:
+			case FIELD_CMP_IPV4:
+			case FIELD_CMP_SLICE:
 			default:
 				g_assert_not_reached();
 				break;
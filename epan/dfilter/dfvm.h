@@ -71,7 +71,16 @@ typedef enum {
 	ANY_CONTAINS,
 	ANY_MATCHES,
 	MK_RANGE,
-    CALL_FUNCTION
+    CALL_FUNCTION,
+
+	/* Typed tests of a field against a constant, generated instead of
+	 * READ_TREE and ANY_xxx when the types allow it.  arg1 is the field,
+	 * arg2 the constant and arg3 the ANY_xxx relation; FIELD_CMP_SLICE
+	 * has the (single, non-negative) range in arg4. */
+	FIELD_CMP_UINT,		/* 32-bit unsigned integers */
+	FIELD_CMP_SINT,		/* 32-bit signed integers */
+	FIELD_CMP_IPV4,		/* IPv4 addresses, honoring netmasks */
+	FIELD_CMP_SLICE		/* a slice of a byte string, == or != */
 
 } dfvm_opcode_t;
 
@@ -99,6 +108,12 @@ dfvm_dump(FILE *f, dfilter_t *df);
 gboolean
 dfvm_apply(dfilter_t *df, proto_tree *tree);
 
+void
+dfvm_share(dfilter_set_t *set, dfilter_set_member_t *member);
+
+gboolean
+dfvm_apply_shared(dfilter_set_t *set, dfilter_set_member_t *member);
+
 void
 dfvm_init_const(dfilter_t *df);
 
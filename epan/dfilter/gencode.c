@@ -52,6 +52,29 @@ dfw_append_const(dfwork_t *dfw, dfvm_insn_t *insn)
 	g_ptr_array_add(dfw->consts, insn);
 }
 
+/* Rewind to the first field with this field's name */
+static header_field_info *
+first_same_name(header_field_info *hfinfo)
+{
+	while (hfinfo->same_name_prev_id != -1) {
+		hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
+	}
+	return hfinfo;
+}
+
+/* Record the FIELD_ID of the field, and of any others with the
+ * same name, in the hash of interesting fields. */
+static void
+dfw_add_interesting_fields(dfwork_t *dfw, header_field_info *hfinfo)
+{
+	while (hfinfo) {
+		g_hash_table_insert(dfw->interesting_fields,
+		    GINT_TO_POINTER(hfinfo->id),
+		    GUINT_TO_POINTER(TRUE));
+		hfinfo = hfinfo->same_name_next;
+	}
+}
+
 /* returns register number */
 static int
 dfw_append_read_tree(dfwork_t *dfw, header_field_info *hfinfo)
@@ -62,9 +85,7 @@ dfw_append_read_tree(dfwork_t *dfw, header_field_info *hfinfo)
 	gboolean	added_new_hfinfo = FALSE;
 
 	/* Rewind to find the first field of this name. */
-	while (hfinfo->same_name_prev_id != -1) {
-		hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
-	}
+	hfinfo = first_same_name(hfinfo);
 
 	/* Keep track of which registers
 	 * were used for which hfinfo's so that we
@@ -97,13 +118,7 @@ dfw_append_read_tree(dfwork_t *dfw, header_field_info *hfinfo)
 	dfw_append_insn(dfw, insn);
 
 	if (added_new_hfinfo) {
-		while (hfinfo) {
-			/* Record the FIELD_ID in hash of interesting fields. */
-			g_hash_table_insert(dfw->interesting_fields,
-			    GINT_TO_POINTER(hfinfo->id),
-			    GUINT_TO_POINTER(TRUE));
-			hfinfo = hfinfo->same_name_next;
-		}
+		dfw_add_interesting_fields(dfw, hfinfo);
 	}
 
 	return reg;
@@ -245,6 +260,175 @@ dfw_append_function(dfwork_t *dfw, stnode_t *node, dfvm_value_t **p_jmp)
 }
 
 
+/* The FIELD_CMP_xxx opcode that can test a field of this type, if any */
+static dfvm_opcode_t
+field_cmp_opcode(enum ftenum ftype)
+{
+	switch (ftype) {
+		case FT_UINT8:
+		case FT_UINT16:
+		case FT_UINT24:
+		case FT_UINT32:
+		case FT_FRAMENUM:
+		case FT_IPXNET:
+			return FIELD_CMP_UINT;
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+			return FIELD_CMP_SINT;
+		case FT_IPv4:
+			return FIELD_CMP_IPV4;
+		case FT_BYTES:
+		case FT_UINT_BYTES:
+		case FT_AX25:
+		case FT_VINES:
+		case FT_ETHER:
+		case FT_OID:
+		case FT_REL_OID:
+		case FT_SYSTEM_ID:
+		case FT_FCWWN:
+			return FIELD_CMP_SLICE;
+		default:
+			return RETURN;	/* none */
+	}
+}
+
+/* As field_cmp_opcode(), for all the fields with this field's name */
+static dfvm_opcode_t
+field_cmp_opcode_for_name(header_field_info *hfinfo)
+{
+	dfvm_opcode_t	op;
+
+	hfinfo = first_same_name(hfinfo);
+	op = field_cmp_opcode(hfinfo->type);
+	for (hfinfo = hfinfo->same_name_next; hfinfo; hfinfo = hfinfo->same_name_next) {
+		if (field_cmp_opcode(hfinfo->type) != op) {
+			return RETURN;
+		}
+	}
+	return op;
+}
+
+/* The relation to test with the operands the other way round */
+static dfvm_opcode_t
+swap_relation(dfvm_opcode_t op)
+{
+	switch (op) {
+		case ANY_GT:
+			return ANY_LT;
+		case ANY_GE:
+			return ANY_LE;
+		case ANY_LT:
+			return ANY_GT;
+		case ANY_LE:
+			return ANY_GE;
+		default:
+			return op;
+	}
+}
+
+/* Specialization: if a relation between a field, or a slice of one, and
+ * a constant can be done by one of the typed FIELD_CMP_xxx opcodes,
+ * generate that rather than READ_TREE and ANY_xxx, and return TRUE. */
+static gboolean
+gen_field_cmp(dfwork_t *dfw, dfvm_opcode_t op, stnode_t *st_arg1, stnode_t *st_arg2)
+{
+	stnode_t		*st_field, *st_range = NULL;
+	header_field_info	*hfinfo;
+	fvalue_t		*fv;
+	drange_t		*d_range = NULL;
+	drange_node		*range_item;
+	dfvm_opcode_t		cmp_op;
+	dfvm_insn_t		*insn;
+	dfvm_value_t		*val;
+
+	switch (op) {
+		case ANY_EQ:
+		case ANY_NE:
+		case ANY_GT:
+		case ANY_GE:
+		case ANY_LT:
+		case ANY_LE:
+		case ANY_BITWISE_AND:
+			break;
+		default:
+			return FALSE;
+	}
+
+	/* field <op> constant, or constant <op> field */
+	if (stnode_type_id(st_arg2) != STTYPE_FVALUE) {
+		if (stnode_type_id(st_arg1) != STTYPE_FVALUE) {
+			return FALSE;
+		}
+		op = swap_relation(op);
+		st_field = st_arg2;
+		st_arg2 = st_arg1;
+	}
+	else {
+		st_field = st_arg1;
+	}
+	fv = (fvalue_t *)stnode_data(st_arg2);
+
+	if (stnode_type_id(st_field) == STTYPE_RANGE) {
+		st_range = st_field;
+		st_field = sttype_range_entity(st_range);
+		d_range = sttype_range_drange(st_range);
+	}
+	if (stnode_type_id(st_field) != STTYPE_FIELD) {
+		return FALSE;
+	}
+	hfinfo = (header_field_info *)stnode_data(st_field);
+
+	cmp_op = field_cmp_opcode_for_name(hfinfo);
+	if (cmp_op == RETURN) {
+		return FALSE;
+	}
+	if (st_range) {
+		/* Only byte strings, and a single [start:length] slice
+		 * at a known offset, compared for (in)equality */
+		if (cmp_op != FIELD_CMP_SLICE ||
+		    fvalue_type_ftenum(fv) != FT_BYTES ||
+		    (op != ANY_EQ && op != ANY_NE) ||
+		    g_slist_length(d_range->range_list) != 1) {
+			return FALSE;
+		}
+		range_item = (drange_node *)d_range->range_list->data;
+		if (drange_node_get_ending(range_item) != DRANGE_NODE_END_T_LENGTH ||
+		    drange_node_get_start_offset(range_item) < 0) {
+			return FALSE;
+		}
+	}
+	else {
+		if (cmp_op == FIELD_CMP_SLICE ||
+		    field_cmp_opcode(fvalue_type_ftenum(fv)) != cmp_op) {
+			return FALSE;
+		}
+	}
+
+	hfinfo = first_same_name(hfinfo);
+	insn = dfvm_insn_new(cmp_op);
+	val = dfvm_value_new(HFINFO);
+	val->value.hfinfo = hfinfo;
+	insn->arg1 = val;
+	val = dfvm_value_new(FVALUE);
+	val->value.fvalue = fv;
+	insn->arg2 = val;
+	val = dfvm_value_new(INTEGER);
+	val->value.numeric = op;
+	insn->arg3 = val;
+	if (st_range) {
+		val = dfvm_value_new(DRANGE);
+		val->value.drange = d_range;
+		insn->arg4 = val;
+		sttype_range_remove_drange(st_range);
+	}
+	dfw_append_insn(dfw, insn);
+
+	dfw_add_interesting_fields(dfw, hfinfo);
+	return TRUE;
+}
+
 static void
 gen_relation(dfwork_t *dfw, dfvm_opcode_t op, stnode_t *st_arg1, stnode_t *st_arg2)
 {
@@ -253,6 +437,10 @@ gen_relation(dfwork_t *dfw, dfvm_opcode_t op, stnode_t *st_arg1, stnode_t *st_ar
 	dfvm_value_t	*jmp1 = NULL, *jmp2 = NULL;
 	int		reg1 = -1, reg2 = -1;
 
+	if (gen_field_cmp(dfw, op, st_arg1, st_arg2)) {
+		return;
+	}
+
     /* Create code for the LHS and RHS of the relation */
     reg1 = gen_entity(dfw, st_arg1, &jmp1);
     reg2 = gen_entity(dfw, st_arg2, &jmp2);
@@ -414,21 +602,13 @@ gen_test(dfwork_t *dfw, stnode_t *st_node)
 			hfinfo = (header_field_info*)stnode_data(st_arg1);
 
 			/* Rewind to find the first field of this name. */
-			while (hfinfo->same_name_prev_id != -1) {
-				hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
-			}
+			hfinfo = first_same_name(hfinfo);
 			val1->value.hfinfo = hfinfo;
 			insn = dfvm_insn_new(CHECK_EXISTS);
 			insn->arg1 = val1;
 			dfw_append_insn(dfw, insn);
 
-			/* Record the FIELD_ID in hash of interesting fields. */
-			while (hfinfo) {
-				g_hash_table_insert(dfw->interesting_fields,
-					GINT_TO_POINTER(hfinfo->id),
-					GUINT_TO_POINTER(TRUE));
-				hfinfo = hfinfo->same_name_next;
-			}
+			dfw_add_interesting_fields(dfw, hfinfo);
 
 			break;
 
@@ -163,6 +163,12 @@ proto_register_data(void)
 	 * is disabled, so it cannot itself be disabled.
 	 */
 	proto_set_cant_toggle(proto_data);
+
+	/*
+	 * It keeps no state, so it needn't be called if nothing it
+	 * adds is wanted.
+	 */
+	proto_set_stateless(proto_data);
 }
 
 /*
@@ -114,6 +114,12 @@ proto_register_media(void)
      * is disabled, so it cannot itself be disabled.
      */
     proto_set_cant_toggle(proto_media);
+
+    /*
+     * It keeps no state, and only hands the data on to heuristic
+     * dissectors, so it needn't be called if nothing they add is wanted.
+     */
+    proto_set_stateless(proto_media);
 }
 
 /*
@@ -5769,15 +5769,26 @@ dissect_x11(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void* data _U_)
       return tvb_captured_length(tvb);
 }
 
-/* Register the protocol with Wireshark */
-void proto_register_x11(void)
+/*
+ * The X11 core protocol and its extensions have thousands of fields, so
+ * their registration is delayed until they're used; see
+ * proto_register_prefix().
+ */
+static void
+register_x11_fields(const char *unused _U_)
 {
-
 /* Setup list of header fields */
       static hf_register_info hf[] = {
 #include "x11-register-info.h"
       };
 
+      proto_register_field_array(proto_x11, hf, array_length(hf));
+}
+
+/* Register the protocol with Wireshark */
+void proto_register_x11(void)
+{
+
 /* Setup protocol subtree array */
       static gint *ett[] = {
             &ett_x11,
@@ -5835,7 +5846,7 @@ void proto_register_x11(void)
       proto_x11 = proto_register_protocol("X11", "X11", "x11");
 
 /* Required function calls to register the header fields and subtrees used */
-      proto_register_field_array(proto_x11, hf, array_length(hf));
+      proto_register_prefix("x11", register_x11_fields);
       proto_register_subtree_array(ett, array_length(ett));
       expert_x11 = expert_register_protocol(proto_x11);
       expert_register_field_array(expert_x11, ei, array_length(ei));
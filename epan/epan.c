@@ -303,6 +303,7 @@ epan_dissect_init(epan_dissect_t *edt, epan_t *session, const gboolean create_pr
 	}
 
 	edt->tvb = NULL;
+	edt->skipped_protocols = NULL;
 
 	return edt;
 }
@@ -430,6 +431,10 @@ epan_dissect_cleanup(epan_dissect_t* edt)
 		proto_tree_free(edt->tree);
 	}
 
+	if (edt->skipped_protocols) {
+		g_hash_table_destroy(edt->skipped_protocols);
+	}
+
 	if (pinfo_pool_cache == NULL) {
 		wmem_free_all(edt->pi.pool);
 		pinfo_pool_cache = edt->pi.pool;
@@ -452,6 +457,43 @@ epan_dissect_prime_dfilter(epan_dissect_t *edt, const dfilter_t* dfcode)
 	dfilter_prime_proto_tree(dfcode, edt->tree);
 }
 
+void
+epan_dissect_skip_unneeded_protocols(epan_dissect_t *edt, const dfilter_t* dfcode)
+{
+	const int *protocols;
+	int        num_protocols;
+	const int *fields;
+	int        num_fields;
+	int        hf_frame_protocols;
+	int        i;
+
+	if (edt->tree == NULL)
+		return;
+
+	if (edt->skipped_protocols) {
+		g_hash_table_destroy(edt->skipped_protocols);
+		edt->skipped_protocols = NULL;
+	}
+
+	/*
+	 * frame.protocols lists every protocol in the packet, so skipping
+	 * any protocol, and whatever it would have handed the data to,
+	 * could change it.
+	 */
+	hf_frame_protocols = proto_registrar_get_id_byname("frame.protocols");
+	fields = dfilter_get_interesting_fields(dfcode, &num_fields);
+	for (i = 0; i < num_fields; i++) {
+		if (fields[i] == hf_frame_protocols) {
+			proto_tree_set_skipped_protocols(edt->tree, NULL);
+			return;
+		}
+	}
+
+	protocols = dfilter_get_protocols(dfcode, &num_protocols);
+	edt->skipped_protocols = find_skippable_protocols(protocols, num_protocols);
+	proto_tree_set_skipped_protocols(edt->tree, edt->skipped_protocols);
+}
+
 void
 epan_dissect_prime_hfid(epan_dissect_t *edt, int hfid)
 {
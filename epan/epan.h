@@ -212,6 +212,17 @@ WS_DLL_PUBLIC
 void
 epan_dissect_prime_dfilter(epan_dissect_t *edt, const struct epan_dfilter *dfcode);
 
+/** Don't call the dissectors of protocols that can't affect the result of
+ * the dfilter, for those protocols that allow it (see proto_set_stateless()).
+ * This is only for when the dissection is done just to run the dfilter:
+ * the skipped protocols won't appear in the tree or columns, nor be seen
+ * by taps, although they're still in the packet's list of layers.  If
+ * the dfilter looks at frame.protocols, nothing is skipped.  It stays in
+ * effect for all the packets dissected with the epan_dissect_t. */
+WS_DLL_PUBLIC
+void
+epan_dissect_skip_unneeded_protocols(epan_dissect_t *edt, const struct epan_dfilter *dfcode);
+
 /** Prime an epan_dissect_t's proto_tree with a field/protocol specified by its hfid */
 WS_DLL_PUBLIC
 void
@@ -42,6 +42,7 @@ struct epan_dissect {
 	tvbuff_t	*tvb;
 	proto_tree	*tree;
 	packet_info	pi;
+	GHashTable	*skipped_protocols;
 };
 
 #ifdef __cplusplus
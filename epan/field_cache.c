@@ -0,0 +1,581 @@
+/* field_cache.c
+ * Cache of the values of the fields that display filters use, so that a
+ * capture file can be refiltered without dissecting it again
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <epan/epan.h>
+#include <epan/proto.h>
+#include <epan/ipv4.h>
+
+#include "field_cache.h"
+
+/*
+ * Caching a field costs memory for every occurrence of it, and a display
+ * filter rarely looks at more than a handful, so don't let the cache grow
+ * without bound as filters come and go.
+ */
+#define FIELD_CACHE_MAX_FIELDS	64
+
+/*
+ * One column of the cache: the frames in which a field occurs, in
+ * increasing order, with a frame number appearing once for each
+ * occurrence, and the values, if the field has them.
+ */
+typedef struct {
+	int		hfid;
+	enum ftenum	type;
+	GArray		*frames;	/* guint32 */
+	GArray		*values;	/* guint32, NULL if presence only */
+	guint		pos;		/* next occurrence to look at in a scan */
+} field_column_t;
+
+struct _field_cache {
+	GPtrArray	*columns;
+	GHashTable	*columns_by_id;		/* hfid -> field_column_t */
+	guint32		num_frames;
+	GHashTable	*dependent_frames;	/* framenum -> GSList */
+};
+
+/*
+ * Can the field be cached?  Sets *has_values to whether its value is
+ * kept, or only its presence.
+ */
+static gboolean
+field_type_cacheable(enum ftenum type, gboolean *has_values)
+{
+	switch (type) {
+		case FT_UINT8:
+		case FT_UINT16:
+		case FT_UINT24:
+		case FT_UINT32:
+		case FT_FRAMENUM:
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+		case FT_IPv4:
+			*has_values = TRUE;
+			return TRUE;
+
+		case FT_NONE:
+		case FT_PROTOCOL:
+			*has_values = FALSE;
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+static void
+field_column_free(gpointer data)
+{
+	field_column_t *column = (field_column_t *)data;
+
+	g_array_free(column->frames, TRUE);
+	if (column->values)
+		g_array_free(column->values, TRUE);
+	g_free(column);
+}
+
+static void
+dependent_frames_free(gpointer data)
+{
+	g_slist_free((GSList *)data);
+}
+
+field_cache_t *
+field_cache_new(void)
+{
+	field_cache_t *fc;
+
+	fc = g_new(field_cache_t, 1);
+	fc->columns = g_ptr_array_new_with_free_func(field_column_free);
+	fc->columns_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+	fc->num_frames = 0;
+	fc->dependent_frames = g_hash_table_new_full(g_direct_hash,
+	    g_direct_equal, NULL, dependent_frames_free);
+	return fc;
+}
+
+void
+field_cache_free(field_cache_t *fc)
+{
+	if (!fc)
+		return;
+
+	g_hash_table_destroy(fc->dependent_frames);
+	g_hash_table_destroy(fc->columns_by_id);
+	g_ptr_array_free(fc->columns, TRUE);
+	g_free(fc);
+}
+
+void
+field_cache_clear(field_cache_t *fc)
+{
+	field_column_t	*column;
+	guint		i;
+
+	for (i = 0; i < fc->columns->len; i++) {
+		column = (field_column_t *)g_ptr_array_index(fc->columns, i);
+		g_array_set_size(column->frames, 0);
+		if (column->values)
+			g_array_set_size(column->values, 0);
+	}
+	g_hash_table_remove_all(fc->dependent_frames);
+	fc->num_frames = 0;
+}
+
+gboolean
+field_cache_learn(field_cache_t *fc, const dfilter_t *df)
+{
+	const int		*fields;
+	int			num_fields, i;
+	header_field_info	*hfinfo;
+	field_column_t		*column;
+	gboolean		has_values;
+	gboolean		added = FALSE;
+
+	if (!df)
+		return FALSE;
+
+	fields = dfilter_get_interesting_fields(df, &num_fields);
+	for (i = 0; i < num_fields; i++) {
+		if (g_hash_table_lookup(fc->columns_by_id,
+		    GINT_TO_POINTER(fields[i])))
+			continue;
+
+		hfinfo = proto_registrar_get_nth(fields[i]);
+		if (!field_type_cacheable(hfinfo->type, &has_values))
+			continue;
+
+		if (fc->columns->len >= FIELD_CACHE_MAX_FIELDS)
+			break;
+
+		column = g_new(field_column_t, 1);
+		column->hfid = fields[i];
+		column->type = hfinfo->type;
+		column->frames = g_array_new(FALSE, FALSE, sizeof(guint32));
+		column->values = has_values ?
+		    g_array_new(FALSE, FALSE, sizeof(guint32)) : NULL;
+		column->pos = 0;
+		g_ptr_array_add(fc->columns, column);
+		g_hash_table_insert(fc->columns_by_id,
+		    GINT_TO_POINTER(fields[i]), column);
+		added = TRUE;
+	}
+
+	if (added)
+		field_cache_clear(fc);
+	return added;
+}
+
+gboolean
+field_cache_wants_fields(const field_cache_t *fc)
+{
+	return fc && fc->columns->len > 0;
+}
+
+void
+field_cache_prime_edt(const field_cache_t *fc, epan_dissect_t *edt)
+{
+	field_column_t	*column;
+	guint		i;
+
+	for (i = 0; i < fc->columns->len; i++) {
+		column = (field_column_t *)g_ptr_array_index(fc->columns, i);
+		epan_dissect_prime_hfid(edt, column->hfid);
+	}
+}
+
+void
+field_cache_record(field_cache_t *fc, guint32 framenum, gboolean first_pass,
+    epan_dissect_t *edt)
+{
+	field_column_t	*column;
+	GPtrArray	*finfos;
+	field_info	*finfo;
+	guint32		value;
+	guint		i, j;
+
+	if (first_pass || framenum != fc->num_frames + 1)
+		return;
+	if (fc->columns->len > 0 && !edt->tree)
+		return;
+
+	for (i = 0; i < fc->columns->len; i++) {
+		column = (field_column_t *)g_ptr_array_index(fc->columns, i);
+		finfos = proto_get_finfo_ptr_array(edt->tree, column->hfid);
+		if (!finfos)
+			continue;
+
+		for (j = 0; j < finfos->len; j++) {
+			finfo = (field_info *)g_ptr_array_index(finfos, j);
+			g_array_append_val(column->frames, framenum);
+			if (!column->values)
+				continue;
+
+			switch (column->type) {
+				case FT_INT8:
+				case FT_INT16:
+				case FT_INT24:
+				case FT_INT32:
+					value = (guint32)fvalue_get_sinteger(&finfo->value);
+					break;
+				case FT_IPv4:
+					/* Kept in network byte order, as
+					 * proto_tree_add_ipv4() wants it. */
+					value = ipv4_get_net_order_addr(
+					    (ipv4_addr_and_mask *)fvalue_get(&finfo->value));
+					break;
+				default:
+					value = fvalue_get_uinteger(&finfo->value);
+					break;
+			}
+			g_array_append_val(column->values, value);
+		}
+	}
+
+	if (edt->pi.dependent_frames) {
+		g_hash_table_insert(fc->dependent_frames,
+		    GUINT_TO_POINTER(framenum),
+		    g_slist_copy(edt->pi.dependent_frames));
+	}
+
+	fc->num_frames = framenum;
+}
+
+guint32
+field_cache_num_frames(const field_cache_t *fc)
+{
+	return fc->num_frames;
+}
+
+GSList *
+field_cache_dependent_frames(const field_cache_t *fc, guint32 framenum)
+{
+	return (GSList *)g_hash_table_lookup(fc->dependent_frames,
+	    GUINT_TO_POINTER(framenum));
+}
+
+gboolean
+field_cache_can_filter(const field_cache_t *fc, const dfilter_t *df)
+{
+	const int	*fields;
+	int		num_fields, i;
+	field_column_t	*column;
+
+	if (!df || fc->num_frames == 0)
+		return FALSE;
+
+	fields = dfilter_get_interesting_fields(df, &num_fields);
+	for (i = 0; i < num_fields; i++) {
+		column = (field_column_t *)g_hash_table_lookup(
+		    fc->columns_by_id, GINT_TO_POINTER(fields[i]));
+		if (!column)
+			return FALSE;
+
+		/*
+		 * A protocol's value is its data, which isn't kept; an
+		 * FT_NONE field has no value, so anything that can be done
+		 * with it can be done with the empty item the scan adds.
+		 */
+		if (column->type == FT_PROTOCOL &&
+		    dfilter_uses_field_value(df, fields[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+void
+field_cache_begin_scan(field_cache_t *fc)
+{
+	field_column_t	*column;
+	guint		i;
+
+	for (i = 0; i < fc->columns->len; i++) {
+		column = (field_column_t *)g_ptr_array_index(fc->columns, i);
+		column->pos = 0;
+	}
+}
+
+/*
+ * Add the column's occurrences in the frame to the tree, as items with
+ * no data behind them.
+ */
+static void
+field_column_add_items(field_column_t *column, guint *pos, proto_tree *tree,
+    guint32 framenum)
+{
+	proto_item	*item;
+	guint32		value;
+
+	while (*pos < column->frames->len &&
+	    g_array_index(column->frames, guint32, *pos) < framenum)
+		(*pos)++;
+
+	while (*pos < column->frames->len &&
+	    g_array_index(column->frames, guint32, *pos) == framenum) {
+		value = column->values ?
+		    g_array_index(column->values, guint32, *pos) : 0;
+
+		switch (column->type) {
+			case FT_NONE:
+				proto_tree_add_none_format(tree, column->hfid,
+				    NULL, 0, 0, "%s", "");
+				break;
+			case FT_PROTOCOL:
+				proto_tree_add_protocol_format(tree,
+				    column->hfid, NULL, 0, 0, "%s", "");
+				break;
+			case FT_INT8:
+			case FT_INT16:
+			case FT_INT24:
+			case FT_INT32:
+				/*
+				 * The cached value has already been masked
+				 * and shifted, which proto_tree_add_int()
+				 * would do again for a bitmask field, so
+				 * set it directly.
+				 */
+				item = proto_tree_add_int(tree, column->hfid,
+				    NULL, 0, 0, 0);
+				if (item)
+					fvalue_set_sinteger(
+					    &PITEM_FINFO(item)->value,
+					    (gint32)value);
+				break;
+			case FT_IPv4:
+				proto_tree_add_ipv4(tree, column->hfid, NULL,
+				    0, 0, value);
+				break;
+			default:
+				/* As above. */
+				item = proto_tree_add_uint(tree, column->hfid,
+				    NULL, 0, 0, 0);
+				if (item)
+					fvalue_set_uinteger(
+					    &PITEM_FINFO(item)->value, value);
+				break;
+		}
+		(*pos)++;
+	}
+}
+
+gboolean
+field_cache_apply(field_cache_t *fc, dfilter_t *df, epan_dissect_t *edt,
+    guint32 framenum)
+{
+	const int	*fields;
+	int		num_fields, i;
+	field_column_t	*column;
+	gboolean	passed;
+
+	epan_dissect_prime_dfilter(edt, df);
+
+	fields = dfilter_get_interesting_fields(df, &num_fields);
+	for (i = 0; i < num_fields; i++) {
+		column = (field_column_t *)g_hash_table_lookup(
+		    fc->columns_by_id, GINT_TO_POINTER(fields[i]));
+		if (column)
+			field_column_add_items(column, &column->pos,
+			    edt->tree, framenum);
+	}
+
+	passed = dfilter_apply_edt(df, edt);
+	epan_dissect_reset(edt);
+	return passed;
+}
+
+#if GLIB_CHECK_VERSION(2,32,0)
+#define USE_FILTER_THREADS
+#endif
+
+#ifdef USE_FILTER_THREADS
+/*
+ * Starting threads, and compiling the filter for each of them, isn't
+ * worth it for a few frames.
+ */
+#define FIELD_CACHE_MIN_FRAMES_PER_THREAD	65536
+#define FIELD_CACHE_MAX_THREADS			32
+
+/*
+ * A thread filtering a range of frames.  Nothing it uses is shared with
+ * the other threads but the cache itself, which it only reads, and the
+ * header_field_info structures, which were primed before it started.
+ */
+typedef struct {
+	dfilter_t	*df;
+	epan_dissect_t	*edt;
+	field_column_t	**columns;	/* the df's fields, NULL if not cached */
+	guint		*pos;		/* this thread's place in each column */
+	int		num_columns;
+	guint32		first;
+	guint32		last;
+	guint8		*passed;	/* indexed by frame number - 1 */
+} filter_thread_t;
+
+/* Index of the first occurrence of the field in or after the frame. */
+static guint
+field_column_seek(const field_column_t *column, guint32 framenum)
+{
+	guint	low = 0, high = column->frames->len, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (g_array_index(column->frames, guint32, mid) < framenum)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static gpointer
+filter_thread(gpointer data)
+{
+	filter_thread_t	*ft = (filter_thread_t *)data;
+	guint32		framenum;
+	int		i;
+
+	for (i = 0; i < ft->num_columns; i++) {
+		if (ft->columns[i])
+			ft->pos[i] = field_column_seek(ft->columns[i], ft->first);
+	}
+
+	for (framenum = ft->first; framenum <= ft->last; framenum++) {
+		for (i = 0; i < ft->num_columns; i++) {
+			if (ft->columns[i])
+				field_column_add_items(ft->columns[i],
+				    &ft->pos[i], ft->edt->tree, framenum);
+		}
+		ft->passed[framenum - 1] =
+		    dfilter_apply_edt(ft->df, ft->edt) ? 1 : 0;
+		epan_dissect_reset(ft->edt);
+	}
+	return NULL;
+}
+#endif /* USE_FILTER_THREADS */
+
+gboolean
+field_cache_filter_frames(field_cache_t *fc, epan_t *session,
+    const char *dftext, guint32 num_frames, guint8 *passed)
+{
+#ifdef USE_FILTER_THREADS
+	filter_thread_t	*threads, *ft;
+	GThread		**handles;
+	const int	*fields;
+	guint		num_threads, num_ready, i;
+	guint32		per_thread;
+	int		j;
+
+	if (num_frames > fc->num_frames)
+		return FALSE;
+
+#if GLIB_CHECK_VERSION(2,36,0)
+	num_threads = g_get_num_processors();
+#else
+	num_threads = 4;
+#endif
+	if (num_threads > FIELD_CACHE_MAX_THREADS)
+		num_threads = FIELD_CACHE_MAX_THREADS;
+	if (num_threads > num_frames / FIELD_CACHE_MIN_FRAMES_PER_THREAD)
+		num_threads = num_frames / FIELD_CACHE_MIN_FRAMES_PER_THREAD;
+	if (num_threads < 2)
+		return FALSE;
+
+	/*
+	 * A dfilter keeps its registers in itself, so each thread needs its
+	 * own copy; neither the compiler nor epan_dissect_new() is
+	 * reentrant, so set everything up here.
+	 */
+	threads = g_new0(filter_thread_t, num_threads);
+	per_thread = num_frames / num_threads;
+	for (num_ready = 0; num_ready < num_threads; num_ready++) {
+		ft = &threads[num_ready];
+		if (!dfilter_compile(dftext, &ft->df, NULL) || ft->df == NULL)
+			break;
+		if (!field_cache_can_filter(fc, ft->df)) {
+			dfilter_free(ft->df);
+			break;
+		}
+		ft->edt = epan_dissect_new(session, TRUE, FALSE);
+		proto_tree_set_keep_primed(ft->edt->tree, TRUE);
+		fields = dfilter_get_interesting_fields(ft->df, &ft->num_columns);
+		ft->columns = g_new(field_column_t *, ft->num_columns);
+		ft->pos = g_new0(guint, ft->num_columns);
+		for (j = 0; j < ft->num_columns; j++) {
+			ft->columns[j] = (field_column_t *)g_hash_table_lookup(
+			    fc->columns_by_id, GINT_TO_POINTER(fields[j]));
+		}
+		ft->first = num_ready * per_thread + 1;
+		ft->last = (num_ready == num_threads - 1) ?
+		    num_frames : (num_ready + 1) * per_thread;
+		ft->passed = passed;
+	}
+
+	if (num_ready == num_threads) {
+		/*
+		 * Priming marks the fields as referenced in their
+		 * header_field_info, which the threads share, so it's done
+		 * once, here, rather than by each thread, and the threads'
+		 * trees keep the marks when they're reset.
+		 */
+		epan_dissect_prime_dfilter(threads[0].edt, threads[0].df);
+
+		handles = g_new(GThread *, num_threads);
+		for (i = 0; i < num_threads; i++)
+			handles[i] = g_thread_new("Field cache filter",
+			    filter_thread, &threads[i]);
+		for (i = 0; i < num_threads; i++)
+			g_thread_join(handles[i]);
+		g_free(handles);
+	}
+
+	for (i = 0; i < num_ready; i++) {
+		epan_dissect_free(threads[i].edt);
+		g_free(threads[i].columns);
+		g_free(threads[i].pos);
+		dfilter_free(threads[i].df);
+	}
+	g_free(threads);
+	return num_ready == num_threads;
+#else
+	return FALSE;
+#endif
+}
+
+/*
+ * Editor modelines  -  http://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indent=8:tabSize=8:noTabs=false:
+ */
@@ -0,0 +1,129 @@
+/* field_cache.h
+ * Cache of the values of the fields that display filters use, so that a
+ * capture file can be refiltered without dissecting it again
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __FIELD_CACHE_H__
+#define __FIELD_CACHE_H__
+
+#include "ws_symbol_export.h"
+#include <epan/epan.h>
+#include <epan/epan_dissect.h>
+#include <epan/dfilter/dfilter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A field cache holds, for each of a small number of fields, the number
+ * of every frame in which the field occurs and the field's value there.
+ * Only fields whose values fit in 32 bits (integers, IPv4 addresses),
+ * and FT_NONE and FT_PROTOCOL fields, whose presence is all that's kept,
+ * are cached.
+ *
+ * The values are recorded while the frames are dissected, in order,
+ * starting with frame 1, on any pass but the first.  A display filter
+ * that only looks at cached fields can then be applied to those frames
+ * using the cache alone.
+ */
+typedef struct _field_cache field_cache_t;
+
+WS_DLL_PUBLIC field_cache_t *field_cache_new(void);
+
+WS_DLL_PUBLIC void field_cache_free(field_cache_t *fc);
+
+/*
+ * Forget the recorded values, e.g. because the frames are going to be
+ * dissected differently; the set of cached fields is kept.
+ */
+WS_DLL_PUBLIC void field_cache_clear(field_cache_t *fc);
+
+/*
+ * Start caching the fields that the display filter uses, as far as they
+ * can be cached.  If that adds any fields, the values recorded so far are
+ * forgotten, as they're missing those fields; returns TRUE in that case.
+ */
+WS_DLL_PUBLIC gboolean field_cache_learn(field_cache_t *fc, const dfilter_t *df);
+
+/*
+ * Are any fields being cached?  If so, frames have to be dissected with
+ * a protocol tree, primed with field_cache_prime_edt(), to be recorded.
+ */
+WS_DLL_PUBLIC gboolean field_cache_wants_fields(const field_cache_t *fc);
+
+WS_DLL_PUBLIC void field_cache_prime_edt(const field_cache_t *fc,
+    epan_dissect_t *edt);
+
+/*
+ * Record the cached fields' values from a dissected frame.  Frames that
+ * don't directly follow the last frame recorded are ignored, as are
+ * frames being dissected for the first time: some fields, such as the
+ * number of the frame with the response to a request, are only filled
+ * in when a frame is dissected again, so that the values would differ
+ * from the ones a later dissection gives.
+ */
+WS_DLL_PUBLIC void field_cache_record(field_cache_t *fc, guint32 framenum,
+    gboolean first_pass, epan_dissect_t *edt);
+
+/* Number of frames, starting with frame 1, that have been recorded. */
+WS_DLL_PUBLIC guint32 field_cache_num_frames(const field_cache_t *fc);
+
+/*
+ * The frames that the frame depended on when it was recorded, as in
+ * packet_info's dependent_frames.
+ */
+WS_DLL_PUBLIC GSList *field_cache_dependent_frames(const field_cache_t *fc,
+    guint32 framenum);
+
+/*
+ * Can the display filter be applied to the recorded frames using the
+ * cache alone?
+ */
+WS_DLL_PUBLIC gboolean field_cache_can_filter(const field_cache_t *fc,
+    const dfilter_t *df);
+
+/*
+ * Apply a display filter to a recorded frame, using the cached values;
+ * edt must have been created with a protocol tree, and is reset.  After
+ * field_cache_begin_scan(), frames must be given in increasing order.
+ */
+WS_DLL_PUBLIC void field_cache_begin_scan(field_cache_t *fc);
+
+WS_DLL_PUBLIC gboolean field_cache_apply(field_cache_t *fc, dfilter_t *df,
+    epan_dissect_t *edt, guint32 framenum);
+
+/*
+ * Apply the display filter with the given text to frames 1 through
+ * num_frames, which must have been recorded, using several threads;
+ * sets passed[n - 1] to 1 if frame n passed it and to 0 if it didn't.
+ * Returns FALSE, having done nothing, if there are too few frames, or
+ * processors, for that to be worthwhile, or if threads aren't
+ * available; the frames should then be given to field_cache_apply().
+ */
+WS_DLL_PUBLIC gboolean field_cache_filter_frames(field_cache_t *fc,
+    epan_t *session, const char *dftext, guint32 num_frames, guint8 *passed);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIELD_CACHE_H__ */
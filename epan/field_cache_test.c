@@ -0,0 +1,347 @@
+/* field_cache_test.c
+ * Field cache tests
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <epan/epan.h>
+#include <epan/epan_dissect.h>
+#include <epan/proto.h>
+#include <epan/tvbuff.h>
+#include <epan/dfilter/dfilter.h>
+
+#include "field_cache.h"
+
+static int proto_fctest = -1;
+static int hf_fctest_version = -1;
+static int hf_fctest_hdrlen = -1;
+static int hf_fctest_offset = -1;
+static int hf_fctest_response_in = -1;
+
+static epan_t *session;
+
+/*
+ * The frames recorded, repeated in turn: the first two have a header like
+ * IPv4's first byte, a version in the upper nibble and a length in the
+ * lower one, followed by a signed nibble; the third has no fields but the
+ * protocol.  The first is a request, answered by the second, which, like
+ * a real dissector, it only says once it's been seen before.
+ */
+static const guint8 frame1[] = { 0x45, 0xe0 };	/* 4, 5, -2 */
+static const guint8 frame2[] = { 0x65, 0x10 };	/* 6, 5, 1 */
+
+#define NUM_FRAMES	3
+
+/*
+ * Enough frames for field_cache_filter_frames() to use at least two
+ * threads; twice its FIELD_CACHE_MIN_FRAMES_PER_THREAD.
+ */
+#define NUM_THREADED_FRAMES	(2 * 65536)
+
+static void
+register_fctest(register_cb cb _U_, gpointer client_data _U_)
+{
+	static hf_register_info hf[] = {
+		{ &hf_fctest_version,
+		  { "Version", "fctest.version", FT_UINT8, BASE_DEC,
+		    NULL, 0xf0, NULL, HFILL }},
+		{ &hf_fctest_hdrlen,
+		  { "Header Length", "fctest.hdrlen", FT_UINT8, BASE_DEC,
+		    NULL, 0x0f, NULL, HFILL }},
+		{ &hf_fctest_offset,
+		  { "Offset", "fctest.offset", FT_INT8, BASE_DEC,
+		    NULL, 0xf0, NULL, HFILL }},
+		{ &hf_fctest_response_in,
+		  { "Response In", "fctest.response_in", FT_FRAMENUM, BASE_NONE,
+		    NULL, 0x0, NULL, HFILL }},
+	};
+
+	proto_fctest = proto_register_protocol("Field Cache Test",
+	    "FCTEST", "fctest");
+	proto_register_field_array(proto_fctest, hf, G_N_ELEMENTS(hf));
+}
+
+static void
+register_fctest_handoff(register_cb cb _U_, gpointer client_data _U_)
+{
+}
+
+static dfilter_t *
+compile(const char *text)
+{
+	dfilter_t	*df;
+	gchar		*err_msg = NULL;
+
+	if (!dfilter_compile(text, &df, &err_msg)) {
+		g_test_message("%s: %s", text, err_msg);
+		g_free(err_msg);
+		g_assert_not_reached();
+	}
+	g_assert(df != NULL);
+	return df;
+}
+
+/* "Dissect" a frame, adding the fields from its data. */
+static void
+add_frame_items(epan_dissect_t *edt, guint32 framenum, gboolean first_pass)
+{
+	const guint8	*data = NULL;
+	tvbuff_t	*tvb;
+
+	if ((framenum - 1) % 3 == 0)
+		data = frame1;
+	else if ((framenum - 1) % 3 == 1)
+		data = frame2;
+
+	if (!data) {
+		proto_tree_add_protocol_format(edt->tree, proto_fctest, NULL,
+		    0, 0, "%s", "Field Cache Test");
+		return;
+	}
+
+	tvb = tvb_new_real_data(data, 2, 2);
+	proto_tree_add_item(edt->tree, proto_fctest, tvb, 0, 2, ENC_NA);
+	proto_tree_add_item(edt->tree, hf_fctest_version, tvb, 0, 1, ENC_NA);
+	proto_tree_add_item(edt->tree, hf_fctest_hdrlen, tvb, 0, 1, ENC_NA);
+	proto_tree_add_item(edt->tree, hf_fctest_offset, tvb, 1, 1, ENC_NA);
+	if (data == frame1 && !first_pass)
+		proto_tree_add_uint(edt->tree, hf_fctest_response_in, tvb,
+		    0, 0, framenum + 1);
+	edt->tvb = tvb;
+}
+
+/* Record the frames as dissected on the given pass. */
+static void
+record_pass(field_cache_t *fc, guint32 num_frames, gboolean first_pass)
+{
+	epan_dissect_t	*edt;
+	guint32		framenum;
+
+	edt = epan_dissect_new(session, TRUE, FALSE);
+	for (framenum = 1; framenum <= num_frames; framenum++) {
+		field_cache_prime_edt(fc, edt);
+		add_frame_items(edt, framenum, first_pass);
+		field_cache_record(fc, framenum, first_pass, edt);
+		epan_dissect_reset(edt);
+	}
+	epan_dissect_free(edt);
+}
+
+static field_cache_t *
+record_frames(guint32 num_frames)
+{
+	field_cache_t	*fc;
+	dfilter_t	*df;
+
+	fc = field_cache_new();
+	df = compile("fctest || fctest.version || fctest.hdrlen || fctest.offset");
+	field_cache_learn(fc, df);
+	dfilter_free(df);
+	g_assert(field_cache_wants_fields(fc));
+
+	record_pass(fc, num_frames, FALSE);
+	g_assert_cmpuint(field_cache_num_frames(fc), ==, num_frames);
+	return fc;
+}
+
+/*
+ * Apply the filter to the recorded frames through the cache; expected
+ * has a '1' for each frame that should pass it and a '0' for the rest.
+ */
+static void
+check_filter(field_cache_t *fc, const char *text, const char *expected)
+{
+	dfilter_t	*df;
+	epan_dissect_t	*edt;
+	guint32		framenum;
+	char		passed[NUM_FRAMES + 1];
+
+	df = compile(text);
+	g_assert(field_cache_can_filter(fc, df));
+
+	edt = epan_dissect_new(session, TRUE, FALSE);
+	field_cache_begin_scan(fc);
+	for (framenum = 1; framenum <= NUM_FRAMES; framenum++)
+		passed[framenum - 1] =
+		    field_cache_apply(fc, df, edt, framenum) ? '1' : '0';
+	passed[NUM_FRAMES] = '\0';
+	epan_dissect_free(edt);
+	dfilter_free(df);
+
+	if (strcmp(passed, expected) != 0)
+		g_test_message("%s", text);
+	g_assert_cmpstr(passed, ==, expected);
+}
+
+static void
+field_cache_test_bitmask(void)
+{
+	field_cache_t	*fc = record_frames(NUM_FRAMES);
+
+	check_filter(fc, "fctest.version == 4", "100");
+	check_filter(fc, "fctest.version == 6", "010");
+	check_filter(fc, "fctest.version > 4", "010");
+	check_filter(fc, "fctest.hdrlen == 5", "110");
+	check_filter(fc, "fctest.version == 4 && fctest.hdrlen == 5", "100");
+	field_cache_free(fc);
+}
+
+static void
+field_cache_test_signed_bitmask(void)
+{
+	field_cache_t	*fc = record_frames(NUM_FRAMES);
+
+	check_filter(fc, "fctest.offset == -2", "100");
+	check_filter(fc, "fctest.offset < 0", "100");
+	check_filter(fc, "fctest.offset == 1", "010");
+	field_cache_free(fc);
+}
+
+static void
+field_cache_test_absent(void)
+{
+	field_cache_t	*fc = record_frames(NUM_FRAMES);
+
+	check_filter(fc, "fctest", "111");
+	check_filter(fc, "!fctest.version", "001");
+	check_filter(fc, "fctest && !fctest.offset", "001");
+	field_cache_free(fc);
+}
+
+static void
+field_cache_test_request_response(void)
+{
+	field_cache_t	*fc;
+	dfilter_t	*df;
+
+	fc = field_cache_new();
+	df = compile("fctest.response_in");
+	field_cache_learn(fc, df);
+
+	/* The first pass doesn't know about the response yet. */
+	record_pass(fc, NUM_FRAMES, TRUE);
+	g_assert_cmpuint(field_cache_num_frames(fc), ==, 0);
+	g_assert(!field_cache_can_filter(fc, df));
+	dfilter_free(df);
+
+	record_pass(fc, NUM_FRAMES, FALSE);
+	g_assert_cmpuint(field_cache_num_frames(fc), ==, NUM_FRAMES);
+	check_filter(fc, "fctest.response_in", "100");
+	check_filter(fc, "fctest.response_in == 2", "100");
+	check_filter(fc, "!fctest.response_in", "011");
+	field_cache_free(fc);
+}
+
+/*
+ * Apply the filter to many frames, using several threads if possible, and
+ * check the result against applying it to each frame in turn; expected is
+ * as for check_filter(), for each set of three frames.
+ */
+static void
+check_filter_threaded(field_cache_t *fc, const char *text,
+    const char *expected)
+{
+	dfilter_t	*df;
+	epan_dissect_t	*edt;
+	guint8		*passed;
+	guint32		framenum;
+	gboolean	threaded;
+
+	passed = (guint8 *)g_malloc0(NUM_THREADED_FRAMES);
+	threaded = field_cache_filter_frames(fc, session, text,
+	    NUM_THREADED_FRAMES, passed);
+	if (!threaded)
+		g_test_message("%s: not filtered in threads", text);
+
+	df = compile(text);
+	edt = epan_dissect_new(session, TRUE, FALSE);
+	field_cache_begin_scan(fc);
+	for (framenum = 1; framenum <= NUM_THREADED_FRAMES; framenum++) {
+		gboolean want = expected[(framenum - 1) % 3] == '1';
+
+		if (field_cache_apply(fc, df, edt, framenum) != want) {
+			g_test_message("%s: frame %u", text, framenum);
+			g_assert_not_reached();
+		}
+		if (threaded && (passed[framenum - 1] != 0) != want) {
+			g_test_message("%s: frame %u, in a thread", text,
+			    framenum);
+			g_assert_not_reached();
+		}
+	}
+	epan_dissect_free(edt);
+	dfilter_free(df);
+	g_free(passed);
+}
+
+static void
+field_cache_test_threads(void)
+{
+	field_cache_t	*fc = record_frames(NUM_THREADED_FRAMES);
+
+	check_filter_threaded(fc, "fctest.version == 4", "100");
+	check_filter_threaded(fc, "fctest.offset == 1", "010");
+	check_filter_threaded(fc, "!fctest.version", "001");
+	check_filter_threaded(fc, "fctest && fctest.hdrlen == 5", "110");
+	field_cache_free(fc);
+}
+
+int
+main(int argc, char **argv)
+{
+	int	result;
+
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/field_cache/bitmask", field_cache_test_bitmask);
+	g_test_add_func("/field_cache/bitmask/signed",
+	    field_cache_test_signed_bitmask);
+	g_test_add_func("/field_cache/absent", field_cache_test_absent);
+	g_test_add_func("/field_cache/request_response",
+	    field_cache_test_request_response);
+	g_test_add_func("/field_cache/threads", field_cache_test_threads);
+
+	if (!epan_init(register_fctest, register_fctest_handoff, NULL, NULL))
+		return 1;
+	session = epan_new();
+	result = g_test_run();
+	epan_free(session);
+	epan_cleanup();
+
+	return result;
+}
+
+/*
+ * Editor modelines  -  http://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
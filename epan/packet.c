@@ -642,6 +642,7 @@ call_dissector_through_handle(dissector_handle_t handle, tvbuff_t *tvb,
 	saved_proto = pinfo->current_proto;
 
 	if (handle->protocol != NULL) {
+		proto_initialize_protocol_prefix(handle->protocol);
 		pinfo->current_proto =
 			proto_get_protocol_short_name(handle->protocol);
 	}
@@ -683,6 +684,24 @@ call_dissector_work(dissector_handle_t handle, tvbuff_t *tvb, packet_info *pinfo
 		return 0;
 	}
 
+	if (tree != NULL && handle->protocol != NULL &&
+	    PTREE_DATA(tree)->skipped_protocols != NULL &&
+	    g_hash_table_lookup(PTREE_DATA(tree)->skipped_protocols,
+		GINT_TO_POINTER(proto_get_id(handle->protocol))) != NULL) {
+		/*
+		 * Nothing the protocol, or anything it could hand
+		 * the data to, would put into the tree is wanted,
+		 * and it keeps no state between packets, so just
+		 * claim the data as dissected.  It's still one of
+		 * the layers of the packet, though.
+		 */
+		if (add_proto_name) {
+			pinfo->curr_layer_num++;
+			wmem_list_append(pinfo->layers, GINT_TO_POINTER(proto_get_id(handle->protocol)));
+		}
+		return tvb_captured_length(tvb);
+	}
+
 	saved_proto = pinfo->current_proto;
 	saved_can_desegment = pinfo->can_desegment;
 	saved_layers_len = wmem_list_count(pinfo->layers);
@@ -2388,6 +2407,7 @@ dissector_try_heuristic(heur_dissector_list_t sub_dissectors, tvbuff_t *tvb,
 		}
 
 		if (hdtbl_entry->protocol != NULL) {
+			proto_initialize_protocol_prefix(hdtbl_entry->protocol);
 			proto_id = proto_get_id(hdtbl_entry->protocol);
 			/* do NOT change this behavior - wslua uses the protocol short name set here in order
 			   to determine which Lua-based heurisitc dissector to call */
@@ -2852,6 +2872,7 @@ void call_heur_dissector_direct(heur_dtbl_entry_t *heur_dtbl_entry, tvbuff_t *tv
 	}
 
 	if (heur_dtbl_entry->protocol != NULL) {
+		proto_initialize_protocol_prefix(heur_dtbl_entry->protocol);
 		/* do NOT change this behavior - wslua uses the protocol short name set here in order
 			to determine which Lua-based heuristic dissector to call */
 		pinfo->current_proto = proto_get_protocol_short_name(heur_dtbl_entry->protocol);
@@ -2921,6 +2942,85 @@ depend_dissector_list_t find_depend_dissector_list(const char* name)
 	return (depend_dissector_list_t)g_hash_table_lookup(depend_dissector_lists, name);
 }
 
+/* Add the short names of all the protocols that the named protocol can
+ * hand data to, directly or indirectly, to the hash table. */
+static void
+collect_depend_dissectors(const char *name, GHashTable *reached)
+{
+	depend_dissector_list_t  sub_dissectors;
+	GSList                  *entry;
+
+	if (g_hash_table_lookup(reached, name) != NULL)
+		return;
+	g_hash_table_insert(reached, (gpointer)name, GUINT_TO_POINTER(TRUE));
+
+	sub_dissectors = find_depend_dissector_list(name);
+	if (sub_dissectors == NULL)
+		return;
+	for (entry = sub_dissectors->dissectors; entry; entry = g_slist_next(entry))
+		collect_depend_dissectors((const char *)entry->data, reached);
+}
+
+/* Is any of the needed protocols in the hash table? */
+static gboolean
+reaches_needed_protocol(GHashTable *reached, const int *needed_protos, int num_needed)
+{
+	int i;
+
+	for (i = 0; i < num_needed; i++) {
+		if (g_hash_table_lookup(reached,
+		    proto_get_protocol_short_name(find_protocol_by_id(needed_protos[i]))) != NULL)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+GHashTable *
+find_skippable_protocols(const int *needed_protos, int num_needed)
+{
+	GHashTable *reached, *skippable = NULL;
+	protocol_t *protocol;
+	void       *cookie;
+	int         i, proto_id;
+
+	/*
+	 * Every packet's dissection starts with the frame dissector, so
+	 * a needed protocol that can't be reached from it through the
+	 * recorded dependencies gets its data through calls that weren't
+	 * recorded; we then can't tell what's safe to skip.
+	 */
+	reached = g_hash_table_new(g_str_hash, g_str_equal);
+	collect_depend_dissectors(proto_get_protocol_short_name(
+	    find_protocol_by_id(proto_get_id_by_filter_name("frame"))), reached);
+	for (i = 0; i < num_needed; i++) {
+		if (g_hash_table_lookup(reached,
+		    proto_get_protocol_short_name(find_protocol_by_id(needed_protos[i]))) == NULL) {
+			g_hash_table_destroy(reached);
+			return NULL;
+		}
+	}
+	g_hash_table_destroy(reached);
+
+	for (proto_id = proto_get_first_protocol(&cookie); proto_id != -1;
+	     proto_id = proto_get_next_protocol(&cookie)) {
+		protocol = find_protocol_by_id(proto_id);
+		if (!proto_is_protocol_stateless(protocol))
+			continue;
+
+		reached = g_hash_table_new(g_str_hash, g_str_equal);
+		collect_depend_dissectors(proto_get_protocol_short_name(protocol), reached);
+		if (!reaches_needed_protocol(reached, needed_protos, num_needed)) {
+			if (skippable == NULL)
+				skippable = g_hash_table_new(g_direct_hash, g_direct_equal);
+			g_hash_table_insert(skippable, GINT_TO_POINTER(proto_id),
+			    GUINT_TO_POINTER(TRUE));
+		}
+		g_hash_table_destroy(reached);
+	}
+
+	return skippable;
+}
+
 /*
  * Dumps the "layer type"/"decode as" associations to stdout, similar
  * to the proto_registrar_dump_*() routines.
@@ -605,6 +605,19 @@ WS_DLL_PUBLIC gboolean deregister_depend_dissector(const char* parent, const cha
  */
 WS_DLL_PUBLIC depend_dissector_list_t find_depend_dissector_list(const char* name);
 
+/** Find the protocols whose dissectors needn't be called if all that's
+ * wanted from dissection is what the given protocols put into the tree:
+ * those marked with proto_set_stateless() that can't, according to the
+ * protocol dependencies, hand data on to any of the given protocols.
+ *
+ *   @param needed_protos Protocol IDs of the needed protocols
+ *   @param num_needed Number of needed protocols
+ *   @return  hash table, keyed by protocol ID, of the protocols that can
+ *   be skipped, to be freed with g_hash_table_destroy(); NULL if there
+ *   are none
+ */
+WS_DLL_PUBLIC GHashTable *find_skippable_protocols(const int *needed_protos, int num_needed);
+
 
 /* Do all one-time initialization. */
 extern void dissect_init(void);
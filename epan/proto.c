@@ -310,7 +310,9 @@ struct _protocol {
 	gboolean    is_enabled;         /* TRUE if protocol is enabled */
 	gboolean    enabled_by_default; /* TRUE if protocol is enabled by default */
 	gboolean    can_toggle;         /* TRUE if is_enabled can be changed */
+	gboolean    is_stateless;       /* TRUE if dissection may be skipped */
 	GList      *heur_list;          /* Heuristic dissectors associated with this protocol */
+	prefix_initializer_t fields_initializer; /* registers the fields not yet registered, if any */
 };
 
 /* List of all protocols */
@@ -320,10 +322,22 @@ static GList *protocols = NULL;
 static GPtrArray *deregistered_fields = NULL;
 static GPtrArray *deregistered_data = NULL;
 
+/* Every field_info, other than those of the tree roots, ends up in a
+ * proto_node, and the two are freed together when the packet scope is,
+ * so they're allocated together: that's one allocation per item rather
+ * than two, and the node is next to the field_info it points to. */
+typedef struct {
+	proto_node	node;
+	field_info	finfo;
+} proto_node_finfo_t;
+
+#define PNODE_FINFO_CONTAINER(fi) \
+	((proto_node_finfo_t *)(void *)((guint8 *)(fi) - G_STRUCT_OFFSET(proto_node_finfo_t, finfo)))
+
 /* Contains information about a field when a dissector calls
  * proto_tree_add_item.  */
-#define FIELD_INFO_NEW(pool, fi)  fi = wmem_new(pool, field_info)
-#define FIELD_INFO_FREE(pool, fi) wmem_free(pool, fi)
+#define FIELD_INFO_NEW(pool, fi)  fi = &(wmem_new(pool, proto_node_finfo_t)->finfo)
+#define FIELD_INFO_FREE(pool, fi) wmem_free(pool, PNODE_FINFO_CONTAINER(fi))
 
 /* Contains the space for proto_nodes. */
 #define PROTO_NODE_INIT(node)			\
@@ -356,21 +370,51 @@ typedef struct _gpa_hfinfo_t {
 
 static gpa_hfinfo_t gpa_hfinfo;
 
-/* Hash table of abbreviations and IDs */
+/*
+ * Set of the registered fields with names, looked up by abbreviation.
+ * Each entry is the field itself, so the table needs no separate array
+ * of values; with well over 100000 fields, that saves a couple of
+ * megabytes in every process.  Lookups by name go through
+ * hfinfo_lookup_by_name().
+ */
 static GHashTable *gpa_name_map = NULL;
 static header_field_info *same_name_hfinfo;
 /*
  * We're called repeatedly with the same field name when sorting a column.
- * Cache our last gpa_name_map hit for faster lookups.
+ * Cache our last gpa_name_map hit for faster lookups.  Its abbrev is the
+ * name that was looked up, and it lives as long as the field is
+ * registered, so there's no need for a copy of the name; the cache is
+ * cleared whenever a field or protocol is deregistered.
  */
-static char *last_field_name = NULL;
-static header_field_info *last_hfinfo;
+static header_field_info *last_hfinfo = NULL;
 
 static void save_same_name_hfinfo(gpointer data)
 {
 	same_name_hfinfo = (header_field_info*)data;
 }
 
+static guint
+hfinfo_abbrev_hash(gconstpointer v)
+{
+	return g_str_hash(((const header_field_info *)v)->abbrev);
+}
+
+static gboolean
+hfinfo_abbrev_equal(gconstpointer a, gconstpointer b)
+{
+	return strcmp(((const header_field_info *)a)->abbrev,
+		      ((const header_field_info *)b)->abbrev) == 0;
+}
+
+static header_field_info *
+hfinfo_lookup_by_name(const char *field_name)
+{
+	header_field_info key;
+
+	key.abbrev = field_name;
+	return (header_field_info *)g_hash_table_lookup(gpa_name_map, &key);
+}
+
 /* Cached value for VINES address type (used for FT_VINES) */
 static int vines_address_type = -1;
 
@@ -502,7 +546,7 @@ proto_init(void (register_all_protocols_func)(register_cb cb, gpointer client_da
 	gpa_hfinfo.len           = 0;
 	gpa_hfinfo.allocated_len = 0;
 	gpa_hfinfo.hfi           = NULL;
-	gpa_name_map             = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, save_same_name_hfinfo);
+	gpa_name_map             = g_hash_table_new_full(hfinfo_abbrev_hash, hfinfo_abbrev_equal, NULL, save_same_name_hfinfo);
 	deregistered_fields      = g_ptr_array_new();
 	deregistered_data        = g_ptr_array_new();
 
@@ -568,8 +612,7 @@ proto_cleanup(void)
 		g_hash_table_destroy(gpa_name_map);
 		gpa_name_map = NULL;
 	}
-	g_free(last_field_name);
-	last_field_name = NULL;
+	last_hfinfo = NULL;
 
 	while (protocols) {
 		protocol_t        *protocol = (protocol_t *)protocols->data;
@@ -692,14 +735,15 @@ proto_tree_children_foreach(proto_tree *tree, proto_tree_foreach_func func,
 }
 
 static void
-free_GPtrArray_value(gpointer key, gpointer value, gpointer user_data _U_)
+free_GPtrArray_value(gpointer key, gpointer value, gpointer user_data)
 {
 	GPtrArray         *ptrs = (GPtrArray *)value;
 	gint               hfid = GPOINTER_TO_UINT(key);
+	tree_data_t       *tree_data = (tree_data_t *)user_data;
 	header_field_info *hfinfo;
 
 	PROTO_REGISTRAR_GET_NTH(hfid, hfinfo);
-	if (hfinfo->ref_type != HF_REF_TYPE_NONE) {
+	if (hfinfo->ref_type != HF_REF_TYPE_NONE && !tree_data->keep_primed) {
 		/* when a field is referenced by a filter this also
 		   affects the refcount for the parent protocol so we need
 		   to adjust the refcount for the parent as well
@@ -736,7 +780,7 @@ proto_tree_reset(proto_tree *tree)
 	if (tree_data->interesting_hfids) {
 		/* Free all the GPtrArray's in the interesting_hfids hash. */
 		g_hash_table_foreach(tree_data->interesting_hfids,
-			free_GPtrArray_value, NULL);
+			free_GPtrArray_value, tree_data);
 
 		/* And then remove all values. */
 		g_hash_table_remove_all(tree_data->interesting_hfids);
@@ -760,7 +804,7 @@ proto_tree_free(proto_tree *tree)
 	if (tree_data->interesting_hfids) {
 		/* Free all the GPtrArray's in the interesting_hfids hash. */
 		g_hash_table_foreach(tree_data->interesting_hfids,
-			free_GPtrArray_value, NULL);
+			free_GPtrArray_value, tree_data);
 
 		/* And then destroy the hash. */
 		g_hash_table_destroy(tree_data->interesting_hfids);
@@ -791,6 +835,18 @@ proto_tree_set_fake_protocols(proto_tree *tree, gboolean fake_protocols)
 	PTREE_DATA(tree)->fake_protocols = fake_protocols;
 }
 
+void
+proto_tree_set_skipped_protocols(proto_tree *tree, GHashTable *skipped_protocols)
+{
+	PTREE_DATA(tree)->skipped_protocols = skipped_protocols;
+}
+
+void
+proto_tree_set_keep_primed(proto_tree *tree, gboolean keep_primed)
+{
+	PTREE_DATA(tree)->keep_primed = keep_primed;
+}
+
 /* Assume dissector set only its protocol fields.
    This function is called by dissectors and allows the speeding up of filtering
    in wireshark; if this function returns FALSE it is safe to reset tree to NULL
@@ -884,23 +940,66 @@ prefix_equal (gconstpointer ap, gconstpointer bp) {
 static GHashTable* prefixes = NULL;
 
 
+/* The protocol whose filter name is the prefix, if any */
+static protocol_t *
+find_protocol_by_prefix(const char *prefix)
+{
+	int proto_id = proto_get_id_by_filter_name(prefix);
+
+	if (proto_id == -1)
+		return NULL;
+	return find_protocol_by_id(proto_id);
+}
+
 /* Register a new prefix for "delayed" initialization of field arrays */
 void
 proto_register_prefix(const char *prefix, prefix_initializer_t pi ) {
+	protocol_t *protocol;
+
 	if (! prefixes ) {
 		prefixes = g_hash_table_new(prefix_hash, prefix_equal);
 	}
 
 	g_hash_table_insert(prefixes, (gpointer)prefix, (gpointer)pi);
+
+	/*
+	 * If the prefix is a protocol's filter name, the fields get
+	 * registered before that protocol's dissectors are first called.
+	 */
+	protocol = find_protocol_by_prefix(prefix);
+	if (protocol)
+		protocol->fields_initializer = pi;
 }
 
 /* helper to call all prefix initializers */
 static gboolean
 initialize_prefix(gpointer k, gpointer v, gpointer u _U_) {
+	protocol_t *protocol = find_protocol_by_prefix((const char *)k);
+
+	if (protocol)
+		protocol->fields_initializer = NULL;
 	((prefix_initializer_t)v)((const char *)k);
 	return TRUE;
 }
 
+/* Register the protocol's fields, if that was delayed and hasn't been done */
+void
+proto_initialize_protocol_prefix(protocol_t *protocol)
+{
+	prefix_initializer_t pi = protocol->fields_initializer;
+
+	if (pi == NULL)
+		return;
+
+	/*
+	 * Forget the initializer before calling it, so that it's called
+	 * only once even if it looks up fields of its own.
+	 */
+	protocol->fields_initializer = NULL;
+	g_hash_table_remove(prefixes, protocol->filter_name);
+	pi(protocol->filter_name);
+}
+
 /** Initialize every remaining uninitialized prefix. */
 void
 proto_initialize_all_prefixes(void) {
@@ -918,19 +1017,19 @@ proto_registrar_get_byname(const char *field_name)
 {
 	header_field_info    *hfinfo;
 	prefix_initializer_t  pi;
+	gpointer              prefix, value;
+	protocol_t           *protocol;
 
 	if (!field_name)
 		return NULL;
 
-	if (g_strcmp0(field_name, last_field_name) == 0) {
+	if (last_hfinfo && strcmp(field_name, last_hfinfo->abbrev) == 0) {
 		return last_hfinfo;
 	}
 
-	hfinfo = (header_field_info *)g_hash_table_lookup(gpa_name_map, field_name);
+	hfinfo = hfinfo_lookup_by_name(field_name);
 
 	if (hfinfo) {
-		g_free(last_field_name);
-		last_field_name = g_strdup(field_name);
 		last_hfinfo = hfinfo;
 		return hfinfo;
 	}
@@ -938,18 +1037,20 @@ proto_registrar_get_byname(const char *field_name)
 	if (!prefixes)
 		return NULL;
 
-	if ((pi = (prefix_initializer_t)g_hash_table_lookup(prefixes, field_name) ) != NULL) {
+	if (g_hash_table_lookup_extended(prefixes, field_name, &prefix, &value)) {
+		pi = (prefix_initializer_t)value;
+		protocol = find_protocol_by_prefix((const char *)prefix);
+		if (protocol)
+			protocol->fields_initializer = NULL;
 		pi(field_name);
 		g_hash_table_remove(prefixes, field_name);
 	} else {
 		return NULL;
 	}
 
-	hfinfo = (header_field_info *)g_hash_table_lookup(gpa_name_map, field_name);
+	hfinfo = hfinfo_lookup_by_name(field_name);
 
 	if (hfinfo) {
-		g_free(last_field_name);
-		last_field_name = g_strdup(field_name);
 		last_hfinfo = hfinfo;
 	}
 	return hfinfo;
@@ -4009,7 +4110,10 @@ proto_tree_set_uint(field_info *fi, guint32 value)
 		integer >>= hfinfo_bitshift(hfinfo);
 	}
 
-	fvalue_set_uinteger(&fi->value, integer);
+	/* All the types added with this (FT_UINT8 through FT_UINT32,
+	 * FT_FRAMENUM) keep the value in the same place, so set it
+	 * directly rather than through the ftype. */
+	fi->value.value.uinteger = integer;
 }
 
 /* Add FT_UINT{40,48,56,64} to a proto_tree */
@@ -4188,7 +4292,8 @@ proto_tree_set_int(field_info *fi, gint32 value)
 		integer = ws_sign_ext32(integer, no_of_bits);
 	}
 
-	fvalue_set_sinteger(&fi->value, integer);
+	/* As in proto_tree_set_uint(). */
+	fi->value.value.sinteger = integer;
 }
 
 /* Add FT_INT{40,48,56,64} to a proto_tree */
@@ -4400,7 +4505,8 @@ proto_tree_add_node(proto_tree *tree, field_info *fi)
 		/* XXX - is it safe to continue here? */
 	}
 
-	pnode = wmem_new(PNODE_POOL(tree), proto_node);
+	/* The node was allocated along with the field_info. */
+	pnode = &PNODE_FINFO_CONTAINER(fi)->node;
 	PROTO_NODE_INIT(pnode);
 	pnode->parent = tnode;
 	PNODE_FINFO(pnode) = fi;
@@ -4691,6 +4797,7 @@ new_field_info(proto_tree *tree, header_field_info *hfinfo, tvbuff_t *tvb,
 		FI_SET_FLAG(fi, FI_HIDDEN);
 	fvalue_init(&fi->value, fi->hfinfo->type);
 	fi->rep        = NULL;
+	fi->deferred_rep = NULL;
 
 	/* add the data source tvbuff */
 	fi->ds_tvb = tvb ? tvb_get_ds_tvb(tvb) : NULL;
@@ -4701,10 +4808,274 @@ new_field_info(proto_tree *tree, header_field_info *hfinfo, tvbuff_t *tvb,
 	return fi;
 }
 
+/*
+ * The labels of items added with the ..._format_value() routines are the
+ * field name followed by a value formatted by the dissector.  Most of
+ * those labels are never looked at, so if we know how to replay all of
+ * the conversions in the format, we keep the format and its arguments
+ * and only format the label when it's asked for.
+ */
+#define DEFERRED_LABEL_MAX_ARGS	8
+#define DEFERRED_LABEL_MAX_SPEC	32	/* longest conversion specification */
+
+typedef enum {
+	LABEL_ARG_INT,		/* also char and short, and '*' widths */
+	LABEL_ARG_LONG,
+	LABEL_ARG_INT64,
+	LABEL_ARG_DOUBLE,
+	LABEL_ARG_STRING
+} label_arg_type_t;
+
+typedef struct {
+	label_arg_type_t type;
+	union {
+		int		i;
+		long		l;
+		gint64		ll;
+		double		d;
+		const char	*s;
+	} v;
+} label_arg_t;
+
+struct _item_label_deferred {
+	const char	*format;
+	int		num_args;
+	label_arg_t	args[1];	/* actually num_args of them */
+};
+
+/*
+ * Parse the conversion specification starting at the '%' at p.  Returns
+ * a pointer past it, and sets *num_stars to the number of '*' widths and
+ * precisions it has and *type to the type of its argument, or returns
+ * NULL if it's one we can't replay (including "%%").
+ */
+static const char *
+label_conversion_parse(const char *p, int *num_stars, label_arg_type_t *type)
+{
+	const char *start = p;
+	gboolean    has_precision = FALSE;
+	int         length = 0;	/* 0 = none, 1 = l, 2 = ll or I64 */
+
+	*num_stars = 0;
+	p++;
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+		p++;
+	if (*p == '*') {
+		(*num_stars)++;
+		p++;
+	} else {
+		while (g_ascii_isdigit(*p))
+			p++;
+	}
+	if (*p == '.') {
+		has_precision = TRUE;
+		p++;
+		if (*p == '*') {
+			(*num_stars)++;
+			p++;
+		} else {
+			while (g_ascii_isdigit(*p))
+				p++;
+		}
+	}
+	if (*p == 'h') {
+		p++;
+		if (*p == 'h')
+			p++;
+	} else if (*p == 'l') {
+		p++;
+		length = 1;
+		if (*p == 'l') {
+			p++;
+			length = 2;
+		}
+	} else if (p[0] == 'I' && p[1] == '6' && p[2] == '4') {
+		p += 3;
+		length = 2;
+	}
+
+	switch (*p) {
+		case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+			*type = (length == 2) ? LABEL_ARG_INT64 :
+			    (length == 1) ? LABEL_ARG_LONG : LABEL_ARG_INT;
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			if (length != 0)
+				return NULL;
+			*type = LABEL_ARG_DOUBLE;
+			break;
+		case 's':
+			/* With a precision, the string needn't be terminated. */
+			if (length != 0 || has_precision)
+				return NULL;
+			*type = LABEL_ARG_STRING;
+			break;
+		default:
+			return NULL;
+	}
+	p++;
+
+	if (p - start >= DEFERRED_LABEL_MAX_SPEC)
+		return NULL;
+	return p;
+}
+
+/*
+ * Save the format and arguments for formatting later, copying them into
+ * the pool, as the dissector's strings are likely to go away; returns
+ * NULL, having used up ap, if the format has anything we can't replay.
+ */
+static struct _item_label_deferred *
+deferred_label_new(wmem_allocator_t *pool, const char *format, va_list ap)
+{
+	label_arg_t                  args[DEFERRED_LABEL_MAX_ARGS];
+	int                          num_args = 0, num_stars, i;
+	label_arg_type_t             type;
+	const char                  *p, *s;
+	struct _item_label_deferred *dl;
+
+	for (p = strchr(format, '%'); p != NULL; p = strchr(p, '%')) {
+		if (p[1] == '%') {
+			p += 2;
+			continue;
+		}
+		p = label_conversion_parse(p, &num_stars, &type);
+		if (p == NULL || num_args + num_stars + 1 > DEFERRED_LABEL_MAX_ARGS)
+			return NULL;
+
+		for (i = 0; i < num_stars; i++) {
+			args[num_args].type = LABEL_ARG_INT;
+			args[num_args++].v.i = va_arg(ap, int);
+		}
+		args[num_args].type = type;
+		switch (type) {
+			case LABEL_ARG_INT:
+				args[num_args].v.i = va_arg(ap, int);
+				break;
+			case LABEL_ARG_LONG:
+				args[num_args].v.l = va_arg(ap, long);
+				break;
+			case LABEL_ARG_INT64:
+				args[num_args].v.ll = va_arg(ap, gint64);
+				break;
+			case LABEL_ARG_DOUBLE:
+				args[num_args].v.d = va_arg(ap, double);
+				break;
+			case LABEL_ARG_STRING:
+				s = va_arg(ap, const char *);
+				args[num_args].v.s = wmem_strdup(pool, s ? s : "(null)");
+				break;
+		}
+		num_args++;
+	}
+
+	dl = (struct _item_label_deferred *)wmem_alloc(pool,
+	    sizeof(struct _item_label_deferred) + (num_args ? num_args - 1 : 0) * sizeof(label_arg_t));
+	dl->format = wmem_strdup(pool, format);
+	dl->num_args = num_args;
+	memcpy(dl->args, args, num_args * sizeof(label_arg_t));
+	return dl;
+}
+
+#define DEFERRED_LABEL_SNPRINTF(val) \
+	((num_stars == 0) ? g_snprintf(buf + ret, size - ret, spec, val) : \
+	 (num_stars == 1) ? g_snprintf(buf + ret, size - ret, spec, arg[0].v.i, val) : \
+	 g_snprintf(buf + ret, size - ret, spec, arg[0].v.i, arg[1].v.i, val))
+
+/*
+ * Format a deferred label into buf; returns the length the formatted
+ * text would have had if there had been room for it, as g_snprintf()
+ * does.
+ */
+static int
+deferred_label_format(const struct _item_label_deferred *dl, gchar *buf, int size)
+{
+	const char        *p = dl->format, *next;
+	const label_arg_t *arg = dl->args;
+	char               spec[DEFERRED_LABEL_MAX_SPEC];
+	int                ret = 0, num_stars;
+	label_arg_type_t   type;
+
+	while (*p != '\0' && ret < size - 1) {
+		if (*p != '%') {
+			buf[ret++] = *p++;
+			continue;
+		}
+		if (p[1] == '%') {
+			buf[ret++] = '%';
+			p += 2;
+			continue;
+		}
+
+		/* deferred_label_new() checked that this can be parsed. */
+		next = label_conversion_parse(p, &num_stars, &type);
+		memcpy(spec, p, next - p);
+		spec[next - p] = '\0';
+		p = next;
+
+		switch (type) {
+			case LABEL_ARG_INT:
+				ret += DEFERRED_LABEL_SNPRINTF(arg[num_stars].v.i);
+				break;
+			case LABEL_ARG_LONG:
+				ret += DEFERRED_LABEL_SNPRINTF(arg[num_stars].v.l);
+				break;
+			case LABEL_ARG_INT64:
+				ret += DEFERRED_LABEL_SNPRINTF(arg[num_stars].v.ll);
+				break;
+			case LABEL_ARG_DOUBLE:
+				ret += DEFERRED_LABEL_SNPRINTF(arg[num_stars].v.d);
+				break;
+			case LABEL_ARG_STRING:
+				ret += DEFERRED_LABEL_SNPRINTF(arg[num_stars].v.s);
+				break;
+		}
+		arg += num_stars + 1;
+	}
+	if (ret < size)
+		buf[ret] = '\0';
+	else
+		buf[size - 1] = '\0';
+
+	/* If we stopped early, there was more to come. */
+	if (*p != '\0' && ret < size)
+		ret = size;
+	return ret;
+}
+
+/* Put the bits of a bitfield, if the field is one, and the field's name,
+   at the start of a label; returns the length they take up. */
+static int
+label_fill_field_name(field_info *fi, gchar *label_str)
+{
+	header_field_info *hf = fi->hfinfo;
+	int                ret = 0;
+
+	if (hf->bitmask && (hf->type == FT_BOOLEAN || IS_FT_UINT(hf->type))) {
+		guint64 val;
+		char *p;
+
+		if (IS_FT_UINT(hf->type))
+			val = fvalue_get_uinteger(&fi->value);
+		else
+			val = fvalue_get_uinteger64(&fi->value);
+
+		val <<= hfinfo_bitshift(hf);
+
+		p = decode_bitfield_value(label_str, val, hf->bitmask, hfinfo_container_bitwidth(hf));
+		ret = (int) (p - label_str);
+	}
+
+	/* put in the hf name */
+	ret += g_snprintf(label_str + ret, ITEM_LABEL_LENGTH - ret, "%s: ", hf->name);
+	return ret;
+}
+
 /* If the protocol tree is to be visible, set the representation of a
    proto_tree entry with the name of the field for the item and with
    the value formatted with the supplied printf-style format and
-   argument list. */
+   argument list; if possible, the formatting is put off until the
+   representation is needed. */
 static void
 proto_tree_set_representation_value(proto_item *pi, const char *format, va_list ap)
 {
@@ -4715,30 +5086,18 @@ proto_tree_set_representation_value(proto_item *pi, const char *format, va_list
 	if (PTREE_DATA(pi)->visible && !PROTO_ITEM_IS_HIDDEN(pi)) {
 		int               ret = 0;
 		field_info        *fi = PITEM_FINFO(pi);
-		header_field_info *hf;
+		va_list           ap2;
 
 		DISSECTOR_ASSERT(fi);
 
-		hf = fi->hfinfo;
+		G_VA_COPY(ap2, ap);
+		fi->deferred_rep = deferred_label_new(PNODE_POOL(pi), format, ap2);
+		va_end(ap2);
+		if (fi->deferred_rep != NULL)
+			return;
 
 		ITEM_LABEL_NEW(PNODE_POOL(pi), fi->rep);
-		if (hf->bitmask && (hf->type == FT_BOOLEAN || IS_FT_UINT(hf->type))) {
-			guint64 val;
-			char *p;
-
-			if (IS_FT_UINT(hf->type))
-				val = fvalue_get_uinteger(&fi->value);
-			else
-				val = fvalue_get_uinteger64(&fi->value);
-
-			val <<= hfinfo_bitshift(hf);
-
-			p = decode_bitfield_value(fi->rep->representation, val, hf->bitmask, hfinfo_container_bitwidth(hf));
-			ret = (int) (p - fi->rep->representation);
-		}
-
-		/* put in the hf name */
-		ret += g_snprintf(fi->rep->representation + ret, ITEM_LABEL_LENGTH - ret, "%s: ", hf->name);
+		ret = label_fill_field_name(fi, fi->rep->representation);
 
 		/* If possible, Put in the value of the string */
 		if (ret < ITEM_LABEL_LENGTH) {
@@ -4766,6 +5125,7 @@ proto_tree_set_representation(proto_item *pi, const char *format, va_list ap)
 	DISSECTOR_ASSERT(fi);
 
 	if (!PROTO_ITEM_IS_HIDDEN(pi)) {
+		fi->deferred_rep = NULL;
 		ITEM_LABEL_NEW(PNODE_POOL(pi), fi->rep);
 		ret = g_vsnprintf(fi->rep->representation, ITEM_LABEL_LENGTH,
 				  format, ap);
@@ -4820,12 +5180,11 @@ hfinfo_same_name_get_prev(const header_field_info *hfinfo)
 static void
 hfinfo_remove_from_gpa_name_map(const header_field_info *hfinfo)
 {
-	g_free(last_field_name);
-	last_field_name = NULL;
+	last_hfinfo = NULL;
 
 	if (!hfinfo->same_name_next && hfinfo->same_name_prev_id == -1) {
 		/* No hfinfo with the same name */
-		g_hash_table_steal(gpa_name_map, hfinfo->abbrev);
+		g_hash_table_steal(gpa_name_map, hfinfo);
 		return;
 	}
 
@@ -4838,7 +5197,7 @@ hfinfo_remove_from_gpa_name_map(const header_field_info *hfinfo)
 		same_name_prev->same_name_next = hfinfo->same_name_next;
 		if (!hfinfo->same_name_next) {
 			/* It's always the latest added hfinfo which is stored in gpa_name_map */
-			g_hash_table_insert(gpa_name_map, (gpointer) (same_name_prev->abbrev), same_name_prev);
+			g_hash_table_replace(gpa_name_map, same_name_prev, same_name_prev);
 		}
 	}
 }
@@ -5304,6 +5663,7 @@ proto_item_set_text(proto_item *pi, const char *format, ...)
 		ITEM_LABEL_FREE(PNODE_POOL(pi), fi->rep);
 		fi->rep = NULL;
 	}
+	fi->deferred_rep = NULL;
 
 	va_start(ap, format);
 	proto_tree_set_representation(pi, format, ap);
@@ -5333,6 +5693,7 @@ proto_item_append_text(proto_item *pi, const char *format, ...)
 		if (fi->rep == NULL) {
 			ITEM_LABEL_NEW(PNODE_POOL(pi), fi->rep);
 			proto_item_fill_label(fi, fi->rep->representation);
+			fi->deferred_rep = NULL;
 		}
 
 		curlen = strlen(fi->rep->representation);
@@ -5368,6 +5729,7 @@ proto_item_prepend_text(proto_item *pi, const char *format, ...)
 		if (fi->rep == NULL) {
 			ITEM_LABEL_NEW(PNODE_POOL(pi), fi->rep);
 			proto_item_fill_label(fi, representation);
+			fi->deferred_rep = NULL;
 		} else
 			g_strlcpy(representation, fi->rep->representation, ITEM_LABEL_LENGTH);
 
@@ -5459,6 +5821,12 @@ proto_tree_create_root(packet_info *pinfo)
 	/* Make sure that we fake protocols (if possible) */
 	pnode->tree_data->fake_protocols = TRUE;
 
+	/* Dissect every protocol */
+	pnode->tree_data->skipped_protocols = NULL;
+
+	/* Fields primed for a filter are unprimed when the tree is reset */
+	pnode->tree_data->keep_primed = FALSE;
+
 	/* Keep track of the number of children */
 	pnode->tree_data->count = 0;
 
@@ -5721,6 +6089,7 @@ proto_register_protocol(const char *name, const char *short_name,
 	protocol->is_enabled = TRUE; /* protocol is enabled by default */
 	protocol->enabled_by_default = TRUE; /* see previous comment */
 	protocol->can_toggle = TRUE;
+	protocol->is_stateless = FALSE;
 	protocol->heur_list = NULL;
 	/* list will be sorted later by name, when all protocols completed registering */
 	protocols = g_list_prepend(protocols, protocol);
@@ -5777,10 +6146,9 @@ proto_deregister_protocol(const char *short_name)
 	protocols = g_list_remove(protocols, protocol);
 
 	g_ptr_array_add(deregistered_fields, gpa_hfinfo.hfi[proto_id]);
-	g_hash_table_steal(gpa_name_map, protocol->filter_name);
+	g_hash_table_steal(gpa_name_map, gpa_hfinfo.hfi[proto_id]);
 
-	g_free(last_field_name);
-	last_field_name = NULL;
+	last_hfinfo = NULL;
 
 	return TRUE;
 }
@@ -6111,6 +6479,21 @@ proto_set_cant_toggle(const int proto_id)
 	protocol->can_toggle = FALSE;
 }
 
+void
+proto_set_stateless(const int proto_id)
+{
+	protocol_t *protocol;
+
+	protocol = find_protocol_by_id(proto_id);
+	protocol->is_stateless = TRUE;
+}
+
+gboolean
+proto_is_protocol_stateless(const protocol_t *protocol)
+{
+	return protocol->is_stateless;
+}
+
 static int
 proto_register_field_common(protocol_t *proto, header_field_info *hfi, const int parent)
 {
@@ -6203,8 +6586,7 @@ proto_deregister_field (const int parent, gint hf_id)
 	protocol_t       *proto;
 	guint             i;
 
-	g_free(last_field_name);
-	last_field_name = NULL;
+	last_hfinfo = NULL;
 
 	if (hf_id == -1 || hf_id == 0)
 		return;
@@ -6218,7 +6600,7 @@ proto_deregister_field (const int parent, gint hf_id)
 		hfi = (header_field_info *)g_ptr_array_index(proto->fields, i);
 		if (hfi->id == hf_id) {
 			/* Found the hf_id in this protocol */
-			g_hash_table_steal(gpa_name_map, hfi->abbrev);
+			g_hash_table_steal(gpa_name_map, hfi);
 			g_ptr_array_remove_index_fast(proto->fields, i);
 			g_ptr_array_add(deregistered_fields, gpa_hfinfo.hfi[hf_id]);
 			return;
@@ -6859,10 +7241,11 @@ proto_register_field_init(header_field_info *hfinfo, const int parent)
 
 		same_name_hfinfo = NULL;
 
-		g_hash_table_insert(gpa_name_map, (gpointer) (hfinfo->abbrev), hfinfo);
-		/* GLIB 2.x - if it is already present
-		 * the previous hfinfo with the same name is saved
-		 * to same_name_hfinfo by value destroy callback */
+		/* Replace, rather than insert, so that the key and the
+		 * value stay the same and the table remains a set.
+		 * If a field with this name is already present, it's
+		 * saved to same_name_hfinfo by the value destroy callback */
+		g_hash_table_replace(gpa_name_map, hfinfo, hfinfo);
 		if (same_name_hfinfo) {
 			/* There's already a field with this name.
 			 * Put the current field *before* that field
@@ -6881,6 +7264,9 @@ proto_register_field_init(header_field_info *hfinfo, const int parent)
 
 			same_name_hfinfo->same_name_next = hfinfo;
 			hfinfo->same_name_prev_id = same_name_hfinfo->id;
+
+			/* The name now maps to this field. */
+			last_hfinfo = NULL;
 #ifdef ENABLE_CHECK_FILTER
 			while (same_name_hfinfo) {
 				if (_ftype_common(hfinfo->type) != _ftype_common(same_name_hfinfo->type))
@@ -7043,6 +7429,21 @@ proto_item_fill_label(field_info *fi, gchar *label_str)
 		return;
 	}
 
+	if (fi->deferred_rep) {
+		/* Set with one of the ..._format_value() routines, and not
+		 * formatted yet. */
+		int ret;
+
+		ret = label_fill_field_name(fi, label_str);
+		if (ret < ITEM_LABEL_LENGTH) {
+			ret += deferred_label_format(fi->deferred_rep,
+			    label_str + ret, ITEM_LABEL_LENGTH - ret);
+		}
+		if (ret >= ITEM_LABEL_LENGTH)
+			LABEL_MARK_TRUNCATED_START(label_str);
+		return;
+	}
+
 	hfinfo = fi->hfinfo;
 
 	switch (hfinfo->type) {
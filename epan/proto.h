@@ -624,6 +624,7 @@ typedef struct field_info {
 	gint			 tree_type;       /**< one of ETT_ or -1 */
 	guint32			 flags;           /**< bitfield like FI_GENERATED, ... */
 	item_label_t		*rep;             /**< string for GUI tree */
+	struct _item_label_deferred *deferred_rep; /**< what rep will be made from, if it hasn't been yet */
 	tvbuff_t		*ds_tvb;          /**< data source tvbuff */
 	fvalue_t		 value;
 } field_info;
@@ -694,6 +695,8 @@ typedef struct {
     GHashTable  *interesting_hfids;
     gboolean     visible;
     gboolean     fake_protocols;
+    GHashTable  *skipped_protocols;
+    gboolean     keep_primed;
     gint         count;
     struct _packet_info *pinfo;
 } tree_data_t;
@@ -954,6 +957,24 @@ proto_tree_set_visible(proto_tree *tree, gboolean visible);
 extern void
 proto_tree_set_fake_protocols(proto_tree *tree, gboolean fake_protocols);
 
+/** Set the protocols whose dissectors aren't to be called when dissecting
+ into this tree, as returned by find_skippable_protocols() (default = NULL,
+ none are skipped).  The tree doesn't take ownership of the hash table.
+ @param tree the tree to be set
+ @param skipped_protocols protocol IDs of the protocols to skip, or NULL */
+extern void
+proto_tree_set_skipped_protocols(proto_tree *tree, GHashTable *skipped_protocols);
+
+/** Indicate whether resetting or freeing the tree should leave the fields
+ that a filter primed it with marked as referenced (default = FALSE).
+ Several trees used at once, in different threads, with the same filter
+ must do so, as the mark is kept in the fields' header_field_info; the
+ fields are then primed once, before any of the trees is used.
+ @param tree the tree to be set
+ @param keep_primed TRUE if the fields are to stay primed */
+extern void
+proto_tree_set_keep_primed(proto_tree *tree, gboolean keep_primed);
+
 /** Mark a field/protocol ID as "interesting".
  @param tree the tree to be set (currently ignored)
  @param hfid the interesting field id
@@ -2099,15 +2120,23 @@ proto_deregister_protocol(const char *short_name);
 typedef void (*prefix_initializer_t)(const char* match);
 
 /** Register a new prefix for delayed initialization of field arrays
-    Note that the initializer function MAY NOT be called before the dissector
-    is first called.  That is, dissectors using this function must be prepared
-    to call the initializer before beginning dissection; they should do this by
-    calling proto_registrar_get_byname() on one of the dissector's field names.
+    If the prefix is the filter name of a protocol that's already registered,
+    the initializer is called before any of that protocol's dissectors are
+    first called through a handle or as a heuristic dissector.  Code that can
+    run otherwise, e.g. a function called directly by another dissector, must
+    be prepared to call the initializer itself; it should do this by calling
+    proto_registrar_get_byname() on one of the dissector's field names.
 @param prefix the prefix for the new protocol
 @param initializer function that will initialize the field array for the given prefix */
 WS_DLL_PUBLIC void
 proto_register_prefix(const char *prefix,  prefix_initializer_t initializer);
 
+/** Call the initializer registered with proto_register_prefix() for the
+    protocol's filter name, if it hasn't been called yet.
+@param protocol the protocol whose fields are about to be used */
+WS_DLL_PUBLIC void
+proto_initialize_protocol_prefix(protocol_t *protocol);
+
 /** Initialize every remaining uninitialized prefix. */
 WS_DLL_PUBLIC void proto_initialize_all_prefixes(void);
 
@@ -2305,6 +2334,22 @@ WS_DLL_PUBLIC void proto_enable_all(void);
  @param proto_id protocol id (0-indexed) */
 WS_DLL_PUBLIC void proto_set_cant_toggle(const int proto_id);
 
+/** Mark a protocol as stateless: its dissector may be skipped when nothing
+ it, or the protocols it hands data to, adds to the tree is needed, e.g.
+ when the only reason to dissect packets is to run a display filter that
+ doesn't test any of their fields.  Only do this for a protocol whose
+ dissector keeps no state between packets, always accepts the data it's
+ handed, and only passes data on to other protocols through dissector
+ tables, heuristic lists or register_depend_dissector()-registered calls.
+ XXX - only "data" and "media" are marked so far; dissectors that track
+ conversations or reassemble, such as HTTP's or SMB2's, can't be.
+ @param proto_id protocol id (0-indexed) */
+WS_DLL_PUBLIC void proto_set_stateless(const int proto_id);
+
+/** Can protocol's dissection be skipped when not needed?
+ @return TRUE if it can, FALSE if not */
+WS_DLL_PUBLIC gboolean proto_is_protocol_stateless(const protocol_t *protocol);
+
 /** Checks for existence any protocol or field within a tree.
  @param tree "Protocols" are assumed to be a child of the [empty] root node.
  @param id hfindex of protocol or field
@@ -38,6 +38,7 @@
 
 #include <epan/packet_info.h>
 #include <epan/dfilter/dfilter.h>
+#include <epan/epan_dissect.h>
 #include <epan/tap.h>
 #include <wsutil/ws_printf.h> /* ws_g_warning */
 
@@ -99,6 +100,7 @@ typedef struct _tap_listener_t {
 	guint flags;
 	gchar *fstring;
 	dfilter_t *code;
+	guint code_idx;		/* index of code in tap_filter_set */
 	void *tapdata;
 	tap_reset_cb reset;
 	tap_packet_cb packet;
@@ -106,6 +108,34 @@ typedef struct _tap_listener_t {
 } tap_listener_t;
 static volatile tap_listener_t *tap_listener_queue=NULL;
 
+/* The filters of all the tap listeners, as a set, so that they share
+ * the work of testing a packet; built when first needed, and thrown
+ * away whenever a listener or its filter changes. */
+static dfilter_set_t *tap_filter_set=NULL;
+
+static void
+tap_filter_set_invalidate(void)
+{
+	dfilter_set_free(tap_filter_set);
+	tap_filter_set=NULL;
+}
+
+static dfilter_set_t *
+tap_filter_set_get(void)
+{
+	volatile tap_listener_t *tl;
+
+	if(!tap_filter_set){
+		tap_filter_set=dfilter_set_new();
+		for(tl=tap_listener_queue;tl;tl=tl->next){
+			if(tl->code){
+				tl->code_idx=dfilter_set_add(tap_filter_set, tl->code);
+			}
+		}
+	}
+	return tap_filter_set;
+}
+
 #ifdef HAVE_PLUGINS
 
 #include <gmodule.h>
@@ -339,6 +369,7 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 {
 	tap_packet_t *tp;
 	volatile tap_listener_t *tl;
+	dfilter_set_t *set;
 	guint i;
 
 	/* nothing to do, just return */
@@ -353,6 +384,11 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 		return;
 	}
 
+	/* each listener's filter is run at most once for this packet,
+	   however many times its tap was queued */
+	set=tap_filter_set_get();
+	dfilter_set_begin(set, edt->tree);
+
 	/* loop over all tap listeners and call the listener callback
 	   for all packets that match the filter. */
 	for(i=0;i<tap_packet_index;i++){
@@ -364,7 +400,7 @@ tap_push_tapped_queue(epan_dissect_t *edt)
 				if(tp->tap_id==tl->tap_id){
 					gboolean passed=TRUE;
 					if(tl->code){
-						passed=dfilter_apply_edt(tl->code, edt);
+						passed=dfilter_set_apply_nth(set, tl->code_idx);
 					}
 					if(passed && tl->packet){
 						tl->needs_redraw|=tl->packet(tl->tapdata, tp->pinfo, edt, tp->tap_specific_data);
@@ -505,6 +541,7 @@ free_tap_listener(volatile tap_listener_t *tl)
 	if(!tl)
 		return;
 	if(tl->code){
+		tap_filter_set_invalidate();
 		dfilter_free(tl->code);
 	}
 	g_free(tl->fstring);
@@ -561,6 +598,7 @@ register_tap_listener(const char *tapname, void *tapdata, const char *fstring,
 	tl->next=tap_listener_queue;
 
 	tap_listener_queue=tl;
+	tap_filter_set_invalidate();
 
 	return NULL;
 }
@@ -592,6 +630,7 @@ set_tap_dfilter(void *tapdata, const char *fstring)
 	}
 
 	if(tl){
+		tap_filter_set_invalidate();
 		if(tl->code){
 			dfilter_free(tl->code);
 			tl->code=NULL;
@@ -625,6 +664,7 @@ tap_listeners_dfilter_recompile(void)
 	dfilter_t *code;
 	gchar *err_msg;
 
+	tap_filter_set_invalidate();
 	for(tl=tap_listener_queue;tl;tl=tl->next){
 		if(tl->code){
 			dfilter_free(tl->code);
@@ -649,6 +649,9 @@ WSLUA_CONSTRUCTOR Field_list(lua_State *L) {
 
     lua_newtable(L);
 
+    /* Some protocols only register their fields when they're first used */
+    proto_initialize_all_prefixes();
+
     for (i = proto_get_first_protocol(&cookie); i != -1;
          i = proto_get_next_protocol(&cookie)) {
 
@@ -354,6 +354,7 @@ cf_open(capture_file *cf, const char *fname, unsigned int type, gboolean is_temp
 
   /* Allocate a frame_data_sequence for the frames in this file */
   cf->frames = new_frame_data_sequence();
+  cf->field_cache = field_cache_new();
 
   nstime_set_zero(&cf->elapsed_time);
   cf->ref = NULL;
@@ -441,6 +442,8 @@ cf_close(capture_file *cf)
     free_frame_data_sequence(cf->frames);
     cf->frames = NULL;
   }
+  field_cache_free(cf->field_cache);
+  cf->field_cache = NULL;
 #ifdef WANT_PACKET_EDITOR
   if (cf->edited_frames) {
     g_tree_destroy(cf->edited_frames);
@@ -558,6 +561,11 @@ cf_read(capture_file *cf, gboolean reloading)
   compiled = dfilter_compile(cf->dfilter, &dfcode, NULL);
   g_assert(!cf->dfilter || (compiled && dfcode));
 
+  /* Remember the values of the fields the filter uses, once they're
+     recorded when the packets are next rescanned, so that it, and filters
+     on the same fields, can be reapplied without dissecting. */
+  field_cache_learn(cf->field_cache, dfcode);
+
   /* Get the union of the flags for all tap listeners. */
   tap_flags = union_of_tap_listener_flags();
   create_proto_tree =
@@ -603,6 +611,9 @@ cf_read(capture_file *cf, gboolean reloading)
 
     g_timer_start(prog_timer);
 
+    /* Have the next records read while we're processing the current one. */
+    wtap_set_read_ahead(cf->wth, WTAP_READ_AHEAD_DEFAULT_DEPTH);
+
     while ((wtap_read(cf->wth, &err, &err_info, &data_offset))) {
       if (size >= 0) {
         count++;
@@ -1098,6 +1109,7 @@ add_packet_to_packet_list(frame_data *fdata, capture_file *cf,
     struct wtap_pkthdr *phdr, const guint8 *buf, gboolean add_to_packet_list)
 {
   gint            row               = -1;
+  gboolean        first_pass        = !fdata->flags.visited;
 
   frame_data_set_before_dissect(fdata, &cf->elapsed_time,
                                 &cf->ref, cf->prev_dis);
@@ -1106,6 +1118,9 @@ add_packet_to_packet_list(frame_data *fdata, capture_file *cf,
   if (dfcode != NULL) {
       epan_dissect_prime_dfilter(edt, dfcode);
   }
+  if (edt->tree && !first_pass && field_cache_wants_fields(cf->field_cache)) {
+      field_cache_prime_edt(cf->field_cache, edt);
+  }
 #if 0
   /* Prepare coloring rules, this ensures that display filter rules containing
    * frame.color_rule references are still processed.
@@ -1119,6 +1134,10 @@ add_packet_to_packet_list(frame_data *fdata, capture_file *cf,
   /* Dissect the frame. */
   epan_dissect_run_with_taps(edt, cf->cd_t, phdr, frame_tvbuff_new(fdata, buf), fdata, cinfo);
 
+  if (cf->field_cache != NULL) {
+    field_cache_record(cf->field_cache, fdata->num, first_pass, edt);
+  }
+
   /* If we don't have a display filter, set "passed_dfilter" to 1. */
   if (dfcode != NULL) {
     fdata->flags.passed_dfilter = dfilter_apply_edt(dfcode, edt) ? 1 : 0;
@@ -1170,6 +1189,46 @@ add_packet_to_packet_list(frame_data *fdata, capture_file *cf,
   return row;
 }
 
+/*
+ * Like add_packet_to_packet_list(), but without reading or dissecting the
+ * frame; the display filter is applied to the values in cf->field_cache.
+ */
+static void
+filter_packet_from_field_cache(frame_data *fdata, capture_file *cf,
+    epan_dissect_t *edt, dfilter_t *dfcode, const guint8 *passed)
+{
+  frame_data_set_before_dissect(fdata, &cf->elapsed_time,
+                                &cf->ref, cf->prev_dis);
+  cf->prev_cap = fdata;
+
+  if (dfcode != NULL) {
+    /* If the frames have already been filtered, in parallel, just pick
+       up the result. */
+    if (passed != NULL)
+      fdata->flags.passed_dfilter = passed[fdata->num - 1];
+    else
+      fdata->flags.passed_dfilter =
+        field_cache_apply(cf->field_cache, dfcode, edt, fdata->num) ? 1 : 0;
+
+    if (fdata->flags.passed_dfilter) {
+      g_slist_foreach(field_cache_dependent_frames(cf->field_cache, fdata->num),
+                      find_and_mark_frame_depended_upon, cf->frames);
+    }
+  } else
+    fdata->flags.passed_dfilter = 1;
+
+  if (fdata->flags.passed_dfilter || fdata->flags.ref_time) {
+    cf->displayed_count++;
+
+    frame_data_set_after_dissect(fdata, &cf->cum_bytes);
+    cf->prev_dis = fdata;
+
+    if (cf->first_displayed == 0)
+      cf->first_displayed = fdata->num;
+    cf->last_displayed = fdata->num;
+  }
+}
+
 /* read in a new packet */
 /* returns the row of the new packet in the packet list or -1 if not displayed */
 static int
@@ -1270,13 +1329,6 @@ merge_callback(merge_event event, int num _U_,
 
     case MERGE_EVENT_PACKET_WAS_READ:
       {
-        gint64 data_offset = 0;
-
-        /* Get the sum of the data offsets in all of the files. */
-        data_offset = 0;
-        for (i = 0; i < in_file_count; i++)
-          data_offset += in_files[i].data_offset;
-
         /* Create the progress bar if necessary.
            We check on every iteration of the loop, so that it takes no
            longer than the standard time to create it (otherwise, for a
@@ -1473,6 +1525,9 @@ cf_filter_packets(capture_file *cf, gchar *dftext, gboolean force)
   /* Now rescan the packet list, applying the new filter, but not
      throwing away information constructed on a previous pass. */
   if (cf->state != FILE_CLOSED) {
+    /* If the filter looks at fields we haven't been caching, start
+       caching them; this rescan will record them. */
+    field_cache_learn(cf->field_cache, dfcode);
     if (dftext == NULL) {
       rescan_packets(cf, "Resetting", "Filter", FALSE);
     } else {
@@ -1589,6 +1644,8 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, gb
   gboolean    add_to_packet_list = FALSE;
   gboolean    compiled;
   guint32     frames_count;
+  gboolean    use_field_cache;
+  guint8     *passed = NULL;
 
   /* Compile the current display filter.
    * We assume this will not fail since cf->dfilter is only set in
@@ -1601,9 +1658,36 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, gb
   tap_flags = union_of_tap_listener_flags();
   cinfo = (tap_flags & TL_REQUIRES_COLUMNS) ? &cf->cinfo : NULL;
   create_proto_tree =
-    (dfcode != NULL || have_filtering_tap_listeners() || (tap_flags & TL_REQUIRES_PROTO_TREE));
+    (dfcode != NULL || have_filtering_tap_listeners() || (tap_flags & TL_REQUIRES_PROTO_TREE) ||
+     field_cache_wants_fields(cf->field_cache));
+
+  /* If only the display filter needs the packets, and we have the values
+     of all the fields it looks at for all of them, filter using those
+     values rather than reading and dissecting every packet again.  The
+     tap listeners keep what they have, as nothing will be tapped. */
+  use_field_cache = !redissect && !tap_listeners_require_dissection() &&
+    field_cache_num_frames(cf->field_cache) >= cf->count &&
+    (dfcode == NULL || field_cache_can_filter(cf->field_cache, dfcode));
+  if (use_field_cache) {
+    field_cache_begin_scan(cf->field_cache);
+
+    /* With enough frames, and processors, the filter can be applied to
+       the cached values by several threads at once; the rest of the
+       work for each frame has to be done in order, below. */
+    if (dfcode != NULL) {
+      passed = (guint8 *)g_malloc(cf->count);
+      if (!field_cache_filter_frames(cf->field_cache, cf->epan, cf->dfilter,
+                                     cf->count, passed)) {
+        g_free(passed);
+        passed = NULL;
+      }
+    }
+  } else {
+    /* Everything is about to be dissected again; record it afresh. */
+    field_cache_clear(cf->field_cache);
+    reset_tap_listeners();
+  }
 
-  reset_tap_listeners();
   /* Which frame, if any, is the currently selected frame?
      XXX - should the selected frame or the focus frame be the "current"
      frame, that frame being the one from which "Find Frame" searches
@@ -1757,7 +1841,7 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, gb
     /* Frame dependencies from the previous dissection/filtering are no longer valid. */
     fdata->flags.dependent_of_displayed = 0;
 
-    if (!cf_read_record(cf, fdata))
+    if (!use_field_cache && !cf_read_record(cf, fdata))
       break; /* error reading the frame */
 
     /* If the previous frame is displayed, and we haven't yet seen the
@@ -1768,10 +1852,13 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, gb
       preceding_frame = prev_frame;
     }
 
-    add_packet_to_packet_list(fdata, cf, &edt, dfcode,
-                                    cinfo, &cf->phdr,
-                                    ws_buffer_start_ptr(&cf->buf),
-                                    add_to_packet_list);
+    if (use_field_cache)
+      filter_packet_from_field_cache(fdata, cf, &edt, dfcode, passed);
+    else
+      add_packet_to_packet_list(fdata, cf, &edt, dfcode,
+                                      cinfo, &cf->phdr,
+                                      ws_buffer_start_ptr(&cf->buf),
+                                      add_to_packet_list);
 
     /* If this frame is displayed, and this is the first frame we've
        seen displayed after the selected frame, remember this frame -
@@ -1794,6 +1881,7 @@ rescan_packets(capture_file *cf, const char *action, const char *action_item, gb
   }
 
   epan_dissect_cleanup(&edt);
+  g_free(passed);
 
   /* We are done redissecting the packet list. */
   cf->redissecting = FALSE;
@@ -4616,7 +4704,7 @@ cf_save_records(capture_file *cf, const char *fname, guint save_format,
       pdh = wtap_dump_open_ng(fname, save_format, encap, cf->snap,
                               compressed, shb_hdrs, idb_inf, nrb_hdrs, &err);
     }
-    g_free(idb_inf);
+    wtap_file_free_idb_info(idb_inf);
     idb_inf = NULL;
 
     if (pdh == NULL) {
@@ -4848,7 +4936,7 @@ cf_export_specified_packets(capture_file *cf, const char *fname,
     pdh = wtap_dump_open_ng(fname, save_format, encap, cf->snap,
                             compressed, shb_hdrs, idb_inf, nrb_hdrs, &err);
   }
-  g_free(idb_inf);
+  wtap_file_free_idb_info(idb_inf);
   idb_inf = NULL;
 
   if (pdh == NULL) {
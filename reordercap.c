@@ -38,6 +38,7 @@
 #include "wsutil/wsgetopt.h"
 #endif
 
+#include <wsutil/clopts_common.h>
 #include <wsutil/crash_info.h>
 #include <wsutil/filesystem.h>
 #include <wsutil/file_util.h>
@@ -60,6 +61,9 @@ print_usage(FILE *output)
     fprintf(output, "\n");
     fprintf(output, "Options:\n");
     fprintf(output, "  -n        don't write to output file if the input file is ordered.\n");
+    fprintf(output, "  -m <frames>\n");
+    fprintf(output, "            hold at most <frames> frames in memory, sorting in\n");
+    fprintf(output, "            runs written to temporary files if that isn't enough.\n");
     fprintf(output, "  -h        display this help and exit.\n");
 }
 
@@ -67,6 +71,7 @@ print_usage(FILE *output)
 typedef struct FrameRecord_t {
     gint64       offset;
     guint        num;
+    guint        run;           /* with -m, the sorted run it's written in */
 
     nstime_t     frame_time;
 } FrameRecord_t;
@@ -85,6 +90,43 @@ typedef struct FrameRecord_t {
 #endif
 /**************************************************/
 
+/* Number of records to read at a time */
+#define REORDERCAP_BATCH_SIZE 1024
+
+/* Most temporary files to have open at once when merging sorted runs */
+#define REORDERCAP_MAX_MERGED_RUNS 64
+
+
+/* Report a read error and give up */
+static void
+read_failure(const char *filename, int err, gchar *err_info)
+{
+    fprintf(stderr,
+            "reordercap: An error occurred while reading \"%s\": %s.\n",
+            filename, wtap_strerror(err));
+    if (err_info != NULL) {
+        fprintf(stderr, "(%s)\n", err_info);
+        g_free(err_info);
+    }
+    exit(1);
+}
+
+static void
+dump_frame(wtap_dumper *pdh, const struct wtap_pkthdr *phdr, const guint8 *pd)
+{
+    int    err;
+    gchar  *err_info;
+
+    if (!wtap_dump(pdh, phdr, pd, &err, &err_info)) {
+        fprintf(stderr, "reordercap: Error (%s) writing frame to outfile\n",
+                wtap_strerror(err));
+        if (err_info != NULL) {
+            fprintf(stderr, "(%s)\n", err_info);
+            g_free(err_info);
+        }
+        exit(1);
+    }
+}
 
 static void
 frame_write(FrameRecord_t *frame, wtap *wth, wtap_dumper *pdh,
@@ -118,14 +160,16 @@ frame_write(FrameRecord_t *frame, wtap *wth, wtap_dumper *pdh,
     phdr->ts = frame->frame_time;
 
     /* Dump frame to outfile */
-    if (!wtap_dump(pdh, phdr, ws_buffer_start_ptr(buf), &err, &err_info)) {
-        fprintf(stderr, "reordercap: Error (%s) writing frame to outfile\n",
-                wtap_strerror(err));
-        if (err_info != NULL) {
-            fprintf(stderr, "(%s)\n", err_info);
-            g_free(err_info);
-        }
-        exit(1);
+    dump_frame(pdh, phdr, ws_buffer_start_ptr(buf));
+}
+
+static void
+frame_set_time(FrameRecord_t *frame, const struct wtap_pkthdr *phdr)
+{
+    if (phdr->presence_flags & WTAP_HAS_TS) {
+        frame->frame_time = phdr->ts;
+    } else {
+        nstime_set_unset(&frame->frame_time);
     }
 }
 
@@ -146,6 +190,427 @@ frames_compare(gconstpointer a, gconstpointer b)
     return nstime_cmp(time1, time2);
 }
 
+/**************************************************/
+/* Bounded-memory sort (-m)                       */
+/*
+ * With -m, at most max_held frames are held in memory.  Frames are read
+ * in order into a heap and, once it's full, the earliest one is written
+ * out each time another is read; as long as no frame is more than
+ * max_held frames away from where it belongs, as is usual for captures
+ * merged from several queues, that sorts the whole file in one pass.
+ *
+ * A frame that arrives too late to be written in order is held back
+ * for the next "run", as in replacement selection.  If there turns out
+ * to be more than one run, each run is written to a temporary file and
+ * the runs are then merged.  The first pass over the file, which only
+ * looks at the timestamps, finds out which of those will happen, so
+ * that a single run can go straight to the output file.
+ */
+
+/* A frame held in memory */
+typedef struct HeldFrame_t {
+    FrameRecord_t       rec;        /* must be first */
+    struct wtap_pkthdr  phdr;
+    guint8             *data;
+} HeldFrame_t;
+
+/* Binary min-heap of frames, ordered by run, then timestamp, then
+   position in the input file */
+typedef struct FrameHeap_t {
+    FrameRecord_t **frames;
+    guint           count;
+    FrameRecord_t  *last_out;       /* last frame taken out, if any */
+} FrameHeap_t;
+
+static gboolean
+frame_earlier(const FrameRecord_t *frame1, const FrameRecord_t *frame2)
+{
+    int cmp;
+
+    if (frame1->run != frame2->run) {
+        return frame1->run < frame2->run;
+    }
+    cmp = nstime_cmp(&frame1->frame_time, &frame2->frame_time);
+    if (cmp != 0) {
+        return cmp < 0;
+    }
+    return frame1->num < frame2->num;
+}
+
+static void
+frame_heap_init(FrameHeap_t *heap, guint max_count)
+{
+    heap->frames = g_new(FrameRecord_t *, max_count);
+    heap->count = 0;
+    heap->last_out = NULL;
+}
+
+static void
+frame_heap_push(FrameHeap_t *heap, FrameRecord_t *frame)
+{
+    guint i = heap->count++;
+
+    while (i > 0) {
+        guint parent = (i - 1) / 2;
+
+        if (!frame_earlier(frame, heap->frames[parent])) {
+            break;
+        }
+        heap->frames[i] = heap->frames[parent];
+        i = parent;
+    }
+    heap->frames[i] = frame;
+}
+
+static FrameRecord_t *
+frame_heap_pop(FrameHeap_t *heap)
+{
+    FrameRecord_t *top = heap->frames[0];
+    FrameRecord_t *last = heap->frames[--heap->count];
+    guint i = 0;
+
+    if (heap->count == 0) {
+        return top;
+    }
+    for (;;) {
+        guint child = 2 * i + 1;
+
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count &&
+            frame_earlier(heap->frames[child + 1], heap->frames[child])) {
+            child++;
+        }
+        if (!frame_earlier(heap->frames[child], last)) {
+            break;
+        }
+        heap->frames[i] = heap->frames[child];
+        i = child;
+    }
+    heap->frames[i] = last;
+    return top;
+}
+
+/* First pass: add a frame to the window, taking out the earliest frame
+   once there are more than max_held.  Returns FALSE if the frame comes
+   before one that's already been taken out, i.e. if one run isn't
+   enough; the caller then stops checking. */
+static gboolean
+window_check(FrameHeap_t *window, guint max_held, FrameRecord_t *frame)
+{
+    if (window->last_out != NULL && frame_earlier(frame, window->last_out)) {
+        g_slice_free(FrameRecord_t, frame);
+        return FALSE;
+    }
+    frame_heap_push(window, frame);
+    if (window->count > max_held) {
+        if (window->last_out != NULL) {
+            g_slice_free(FrameRecord_t, window->last_out);
+        }
+        window->last_out = frame_heap_pop(window);
+    }
+    return TRUE;
+}
+
+static void
+window_free(FrameHeap_t *window)
+{
+    while (window->count > 0) {
+        g_slice_free(FrameRecord_t, frame_heap_pop(window));
+    }
+    if (window->last_out != NULL) {
+        g_slice_free(FrameRecord_t, window->last_out);
+    }
+    g_free(window->frames);
+}
+
+static HeldFrame_t *
+held_frame_new(const struct wtap_pkthdr *phdr, const guint8 *pd, guint num)
+{
+    HeldFrame_t *frame = g_new(HeldFrame_t, 1);
+
+    frame->rec.offset = 0;
+    frame->rec.num = num;
+    frame->rec.run = 0;
+    frame_set_time(&frame->rec, phdr);
+
+    /* The copy mustn't share anything with the reader */
+    frame->phdr = *phdr;
+    memset(&frame->phdr.ft_specific_data, 0, sizeof frame->phdr.ft_specific_data);
+    frame->phdr.opt_comment = g_strdup(phdr->opt_comment);
+    frame->data = (guint8 *)g_memdup(pd, phdr->caplen);
+    return frame;
+}
+
+static void
+held_frame_free(HeldFrame_t *frame)
+{
+    g_free(frame->phdr.opt_comment);
+    g_free(frame->data);
+    g_free(frame);
+}
+
+typedef struct BoundedSort_t {
+    wtap                        *wth;
+    FrameHeap_t                  window;
+    guint                        max_held;
+    gboolean                     single_run;
+    guint                        run;       /* run being written */
+    wtap_dumper                 *run_pdh;   /* where it's being written */
+    GPtrArray                   *run_files; /* temporary files, with more than one run */
+    GArray                      *shb_hdrs;
+    wtapng_iface_descriptions_t *idb_inf;
+    GArray                      *nrb_hdrs;
+} BoundedSort_t;
+
+static void
+run_open(BoundedSort_t *sort)
+{
+    char *tmpname;
+    int err;
+
+    sort->run_pdh = wtap_dump_open_tempfile_ng(&tmpname, "reordercap",
+                        wtap_file_type_subtype(sort->wth), wtap_file_encap(sort->wth),
+                        65535, FALSE, sort->shb_hdrs, sort->idb_inf, sort->nrb_hdrs, &err);
+    if (sort->run_pdh == NULL) {
+        fprintf(stderr, "reordercap: Can't create a temporary file: %s\n",
+                wtap_strerror(err));
+        exit(1);
+    }
+    /* tmpname belongs to create_tempfile() and will be reused */
+    g_ptr_array_add(sort->run_files, g_strdup(tmpname));
+}
+
+static void
+run_close(BoundedSort_t *sort)
+{
+    int err;
+
+    if (!wtap_dump_close(sort->run_pdh, &err)) {
+        fprintf(stderr, "reordercap: Error closing %s: %s\n",
+                (const char *)g_ptr_array_index(sort->run_files, sort->run),
+                wtap_strerror(err));
+        exit(1);
+    }
+    sort->run_pdh = NULL;
+}
+
+/* Write out the earliest frame held */
+static void
+window_write(BoundedSort_t *sort)
+{
+    HeldFrame_t *frame = (HeldFrame_t *)frame_heap_pop(&sort->window);
+
+    if (frame->rec.run != sort->run) {
+        /* Everything still held belongs to the next run */
+        if (sort->single_run) {
+            fprintf(stderr, "reordercap: The input file changed while it was being read\n");
+            exit(1);
+        }
+        run_close(sort);
+        sort->run = frame->rec.run;
+        run_open(sort);
+    }
+    dump_frame(sort->run_pdh, &frame->phdr, frame->data);
+
+    /* Only the sort key of the last frame written is needed */
+    g_free(frame->data);
+    frame->data = NULL;
+    if (sort->window.last_out != NULL) {
+        held_frame_free((HeldFrame_t *)sort->window.last_out);
+    }
+    sort->window.last_out = &frame->rec;
+}
+
+/* Read the next frame of a run file */
+static gboolean
+run_read(wtap *run_wth, FrameRecord_t *head, const char *run_file)
+{
+    int err;
+    gchar *err_info;
+    gint64 data_offset;
+
+    if (!wtap_read(run_wth, &err, &err_info, &data_offset)) {
+        if (err != 0) {
+            read_failure(run_file, err, err_info);
+        }
+        return FALSE;
+    }
+    frame_set_time(head, wtap_phdr(run_wth));
+    return TRUE;
+}
+
+/* Merge nruns sorted runs, starting at first, into pdh, and remove them */
+static void
+runs_merge(BoundedSort_t *sort, guint first, guint nruns, wtap_dumper *pdh)
+{
+    wtap **run_wths = g_new(wtap *, nruns);
+    FrameRecord_t *heads = g_new0(FrameRecord_t, nruns);
+    FrameHeap_t heap;
+    guint i;
+    int err;
+    gchar *err_info;
+
+    /* The run number is only a tie-break here, so it goes in num */
+    frame_heap_init(&heap, nruns);
+    for (i = 0; i < nruns; i++) {
+        const char *run_file = (const char *)g_ptr_array_index(sort->run_files, first + i);
+
+        run_wths[i] = wtap_open_offline(run_file, WTAP_TYPE_AUTO, &err, &err_info, FALSE);
+        if (run_wths[i] == NULL) {
+            fprintf(stderr, "reordercap: Can't open %s: %s\n", run_file,
+                    wtap_strerror(err));
+            if (err_info != NULL) {
+                fprintf(stderr, "(%s)\n", err_info);
+                g_free(err_info);
+            }
+            exit(1);
+        }
+        heads[i].num = i;
+        if (run_read(run_wths[i], &heads[i], run_file)) {
+            frame_heap_push(&heap, &heads[i]);
+        }
+    }
+
+    while (heap.count > 0) {
+        FrameRecord_t *head = frame_heap_pop(&heap);
+        wtap *run_wth = run_wths[head->num];
+
+        dump_frame(pdh, wtap_phdr(run_wth), wtap_buf_ptr(run_wth));
+        if (run_read(run_wth, head,
+                     (const char *)g_ptr_array_index(sort->run_files, first + head->num))) {
+            frame_heap_push(&heap, head);
+        }
+    }
+
+    for (i = 0; i < nruns; i++) {
+        wtap_close(run_wths[i]);
+        ws_unlink((const char *)g_ptr_array_index(sort->run_files, first + i));
+    }
+    g_free(heap.frames);
+    g_free(heads);
+    g_free(run_wths);
+}
+
+/* Second pass: read the frames again, this time with their data, and
+   write them out in order */
+static void
+sort_bounded(const char *infile, wtap_dumper *pdh, guint max_held,
+             gboolean single_run)
+{
+    BoundedSort_t sort;
+    wtap_batch_t *batch;
+    guint num = 0;
+    guint rec;
+    int err;
+    gchar *err_info;
+
+    sort.wth = wtap_open_offline(infile, WTAP_TYPE_AUTO, &err, &err_info, FALSE);
+    if (sort.wth == NULL) {
+        fprintf(stderr, "reordercap: Can't open %s: %s\n", infile,
+                wtap_strerror(err));
+        if (err_info != NULL) {
+            fprintf(stderr, "(%s)\n", err_info);
+            g_free(err_info);
+        }
+        exit(1);
+    }
+    frame_heap_init(&sort.window, max_held + 1);
+    sort.max_held = max_held;
+    sort.single_run = single_run;
+    sort.run = 0;
+    sort.run_files = g_ptr_array_new_with_free_func(g_free);
+    sort.shb_hdrs = wtap_file_get_shb_for_new_file(sort.wth);
+    sort.idb_inf = wtap_file_get_idb_info(sort.wth);
+    sort.nrb_hdrs = wtap_file_get_nrb_for_new_file(sort.wth);
+    if (single_run) {
+        sort.run_pdh = pdh;
+    } else {
+        run_open(&sort);
+    }
+
+    batch = wtap_batch_new(REORDERCAP_BATCH_SIZE);
+    while (wtap_read_batch(sort.wth, batch, &err, &err_info) != 0) {
+        for (rec = 0; rec < batch->count; rec++) {
+            HeldFrame_t *frame = held_frame_new(&batch->phdrs[rec],
+                                                wtap_batch_data(batch, rec), ++num);
+
+            /* A frame that belongs before one already written has to
+               wait for the next run */
+            frame->rec.run = sort.run;
+            if (sort.window.last_out != NULL &&
+                frame_earlier(&frame->rec, sort.window.last_out)) {
+                frame->rec.run++;
+            }
+            frame_heap_push(&sort.window, &frame->rec);
+            if (sort.window.count > max_held) {
+                window_write(&sort);
+            }
+        }
+    }
+    wtap_batch_free(batch);
+    if (err != 0) {
+        /* As in the first pass, report it and write what could be read */
+        fprintf(stderr,
+                "reordercap: An error occurred while reading \"%s\": %s.\n",
+                infile, wtap_strerror(err));
+        if (err_info != NULL) {
+            fprintf(stderr, "(%s)\n", err_info);
+            g_free(err_info);
+        }
+    }
+    while (sort.window.count > 0) {
+        window_write(&sort);
+    }
+    if (sort.window.last_out != NULL) {
+        held_frame_free((HeldFrame_t *)sort.window.last_out);
+    }
+    g_free(sort.window.frames);
+
+    if (!single_run) {
+        guint first = 0;
+        guint nruns;
+        gpointer merged;
+
+        run_close(&sort);
+
+        /* If there are too many runs to merge at once, merge them a
+           group at a time into longer ones first, going back to the
+           start when every run has been through a merge.  Ties go to
+           the earlier run, so the longer run takes the place of the
+           first one it was merged from. */
+        while (sort.run_files->len > REORDERCAP_MAX_MERGED_RUNS) {
+            if (sort.run_files->len - first < 2) {
+                first = 0;
+            }
+            nruns = MIN(sort.run_files->len - first,
+                        MIN(REORDERCAP_MAX_MERGED_RUNS,
+                            sort.run_files->len - REORDERCAP_MAX_MERGED_RUNS + 1));
+            run_open(&sort);
+            sort.run = sort.run_files->len - 1;
+            runs_merge(&sort, first, nruns, sort.run_pdh);
+            run_close(&sort);
+
+            merged = g_ptr_array_index(sort.run_files, sort.run);
+            g_ptr_array_index(sort.run_files, sort.run) = NULL;
+            g_ptr_array_remove_index(sort.run_files, sort.run);
+            g_free(g_ptr_array_index(sort.run_files, first));
+            g_ptr_array_index(sort.run_files, first) = merged;
+            g_ptr_array_remove_range(sort.run_files, first + 1, nruns - 1);
+            first++;
+        }
+        runs_merge(&sort, 0, sort.run_files->len, pdh);
+    }
+
+    g_ptr_array_free(sort.run_files, TRUE);
+    wtap_block_array_free(sort.shb_hdrs);
+    wtap_block_array_free(sort.nrb_hdrs);
+    wtap_file_free_idb_info(sort.idb_inf);
+    wtap_close(sort.wth);
+}
+/**************************************************/
+
 #ifdef HAVE_PLUGINS
 /*
  *  Don't report failures to load plugins because most (non-wiretap) plugins
@@ -173,17 +638,22 @@ main(int argc, char *argv[])
     Buffer buf;
     int err;
     gchar *err_info;
-    gint64 data_offset;
+    wtap_batch_t *batch;
+    guint rec;
     const struct wtap_pkthdr *phdr;
+    guint frame_count = 0;
     guint wrong_order_count = 0;
     gboolean write_output_regardless = TRUE;
+    guint max_held = 0;
+    FrameHeap_t window;
+    gboolean single_run = TRUE;
     guint i;
     GArray                      *shb_hdrs = NULL;
     wtapng_iface_descriptions_t *idb_inf = NULL;
     GArray                      *nrb_hdrs = NULL;
 
     GPtrArray *frames;
-    FrameRecord_t *prevFrame = NULL;
+    nstime_t prev_time;
 
     int opt;
     static const struct option long_options[] = {
@@ -240,11 +710,14 @@ main(int argc, char *argv[])
 #endif
 
     /* Process the options first */
-    while ((opt = getopt_long(argc, argv, "hnv", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hm:nv", long_options, NULL)) != -1) {
         switch (opt) {
             case 'n':
                 write_output_regardless = FALSE;
                 break;
+            case 'm':
+                max_held = get_positive_int(optarg, "number of frames held");
+                break;
             case 'h':
                 printf("Reordercap (Wireshark) %s\n"
                        "Reorder timestamps of input file frames into output file.\n"
@@ -274,10 +747,16 @@ main(int argc, char *argv[])
         exit(1);
     }
 
+    /* With -m the input file is read twice */
+    if (max_held != 0 && strcmp(infile, "-") == 0) {
+        fprintf(stderr, "reordercap: -m can't be used when reading from the standard input\n");
+        exit(1);
+    }
+
     /* Open infile */
     /* TODO: if reordercap is ever changed to give the user a choice of which
        open_routine reader to use, then the following needs to change. */
-    wth = wtap_open_offline(infile, WTAP_TYPE_AUTO, &err, &err_info, TRUE);
+    wth = wtap_open_offline(infile, WTAP_TYPE_AUTO, &err, &err_info, max_held == 0);
     if (wth == NULL) {
         fprintf(stderr, "reordercap: Can't open %s: %s\n", infile,
                 wtap_strerror(err));
@@ -302,7 +781,7 @@ main(int argc, char *argv[])
       pdh = wtap_dump_open_ng(outfile, wtap_file_type_subtype(wth), wtap_file_encap(wth),
                               65535, FALSE, shb_hdrs, idb_inf, nrb_hdrs, &err);
     }
-    g_free(idb_inf);
+    wtap_file_free_idb_info(idb_inf);
     idb_inf = NULL;
 
     if (pdh == NULL) {
@@ -313,30 +792,45 @@ main(int argc, char *argv[])
         exit(1);
     }
 
-    /* Allocate the array of frame pointers. */
+    /* Allocate the array of frame pointers; with -m, it stays empty,
+       and only the window is needed. */
     frames = g_ptr_array_new();
+    if (max_held != 0) {
+        frame_heap_init(&window, max_held + 1);
+    }
 
-    /* Read each frame from infile */
-    while (wtap_read(wth, &err, &err_info, &data_offset)) {
-        FrameRecord_t *newFrameRecord;
+    /* Read each frame from infile; we only need the record headers */
+    nstime_set_zero(&prev_time);
+    batch = wtap_batch_new(REORDERCAP_BATCH_SIZE);
+    while (wtap_read_batch(wth, batch, &err, &err_info) != 0) {
+        for (rec = 0; rec < batch->count; rec++) {
+            FrameRecord_t *newFrameRecord;
 
-        phdr = wtap_phdr(wth);
+            phdr = &batch->phdrs[rec];
 
-        newFrameRecord = g_slice_new(FrameRecord_t);
-        newFrameRecord->num = frames->len + 1;
-        newFrameRecord->offset = data_offset;
-        if (phdr->presence_flags & WTAP_HAS_TS) {
-            newFrameRecord->frame_time = phdr->ts;
-        } else {
-            nstime_set_unset(&newFrameRecord->frame_time);
-        }
+            newFrameRecord = g_slice_new(FrameRecord_t);
+            newFrameRecord->num = ++frame_count;
+            newFrameRecord->run = 0;
+            newFrameRecord->offset = batch->data_offsets[rec];
+            frame_set_time(newFrameRecord, phdr);
 
-        if (prevFrame && frames_compare(&newFrameRecord, &prevFrame) < 0) {
-           wrong_order_count++;
+            if (frame_count > 1 && nstime_cmp(&newFrameRecord->frame_time, &prev_time) < 0) {
+               wrong_order_count++;
+            }
+            prev_time = newFrameRecord->frame_time;
+
+            if (max_held == 0) {
+                g_ptr_array_add(frames, newFrameRecord);
+            } else if (single_run) {
+                single_run = window_check(&window, max_held, newFrameRecord);
+            } else {
+                g_slice_free(FrameRecord_t, newFrameRecord);
+            }
         }
-
-        g_ptr_array_add(frames, newFrameRecord);
-        prevFrame = newFrameRecord;
+    }
+    wtap_batch_free(batch);
+    if (max_held != 0) {
+        window_free(&window);
     }
     if (err != 0) {
       /* Print a message noting that the read failed somewhere along the line. */
@@ -349,7 +843,11 @@ main(int argc, char *argv[])
       }
     }
 
-    printf("%u frames, %u out of order\n", frames->len, wrong_order_count);
+    printf("%u frames, %u out of order\n", frame_count, wrong_order_count);
+
+    if (max_held != 0 && (write_output_regardless || (wrong_order_count > 0))) {
+        sort_bounded(infile, pdh, max_held, single_run);
+    }
 
     /* Sort the frames */
     if (wrong_order_count > 0) {
@@ -38,6 +38,11 @@
  * the files at switch and not the capture stop, and by closing them which
  * makes possible their move or deletion after a switch).
  *
+ * Closing the previous file and removing the file that the next one
+ * replaces can take a long time for large files, so, at a switch, both
+ * are handed to a separate thread, and the capture carries on writing
+ * to the next file meanwhile.
+ *
  */
 
 #include <config.h>
@@ -62,6 +67,14 @@ typedef struct _rb_file {
   gchar         *name;
 } rb_file;
 
+/* A file to be closed and/or removed by the closer thread; one with
+   neither tells the thread to stop */
+typedef struct _rb_retired_file {
+  FILE          *pdh;                /* file to close, or NULL */
+  char          *buf;                /* its stdio buffer, to free once it's closed, or NULL */
+  gchar         *name;               /* name of the file to remove, or NULL */
+} rb_retired_file;
+
 /* Ringbuffer data structure */
 typedef struct _ringbuf_data {
   rb_file      *files;
@@ -73,12 +86,106 @@ typedef struct _ringbuf_data {
 
   int           fd;                  /* Current ringbuffer file descriptor */
   FILE         *pdh;
+  size_t        buf_size;            /* Size of each file's stdio buffer, or 0 for the default */
+  char         *buf;                 /* The current file's stdio buffer, if buf_size isn't 0 */
   gboolean      group_read_access;   /* TRUE if files need to be opened with group read access */
+
+  GThread      *closer;              /* Thread closing and removing old files, if any */
+  GAsyncQueue  *closer_q;            /* rb_retired_file's for it */
+  volatile gint closer_err;          /* First error seen closing a file, or 0 */
 } ringbuf_data;
 
 static ringbuf_data rb_data;
 
 
+/*
+ * Close and/or remove an old file
+ */
+static void ringbuf_close_retired(rb_retired_file *retired)
+{
+  if (retired->pdh != NULL && fclose(retired->pdh) == EOF) {
+    g_atomic_int_compare_and_exchange(&rb_data.closer_err, 0, errno != 0 ? errno : EIO);
+  }
+  /* the file might have been writing out of its buffer until it was closed */
+  g_free(retired->buf);
+  if (retired->name != NULL) {
+    /* remove old file (if any, so ignore error) */
+    ws_unlink(retired->name);
+    g_free(retired->name);
+  }
+  g_free(retired);
+}
+
+static gpointer ringbuf_closer(gpointer data _U_)
+{
+  rb_retired_file *retired;
+
+  for (;;) {
+    retired = (rb_retired_file *)g_async_queue_pop(rb_data.closer_q);
+    if (retired->pdh == NULL && retired->name == NULL) {
+      g_free(retired);
+      break;
+    }
+    ringbuf_close_retired(retired);
+  }
+  return NULL;
+}
+
+/*
+ * Have the closer thread close the file, and free its buffer, and/or
+ * remove the file with the given name, which it frees; do it now if
+ * there's no closer thread.
+ * Files are closed and removed in the order they're passed to this, so
+ * a file is closed before it's removed.
+ */
+static void ringbuf_retire(FILE *pdh, char *buf, gchar *name)
+{
+  rb_retired_file *retired;
+
+  retired = (rb_retired_file *)g_malloc(sizeof(rb_retired_file));
+  retired->pdh = pdh;
+  retired->buf = buf;
+  retired->name = name;
+  if (rb_data.closer != NULL) {
+    g_async_queue_push(rb_data.closer_q, retired);
+  } else {
+    ringbuf_close_retired(retired);
+  }
+}
+
+static void ringbuf_start_closer(void)
+{
+  rb_data.closer_err = 0;
+  rb_data.closer_q = g_async_queue_new();
+#if GLIB_CHECK_VERSION(2,31,0)
+  rb_data.closer = g_thread_new("Ringbuffer closer", ringbuf_closer, NULL);
+#else
+  rb_data.closer = g_thread_create(ringbuf_closer, NULL, TRUE, NULL);
+#endif
+  if (rb_data.closer == NULL) {
+    /* do the work ourselves */
+    g_async_queue_unref(rb_data.closer_q);
+    rb_data.closer_q = NULL;
+  }
+}
+
+/*
+ * Wait for the closer thread to finish with the files it's been given.
+ * Returns the first error seen closing a file, or 0.
+ */
+static int ringbuf_stop_closer(void)
+{
+  if (rb_data.closer != NULL) {
+    ringbuf_retire(NULL, NULL, NULL);
+    g_thread_join(rb_data.closer);
+    rb_data.closer = NULL;
+    g_async_queue_unref(rb_data.closer_q);
+    rb_data.closer_q = NULL;
+  }
+  return g_atomic_int_get(&rb_data.closer_err);
+}
+
+
 /*
  * create the next filename and open a new binary file with that name
  */
@@ -90,10 +197,12 @@ static int ringbuf_open_file(rb_file *rfile, int *err)
 
   if (rfile->name != NULL) {
     if (rb_data.unlimited == FALSE) {
-      /* remove old file (if any, so ignore error) */
-      ws_unlink(rfile->name);
+      /* remove old file, in the background */
+      ringbuf_retire(NULL, NULL, rfile->name);
+    } else {
+      g_free(rfile->name);
     }
-    g_free(rfile->name);
+    rfile->name = NULL;
   }
 
 #ifdef _WIN32
@@ -139,7 +248,12 @@ ringbuf_init(const char *capfile_name, guint num_files, gboolean group_read_acce
   rb_data.unlimited = FALSE;
   rb_data.fd = -1;
   rb_data.pdh = NULL;
+  rb_data.buf_size = 0;
+  rb_data.buf = NULL;
   rb_data.group_read_access = group_read_access;
+  rb_data.closer = NULL;
+  rb_data.closer_q = NULL;
+  rb_data.closer_err = 0;
 
   /* just to be sure ... */
   if (num_files <= RINGBUFFER_MAX_NUM_FILES) {
@@ -206,6 +320,8 @@ ringbuf_init(const char *capfile_name, guint num_files, gboolean group_read_acce
     return -1;
   }
 
+  ringbuf_start_closer();
+
   return rb_data.fd;
 }
 
@@ -215,6 +331,26 @@ const gchar *ringbuf_current_filename(void)
   return rb_data.files[rb_data.curr_file_num % rb_data.num_files].name;
 }
 
+/*
+ * Write each file through a stdio buffer of the given size, rather than
+ * the default one; call before ringbuf_init_libpcap_fdopen().  Each file
+ * gets a buffer of its own, as a file being closed in the background
+ * may still be writing out of its buffer while the next one is in use.
+ */
+void
+ringbuf_set_buffer_size(size_t size)
+{
+  rb_data.buf_size = size;
+}
+
+/* Free the current file's buffer, once the file has been closed */
+static void
+ringbuf_free_buffer(void)
+{
+  g_free(rb_data.buf);
+  rb_data.buf = NULL;
+}
+
 /*
  * Calls ws_fdopen() for the current ringbuffer file
  */
@@ -226,6 +362,11 @@ ringbuf_init_libpcap_fdopen(int *err)
     if (err != NULL) {
       *err = errno;
     }
+    return NULL;
+  }
+  if (rb_data.buf_size != 0) {
+    rb_data.buf = (char *)g_malloc(rb_data.buf_size);
+    setvbuf(rb_data.pdh, rb_data.buf, _IOFBF, rb_data.buf_size);
   }
   return rb_data.pdh;
 }
@@ -238,22 +379,36 @@ ringbuf_switch_file(FILE **pdh, gchar **save_file, int *save_file_fd, int *err)
 {
   int     next_file_index;
   rb_file *next_rfile = NULL;
+  int     close_err;
 
-  /* close current file */
+  /* write out what's buffered, so that whoever reads the current file
+     sees all of it once we've switched, and close it in the background */
 
-  if (fclose(rb_data.pdh) == EOF) {
+  if (fflush(rb_data.pdh) == EOF) {
     if (err != NULL) {
       *err = errno;
     }
-    ws_close(rb_data.fd);  /* XXX - the above should have closed this already */
-    rb_data.pdh = NULL;    /* it's still closed, we just got an error while closing */
+    fclose(rb_data.pdh);
+    ringbuf_free_buffer();
+    rb_data.pdh = NULL;    /* it's closed, we just got an error writing it out */
     rb_data.fd = -1;
     return FALSE;
   }
 
+  ringbuf_retire(rb_data.pdh, rb_data.buf, NULL);
   rb_data.pdh = NULL;
+  rb_data.buf = NULL;
   rb_data.fd  = -1;
 
+  /* did closing an earlier file fail? */
+  close_err = g_atomic_int_get(&rb_data.closer_err);
+  if (close_err != 0) {
+    if (err != NULL) {
+      *err = close_err;
+    }
+    return FALSE;
+  }
+
   /* get the next file number and open it */
 
   rb_data.curr_file_num++ /* = next_file_num*/;
@@ -283,6 +438,7 @@ gboolean
 ringbuf_libpcap_dump_close(gchar **save_file, int *err)
 {
   gboolean  ret_val = TRUE;
+  int       close_err;
 
   /* close current file, if it's open */
   if (rb_data.pdh != NULL) {
@@ -293,10 +449,20 @@ ringbuf_libpcap_dump_close(gchar **save_file, int *err)
       ws_close(rb_data.fd);
       ret_val = FALSE;
     }
+    ringbuf_free_buffer();
     rb_data.pdh = NULL;
     rb_data.fd  = -1;
   }
 
+  /* wait for the previous files to be closed */
+  close_err = ringbuf_stop_closer();
+  if (close_err != 0 && ret_val) {
+    if (err != NULL) {
+      *err = close_err;
+    }
+    ret_val = FALSE;
+  }
+
   /* set the save file name to the current file */
   *save_file = rb_data.files[rb_data.curr_file_num % rb_data.num_files].name;
   return ret_val;
@@ -338,11 +504,15 @@ ringbuf_error_cleanup(void)
 {
   unsigned int i;
 
+  /* let the previous files be closed before removing them */
+  ringbuf_stop_closer();
+
   /* try to close via wtap */
   if (rb_data.pdh != NULL) {
     if (fclose(rb_data.pdh) == 0) {
       rb_data.fd = -1;
     }
+    ringbuf_free_buffer();
     rb_data.pdh = NULL;
   }
 
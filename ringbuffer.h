@@ -37,6 +37,7 @@
 
 int ringbuf_init(const char *capture_name, guint num_files, gboolean group_read_access);
 const gchar *ringbuf_current_filename(void);
+void ringbuf_set_buffer_size(size_t size);
 FILE *ringbuf_init_libpcap_fdopen(int *err);
 gboolean ringbuf_switch_file(FILE **pdh, gchar **save_file, int *save_file_fd,
                              int *err);
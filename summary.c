@@ -201,7 +201,7 @@ summary_fill_in(capture_file *cf, summary_tally *st)
     }
     g_array_append_val(st->ifaces, iface);
   }
-  g_free(idb_info);
+  wtap_file_free_idb_info(idb_info);
 }
 
 #ifdef HAVE_LIBPCAP
@@ -73,6 +73,12 @@ unittests_step_exntest() {
 	unittests_step_test
 }
 
+unittests_step_field_cache_test() {
+	check_dut field_cache_test
+	ARGS=
+	unittests_step_test
+}
+
 unittests_step_oids_test() {
 	check_dut oids_test
 	ARGS=
@@ -117,6 +123,7 @@ unittests_suite() {
 	test_step_set_pre unittests_cleanup_step
 	test_step_set_post unittests_cleanup_step
 	test_step_add "exntest" unittests_step_exntest
+	test_step_add "field_cache_test" unittests_step_field_cache_test
 	test_step_add "oids_test" unittests_step_oids_test
 	test_step_add "reassemble_test" unittests_step_reassemble_test
 	test_step_add "tvbtest" unittests_step_tvbtest
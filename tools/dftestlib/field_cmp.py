@@ -0,0 +1,165 @@
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+from dftestlib import dftest
+
+class testFieldCmp(dftest.DFTest):
+    """Tests of a field against a constant, which are compiled to the
+    typed FIELD_CMP_xxx instructions."""
+
+    trace_file = "ntp.pcap"
+
+    def test_uint_eq_1(self):
+        dfilter = "ip.ttl == 30"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_uint_eq_2(self):
+        dfilter = "ip.ttl == 31"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_uint_ne_1(self):
+        dfilter = "ip.ttl != 30"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_uint_gt_1(self):
+        dfilter = "ip.ttl > 29"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_uint_gt_2(self):
+        dfilter = "ip.ttl > 30"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_uint_ge_1(self):
+        dfilter = "ip.ttl >= 30"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_uint_lt_1(self):
+        dfilter = "ip.ttl < 31"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_uint_le_1(self):
+        dfilter = "ip.ttl <= 29"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_bitmask_1(self):
+        # The version is the top 4 bits of its byte
+        dfilter = "ip.version == 4"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_bitmask_2(self):
+        dfilter = "ntp.flags.vn == 3"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_bitmask_3(self):
+        dfilter = "ntp.flags.vn == 4"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_bitmask_4(self):
+        dfilter = "ntp.flags.mode == 3"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_bitmask_5(self):
+        dfilter = "ntp.flags.mode > 3"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_bitmask_6(self):
+        dfilter = "ntp.flags.li == 0"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_sint_eq_1(self):
+        dfilter = "ntp.precision == -11"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_sint_ne_1(self):
+        dfilter = "ntp.precision != -11"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_sint_lt_1(self):
+        # Would be false if compared as unsigned
+        dfilter = "ntp.precision < 0"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_sint_gt_1(self):
+        dfilter = "ntp.precision > -12"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_sint_gt_2(self):
+        dfilter = "ntp.precision > -11"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_sint_ge_1(self):
+        dfilter = "ntp.precision >= -11"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_sint_le_1(self):
+        dfilter = "ntp.precision <= -12"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_ipv4_eq_1(self):
+        dfilter = "ip.src == 130.220.24.62"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_ipv4_eq_2(self):
+        dfilter = "ip.dst == 130.220.24.62"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_ipv4_eq_3(self):
+        dfilter = "ip.addr == 130.220.24.24"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_ipv4_netmask_1(self):
+        dfilter = "ip.src == 130.220.24.0/24"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_ipv4_netmask_2(self):
+        dfilter = "ip.src == 130.220.25.0/24"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_slice_1(self):
+        dfilter = "eth.src[0:3] == 08:00:2b"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_slice_2(self):
+        dfilter = "eth.dst[3:3] == 91:e8:3a"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_slice_3(self):
+        dfilter = "eth.dst[3:3] == 91:e8:3b"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_absent_1(self):
+        # There's no TCP in the trace
+        dfilter = "tcp.port == 123"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_absent_2(self):
+        dfilter = "tcp.port != 123"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_absent_3(self):
+        dfilter = "tcp.srcport > 0"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_absent_4(self):
+        dfilter = "!(tcp.port == 123)"
+        self.assertDFilterCount(dfilter, 1)
+
+    def test_absent_5(self):
+        dfilter = "ip.ttl == 30 && tcp.port == 123"
+        self.assertDFilterCount(dfilter, 0)
+
+    def test_absent_6(self):
+        dfilter = "tcp.port == 123 || ntp.precision == -11"
+        self.assertDFilterCount(dfilter, 1)
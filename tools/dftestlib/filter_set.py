@@ -0,0 +1,75 @@
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+from dftestlib import dftest
+from dftestlib import util
+
+class testFilterSet(dftest.DFTest):
+    """Tests of filters that are run together as a set, sharing field
+    loads and tests.  The filters are given to the io,stat tap, which
+    registers a tap listener for each of them, and the tap listeners'
+    filters are run as a set."""
+
+    trace_file = "ntp.pcap"
+
+    def runFilterSet(self, dfilters):
+        """Run the filters as io,stat columns over the whole trace, and
+        return the number of frames that passed each of them."""
+        cmdv = [dftest.TSHARK,
+                "-n",       # No name resolution
+                "-q",       # Only print the statistics
+                "-r",       # Next arg is trace file to read
+                self.trace_file,
+                "-z",
+                "io,stat,0," + ",".join(["FRAMES()" + f for f in dfilters])]
+
+        (status, output) = util.exec_cmdv(cmdv)
+
+        # tshark must succeed
+        self.assertEqual(status, util.SUCCESS, output)
+
+        # With an interval of 0, there's one row of values, for the
+        # whole trace: "| 0 <> Dur| n1 | n2 | ... |"
+        rows = [L for L in output.split("\n") if "<>" in L]
+        self.assertEqual(len(rows), 1, output)
+        cells = [c.strip() for c in rows[0].split("|") if c.strip() != ""]
+        return [int(c) for c in cells[1:]]
+
+    def assertFilterSetCounts(self, dfilters, expected_counts):
+        counts = self.runFilterSet(dfilters)
+        self.assertEqual(counts, expected_counts)
+
+    def test_shared_load_1(self):
+        # All of these load ip.ttl; each must still get its own result
+        dfilters = ["ip.ttl == 30",
+                    "ip.ttl != 30",
+                    "ip.ttl > 29 && udp",
+                    "ip.ttl < 30"]
+        self.assertFilterSetCounts(dfilters, [1, 0, 1, 0])
+
+    def test_shared_test_1(self):
+        # The same test in several filters, negated in one of them
+        dfilters = ["ntp.precision < 0",
+                    "!(ntp.precision < 0)",
+                    "ntp.precision < 0 && tcp",
+                    "tcp || ntp.precision < 0"]
+        self.assertFilterSetCounts(dfilters, [1, 0, 0, 1])
+
+    def test_shared_absent_1(self):
+        # A field that isn't in the trace, in several filters
+        dfilters = ["tcp.port == 123",
+                    "!tcp.port == 123",
+                    "tcp.port == 123 || ip.version == 4"]
+        self.assertFilterSetCounts(dfilters, [0, 1, 1])
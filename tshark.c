@@ -399,6 +399,9 @@ print_usage(FILE *output)
   fprintf(output, "  --capture-comment <comment>\n");
   fprintf(output, "                           add a capture comment to the newly created\n");
   fprintf(output, "                           output file (only for pcapng)\n");
+  fprintf(output, "  --update-interval <interval>\n");
+  fprintf(output, "                           time in milliseconds between reports of new\n");
+  fprintf(output, "                           captured packets (def: %dms)\n", DEFAULT_UPDATE_INTERVAL);
 
   fprintf(output, "\n");
   fprintf(output, "Miscellaneous:\n");
@@ -1000,6 +1003,7 @@ main(int argc, char *argv[])
     case 'w':        /* Write to capture file x */
     case 'y':        /* Set the pcap data link type */
     case  LONGOPT_NUM_CAP_COMMENT: /* add a capture comment */
+    case  LONGOPT_NUM_UPDATE_INTERVAL: /* how often dumpcap reports packets */
 #ifdef CAN_SET_CAPTURE_BUFFER_SIZE
     case 'B':        /* Buffer size */
 #endif
@@ -2925,7 +2929,7 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
         }
     }
 
-    g_free(idb_inf);
+    wtap_file_free_idb_info(idb_inf);
     idb_inf = NULL;
 
     if (pdh == NULL) {
@@ -2967,7 +2971,7 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
         goto out;
       }
     }
-    g_free(idb_inf);
+    wtap_file_free_idb_info(idb_inf);
     idb_inf = NULL;
     pdh = NULL;
   }
@@ -2978,6 +2982,9 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
   /* Get the union of the flags for all tap listeners. */
   tap_flags = union_of_tap_listener_flags();
 
+  /* Have the next records read while we're processing the current one. */
+  wtap_set_read_ahead(cf->wth, WTAP_READ_AHEAD_DEFAULT_DEPTH);
+
   if (perform_two_pass_analysis) {
     frame_data *fdata;
 
@@ -3001,20 +3008,41 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
       edt = epan_dissect_new(cf->epan, create_proto_tree, FALSE);
     }
 
-    tshark_debug("tshark: reading records for first pass");
-    while (wtap_read(cf->wth, &err, &err_info, &data_offset)) {
-      if (process_packet_first_pass(cf, edt, data_offset, wtap_phdr(cf->wth),
-                         wtap_buf_ptr(cf->wth))) {
-        /* Stop reading if we have the maximum number of packets;
-         * When the -c option has not been used, max_packet_count
-         * starts at 0, which practically means, never stop reading.
-         * (unless we roll over max_packet_count ?)
-         */
-        if ( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
-          tshark_debug("tshark: max_packet_count (%d) or max_byte_count (%" G_GINT64_MODIFIER "d/%" G_GINT64_MODIFIER "d) reached",
-                        max_packet_count, data_offset, max_byte_count);
-          err = 0; /* This is not an error */
-          break;
+    if (edt == NULL && wtap_packet_index_count(cf->wth) != 0) {
+      struct wtap_pkthdr idx_phdr;
+
+      /* We aren't dissecting on the first pass, so all we need for
+         each record is in the file's packet index; use that rather
+         than reading the file. */
+      tshark_debug("tshark: reading packet index for first pass");
+      wtap_phdr_init(&idx_phdr);
+      while (wtap_packet_index_next(cf->wth, &idx_phdr, &data_offset, &err, &err_info)) {
+        if (process_packet_first_pass(cf, NULL, data_offset, &idx_phdr, NULL)) {
+          if ( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
+            tshark_debug("tshark: max_packet_count (%d) or max_byte_count (%" G_GINT64_MODIFIER "d/%" G_GINT64_MODIFIER "d) reached",
+                          max_packet_count, data_offset, max_byte_count);
+            err = 0; /* This is not an error */
+            break;
+          }
+        }
+      }
+      wtap_phdr_cleanup(&idx_phdr);
+    } else {
+      tshark_debug("tshark: reading records for first pass");
+      while (wtap_read(cf->wth, &err, &err_info, &data_offset)) {
+        if (process_packet_first_pass(cf, edt, data_offset, wtap_phdr(cf->wth),
+                           wtap_buf_ptr(cf->wth))) {
+          /* Stop reading if we have the maximum number of packets;
+           * When the -c option has not been used, max_packet_count
+           * starts at 0, which practically means, never stop reading.
+           * (unless we roll over max_packet_count ?)
+           */
+          if ( (--max_packet_count == 0) || (max_byte_count != 0 && data_offset >= max_byte_count)) {
+            tshark_debug("tshark: max_packet_count (%d) or max_byte_count (%" G_GINT64_MODIFIER "d/%" G_GINT64_MODIFIER "d) reached",
+                          max_packet_count, data_offset, max_byte_count);
+            err = 0; /* This is not an error */
+            break;
+          }
         }
       }
     }
@@ -3179,6 +3207,13 @@ load_cap_file(capture_file *cf, char *save_file, int out_file_type,
          ("print_packet_info" is true) and we're in verbose mode
          ("packet_details" is true). */
       edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details);
+
+      /* If we're only dissecting to run the display filter, e.g. to
+         write the packets that pass it, the dissectors of protocols
+         that can't affect whether a packet passes needn't be run. */
+      if (cf->dfcode && !print_packet_info && !tap_listeners_require_dissection() &&
+          !have_custom_cols(&cf->cinfo))
+        epan_dissect_skip_unneeded_protocols(edt, cf->dfcode);
     }
 
     while (wtap_read(cf->wth, &err, &err_info, &data_offset)) {
@@ -110,6 +110,9 @@ commandline_print_usage(gboolean for_help_option) {
     fprintf(output, "  -B <buffer size>         size of kernel buffer (def: %dMB)\n", DEFAULT_CAPTURE_BUFFER_SIZE);
 #endif
     fprintf(output, "  -y <link type>           link layer type (def: first appropriate)\n");
+    fprintf(output, "  --update-interval <interval>\n");
+    fprintf(output, "                           time in milliseconds between reports of new\n");
+    fprintf(output, "                           captured packets (def: %dms)\n", DEFAULT_UPDATE_INTERVAL);
     fprintf(output, "  -D                       print list of interfaces and exit\n");
     fprintf(output, "  -L                       print list of link-layer types of iface and exit\n");
     fprintf(output, "\n");
@@ -418,6 +421,7 @@ void commandline_other_options(int argc, char *argv[], gboolean opt_reset)
             case 'S':        /* "Sync" mode: used for following file ala tail -f */
             case 'w':        /* Write to capture file xxx */
             case 'y':        /* Set the pcap data link type */
+            case LONGOPT_NUM_UPDATE_INTERVAL: /* how often dumpcap reports packets */
 #ifdef CAN_SET_CAPTURE_BUFFER_SIZE
             case 'B':        /* Buffer size */
 #endif
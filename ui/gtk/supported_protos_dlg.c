@@ -248,6 +248,9 @@ static void set_supported_text(GtkWidget *w, supported_type_t type)
 
     /* XXX we should display hinfo->blurb instead of name (if not empty) */
 
+    /* include the fields that are only registered when first used */
+    proto_initialize_all_prefixes();
+
     /* first pass to know the maximum length of first and second fields */
     for (i = proto_get_first_protocol(&cookie); i != -1;
          i = proto_get_next_protocol(&cookie)) {
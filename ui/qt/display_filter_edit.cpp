@@ -443,6 +443,9 @@ void DisplayFilterEdit::buildCompletionList(const QString &field_word)
     completion_model_->setStringList(complex_list);
     completer()->setCompletionPrefix(field_word);
 
+    // Fields registered on first use (e.g. X11's) aren't listed until then.
+    proto_initialize_all_prefixes();
+
     void *proto_cookie;
     QStringList field_list;
     int field_dots = field_word.count('.'); // Some protocol names (_ws.expert) contain periods.
@@ -162,6 +162,8 @@ void FieldFilterEdit::buildCompletionList(const QString &field_word)
         return;
     }
 
+    proto_initialize_all_prefixes();
+
     void *proto_cookie;
     QStringList field_list;
     int field_dots = field_word.count('.'); // Some protocol names (_ws.expert) contain periods.
@@ -86,6 +86,8 @@ void SupportedProtocolsDialog::fillTree()
     void *proto_cookie;
     QList <QTreeWidgetItem *> proto_list;
 
+    proto_initialize_all_prefixes();
+
     for (int proto_id = proto_get_first_protocol(&proto_cookie); proto_id != -1;
          proto_id = proto_get_next_protocol(&proto_cookie)) {
         protocol_t *protocol = find_protocol_by_id(proto_id);
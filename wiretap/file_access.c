@@ -849,6 +849,19 @@ wtap_open_offline(const char *filename, unsigned int type, int *err, char **err_
 
 		file_set_random_access(wth->fh, FALSE, wth->fast_seek);
 		file_set_random_access(wth->random_fh, TRUE, wth->fast_seek);
+
+#ifdef HAVE_ZLIB
+		/*
+		 * If asked to, keep the fast seek points for compressed
+		 * files in an index alongside the file, so that we don't
+		 * have to decompress the whole file again before we can
+		 * seek quickly the next time it's opened.
+		 */
+		if (g_getenv("WIRESHARK_FAST_SEEK_INDEX") != NULL) {
+			wth->fast_seek_index = g_strdup_printf("%s.fsidx", filename);
+			file_read_fast_seek_index(wth->fh, wth->fast_seek_index);
+		}
+#endif
 	}
 
 	/* 'type' is 1 greater than the array index */
@@ -1100,6 +1113,14 @@ success:
 	wth->frame_buffer = (struct Buffer *)g_malloc(sizeof(struct Buffer));
 	ws_buffer_init(wth->frame_buffer, 1500);
 
+	/*
+	 * If asked to, use an index of the records in the file, so that
+	 * the first pass over a file opened for random access can be
+	 * done without reading it.
+	 */
+	if (wth->random_fh && g_getenv("WIRESHARK_PACKET_INDEX") != NULL)
+		wtap_open_packet_index(wth, filename);
+
 	if ((wth->file_type_subtype == WTAP_FILE_TYPE_SUBTYPE_PCAP) ||
 		(wth->file_type_subtype == WTAP_FILE_TYPE_SUBTYPE_PCAP_NSEC)) {
 
@@ -2103,7 +2124,7 @@ wtap_dump_can_open(int file_type_subtype)
 	return TRUE;
 }
 
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 gboolean
 wtap_dump_can_compress(int file_type_subtype)
 {
@@ -2524,7 +2545,7 @@ wtap_dump(wtap_dumper *wdh, const struct wtap_pkthdr *phdr,
 void
 wtap_dump_flush(wtap_dumper *wdh)
 {
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 	if(wdh->compressed) {
 		gzwfile_flush((GZWFILE_T)wdh->fh);
 	} else
@@ -2584,7 +2605,7 @@ wtap_dump_set_addrinfo_list(wtap_dumper *wdh, addrinfo_lists_t *addrinfo_lists)
 }
 
 /* internally open a file for writing (compressed or not) */
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 static WFILE_T
 wtap_dump_file_open(wtap_dumper *wdh, const char *filename)
 {
@@ -2603,7 +2624,7 @@ wtap_dump_file_open(wtap_dumper *wdh _U_, const char *filename)
 #endif
 
 /* internally open a file for writing (compressed or not) */
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 static WFILE_T
 wtap_dump_file_fdopen(wtap_dumper *wdh, int fd)
 {
@@ -2627,7 +2648,7 @@ wtap_dump_file_write(wtap_dumper *wdh, const void *buf, size_t bufsize, int *err
 {
 	size_t nwritten;
 
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 	if (wdh->compressed) {
 		nwritten = gzwfile_write((GZWFILE_T)wdh->fh, buf, (unsigned int) bufsize);
 		/*
@@ -2661,7 +2682,7 @@ wtap_dump_file_write(wtap_dumper *wdh, const void *buf, size_t bufsize, int *err
 static int
 wtap_dump_file_close(wtap_dumper *wdh)
 {
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 	if(wdh->compressed) {
 		/*
 		 * Tell gzwfile_close() whether to close the descriptor
@@ -2685,7 +2706,7 @@ wtap_dump_file_close(wtap_dumper *wdh)
 gint64
 wtap_dump_file_seek(wtap_dumper *wdh, gint64 offset, int whence, int *err)
 {
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 	if(wdh->compressed) {
 		*err = WTAP_ERR_CANT_SEEK_COMPRESSED;
 		return -1;
@@ -2706,7 +2727,7 @@ gint64
 wtap_dump_file_tell(wtap_dumper *wdh, int *err)
 {
 	gint64 rval;
-#ifdef HAVE_ZLIB
+#ifdef CAN_WRITE_COMPRESSED
 	if(wdh->compressed) {
 		*err = WTAP_ERR_CANT_SEEK_COMPRESSED;
 		return -1;
@@ -47,14 +47,58 @@
 #include "file_wrappers.h"
 #include <wsutil/file_util.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#endif
+
 #ifdef HAVE_ZLIB
 #define ZLIB_CONST
 #include <zlib.h>
 #endif /* HAVE_ZLIB */
 
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ * Files written by wtap_dump with compression turned on are written
+ * as a sequence of independent gzip members of at most 64 KiB each,
+ * in the BGZF format used by bgzip and samtools.  Such files are
+ * still valid gzip files, but, as the size of each member is given
+ * in its header, they can be read ahead and the members inflated in
+ * parallel on worker threads; we do that for streams that aren't
+ * being used for random access.
+ */
+#if defined(HAVE_ZLIB) && GLIB_CHECK_VERSION(2,32,0)
+#define USE_BGZF_THREADS
+#endif
+
+/*
+ * LZ4 frame (https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md)
+ * and Zstandard (RFC 8478) streams are sequences of independent frames,
+ * each starting with a 4-byte magic number.  We put a fast seek point
+ * at the start of each frame; files written by wtap_dump are broken
+ * up into frames of at most FRAME_MAX_INPUT bytes of uncompressed data,
+ * so that there are plenty of them.
+ */
+#if defined(HAVE_LZ4) || defined(HAVE_ZSTD)
+#define USE_FRAMED_COMPRESSION
+#define FRAME_MAX_INPUT     (1024 * 1024)
+#endif
+
 /*
  * See RFC 1952 for a description of the gzip file format.
  *
+ * We also support LZ4 frame and Zstandard files, if built with
+ * liblz4 and libzstd respectively.
+ *
  * Some other compressed file formats we might want to support:
  *
  *      XZ format: http://tukaani.org/xz/
@@ -71,6 +115,12 @@
 const char *compressed_file_extension_table[] = {
 #ifdef HAVE_ZLIB
     "gz",
+#endif
+#ifdef HAVE_LZ4
+    "lz4",
+#endif
+#ifdef HAVE_ZSTD
+    "zst",
 #endif
     NULL
 };
@@ -78,16 +128,62 @@ const char *compressed_file_extension_table[] = {
 /* #define GZBUFSIZE 8192 */
 #define GZBUFSIZE 4096
 
+#ifdef HAVE_MMAP
+/*
+ * Amount of a memory-mapped file we hand out as "output buffer" at a
+ * time; keeping this bounded keeps file_tell_raw(), and thus progress
+ * reporting, meaningful.
+ */
+#define MAPWINSIZE (1024 * 1024)
+#endif
+
 /* values for wtap_reader compression */
 typedef enum {
     UNKNOWN,       /* unknown - look for a gzip header */
     UNCOMPRESSED,  /* uncompressed - copy input directly */
 #ifdef HAVE_ZLIB
     ZLIB,          /* decompress a zlib stream */
-    GZIP_AFTER_HEADER
+    GZIP_AFTER_HEADER,
+#endif
+#ifdef HAVE_LZ4
+    LZ4,           /* decompress an LZ4 frame */
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD,          /* decompress a Zstandard frame */
+#endif
+#ifdef USE_BGZF_THREADS
+    BGZF           /* decompress BGZF blocks on worker threads */
 #endif
 } compression_t;
 
+#ifdef HAVE_ZLIB
+/*
+ * BGZF blocks: a gzip member with FEXTRA set and a "BC" subfield
+ * giving the total size of the member, minus 1.
+ */
+#define BGZF_HDR_LEN        18          /* size of the gzip header */
+#define BGZF_TRAILER_LEN    8           /* CRC-32 and ISIZE */
+#define BGZF_MAX_BLOCK      65536       /* maximum size of a member */
+#define BGZF_MAX_INPUT      0xff00      /* maximum data we put in a member */
+
+#ifdef USE_BGZF_THREADS
+#define BGZF_MAX_THREADS    16
+
+/* a BGZF block being inflated by a worker thread */
+struct bgzf_block {
+    unsigned char *cdata;      /* the entire gzip member */
+    guint clen;                /* length of the member */
+    unsigned char *udata;      /* uncompressed data */
+    guint ulen;                /* length of uncompressed data, from ISIZE */
+    gint64 in;                 /* offset in the file of the deflate data */
+    gint64 out;                /* corresponding offset in uncompressed data */
+    gboolean done;             /* TRUE once a worker has finished with it */
+    int err;                   /* error code */
+    const char *err_info;      /* additional error information string */
+};
+#endif
+#endif
+
 struct wtap_reader {
     int fd;                    /* file descriptor */
     gint64 raw_pos;            /* current position in file (just to not call lseek()) */
@@ -102,6 +198,7 @@ struct wtap_reader {
     gint64 start;              /* where the gzip data started, for rewinding */
     gint64 raw;                /* where the raw data started, for seeking */
     compression_t compression; /* type of compression, if any */
+    guint fast_seek_loaded;    /* number of fast seek points loaded from an index */
     gboolean is_compressed;    /* FALSE if completely uncompressed, TRUE otherwise */
     /* seek request */
     gint64 skip;               /* amount to skip (already rewound if backwards) */
@@ -116,10 +213,35 @@ struct wtap_reader {
     /* zlib inflate stream */
     z_stream strm;             /* stream structure in-place (not a pointer) */
     gboolean dont_check_crc;   /* TRUE if we aren't supposed to check the CRC */
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_decompressionContext_t lz4_dctx; /* LZ4 frame decompressor, or NULL */
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zstd_dstream; /* Zstandard decompressor, or NULL */
 #endif
     /* fast seeking */
     GPtrArray *fast_seek;
     void *fast_seek_cur;
+#ifdef HAVE_MMAP
+    /* memory-mapped uncompressed file */
+    unsigned char *map;        /* start of the mapping, or NULL if not mapped */
+    gint64 map_size;           /* size of the mapping */
+#endif
+#ifdef USE_BGZF_THREADS
+    /* parallel BGZF decompression */
+    gboolean random;           /* TRUE if this stream is used for random access */
+    GThreadPool *bgzf_pool;    /* worker threads, or NULL if not yet started */
+    GMutex bgzf_mutex;         /* protects "done" in the blocks */
+    GCond bgzf_cond;           /* signalled when a block is done */
+    GQueue bgzf_blocks;        /* blocks read ahead, oldest first */
+    guint bgzf_depth;          /* maximum number of blocks to read ahead */
+    struct bgzf_block *bgzf_cur; /* block whose data we're handing out */
+    gint64 bgzf_out;           /* uncompressed offset of the next block read */
+    gboolean bgzf_end;         /* TRUE if the next member isn't a BGZF block */
+    int bgzf_err;              /* error that stopped the read-ahead, or 0 */
+    const char *bgzf_err_info; /* additional error information string */
+#endif
 };
 
 static int     /* gz_load */
@@ -158,6 +280,180 @@ fill_in_buffer(FILE_T state)
     return 0;
 }
 
+#if defined(USE_BGZF_THREADS) || defined(USE_FRAMED_COMPRESSION)
+/*
+ * Make sure there are at least n bytes in the input buffer, if the
+ * file has that many left, moving what's there to the beginning of
+ * the buffer to make room.  Returns -1 on a read error, 0 otherwise;
+ * the caller must check avail_in to see whether it got everything.
+ */
+static int
+gz_peek(FILE_T state, guint n)
+{
+    guint got;
+
+    if (state->avail_in >= n)
+        return 0;
+    if (state->err)
+        return -1;
+    if (state->avail_in != 0)
+        memmove(state->in, state->next_in, state->avail_in);
+    state->next_in = state->in;
+    if (!state->eof) {
+        if (raw_read(state, state->in + state->avail_in,
+                     state->size - state->avail_in, &got) == -1)
+            return -1;
+        state->avail_in += got;
+    }
+    return 0;
+}
+#endif
+
+#ifdef USE_BGZF_THREADS
+/*
+ * Copy n bytes of input to buf, taking what we can from the input
+ * buffer and reading the rest directly.  Returns -1, and sets
+ * state->err, on an error or a short read.
+ */
+static int
+gz_read_raw(FILE_T state, unsigned char *buf, guint n)
+{
+    guint got, more;
+
+    got = state->avail_in > n ? n : state->avail_in;
+    memcpy(buf, state->next_in, got);
+    state->next_in += got;
+    state->avail_in -= got;
+    if (got < n) {
+        if (raw_read(state, buf + got, n - got, &more) == -1)
+            return -1;
+        if (more < n - got) {
+            state->err = WTAP_ERR_SHORT_READ;
+            state->err_info = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+#ifdef HAVE_MMAP
+/*
+ * Try to map an uncompressed regular file into memory, so that data
+ * can be copied straight out of the page cache rather than being
+ * read() into our output buffer and then copied again.
+ *
+ * The file is mapped at its size at the time we map it; anything
+ * appended after that (e.g., a file being written by dumpcap while
+ * we read it) is read with read() as usual.
+ *
+ * Touching a page of the mapping that's no longer backed by the file,
+ * because the file was truncated or because a network file system
+ * couldn't read it, gets us a SIGBUS rather than an error, so we
+ * don't map files on network file systems, and map_check() drops the
+ * mapping if the file shrinks.
+ *
+ * Returns TRUE if the file is mapped.
+ */
+static gboolean
+map_file(FILE_T state)
+{
+    ws_statb64 st;
+#ifdef __linux__
+    struct statfs sfs;
+#endif
+    void *map;
+
+    if (state->map != NULL)
+        return TRUE;
+    if (ws_fstat64(state->fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return FALSE;
+    if (st.st_size <= state->start || (guint64)st.st_size > G_MAXSIZE)
+        return FALSE;
+#ifdef __linux__
+    if (fstatfs(state->fd, &sfs) == -1)
+        return FALSE;
+    switch ((guint32)sfs.f_type) {
+
+    case 0x6969:        /* NFS_SUPER_MAGIC */
+    case 0x517B:        /* SMB_SUPER_MAGIC */
+    case 0xFF534D42:    /* CIFS_MAGIC_NUMBER */
+    case 0xFE534D42:    /* SMB2_MAGIC_NUMBER */
+    case 0x65735546:    /* FUSE_SUPER_MAGIC */
+        return FALSE;
+    }
+#endif
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, state->fd, 0);
+    if (map == MAP_FAILED)
+        return FALSE;
+    state->map = (unsigned char *)map;
+    state->map_size = st.st_size;
+    return TRUE;
+}
+
+/*
+ * Check that the file still covers all of the mapping; if it doesn't,
+ * unmap it, so that we read() the file, and get EOF or an error, from
+ * then on.
+ *
+ * Returns TRUE if the file is still mapped.
+ */
+static gboolean
+map_check(FILE_T state)
+{
+    ws_statb64 st;
+
+    if (ws_fstat64(state->fd, &st) == 0 && st.st_size >= state->map_size)
+        return TRUE;
+    munmap(state->map, (size_t)state->map_size);
+    state->map = NULL;
+    state->map_size = 0;
+    if (ws_lseek64(state->fd, state->raw_pos, SEEK_SET) == -1) {
+        state->err = errno;
+        state->err_info = NULL;
+    }
+    return FALSE;
+}
+
+/*
+ * Make the next part of a memory-mapped file available as output
+ * data, or, if we're past the end of the mapping, read from the
+ * file descriptor.
+ */
+static int
+map_fill_out_buffer(FILE_T state)
+{
+    gint64 left = state->map_size - state->raw_pos;
+
+    if (left > 0) {
+        if (map_check(state)) {
+            state->next = state->map + state->raw_pos;
+            state->have = left > MAPWINSIZE ? MAPWINSIZE : (guint)left;
+            state->raw_pos += state->have;
+            return 0;
+        }
+        if (state->err != 0)
+            return -1;
+    }
+
+    /*
+     * We've handed out everything in the mapping; if we've only just
+     * gotten to the end of it, the descriptor isn't necessarily
+     * positioned there, so put it there.
+     */
+    if (state->raw_pos == state->map_size &&
+        ws_lseek64(state->fd, state->raw_pos, SEEK_SET) == -1) {
+        state->err = errno;
+        state->err_info = NULL;
+        return -1;
+    }
+    if (raw_read(state, state->out, state->size, &(state->have)) == -1)
+        return -1;
+    state->next = state->out;
+    return 0;
+}
+#endif
+
 #define ZLIB_WINSIZE 32768
 
 struct fast_seek_point {
@@ -222,7 +518,12 @@ fast_seek_header(FILE_T file, gint64 in_pos, gint64 out_pos,
         item = (struct fast_seek_point *)file->fast_seek->pdata[file->fast_seek->len - 1];
 
     if (!item || item->out < out_pos) {
-        struct fast_seek_point *val = g_new(struct fast_seek_point,1);
+        /*
+         * Only zlib points need the (large) saved window, and we can
+         * have a great many of these points, so don't allocate space
+         * for it.
+         */
+        struct fast_seek_point *val = (struct fast_seek_point *)g_malloc(offsetof(struct fast_seek_point, data));
         val->in = in_pos;
         val->out = out_pos;
         val->compression = compression;
@@ -560,6 +861,485 @@ DIAG_ON(cast-qual)
 }
 #endif
 
+#ifdef HAVE_ZLIB
+/*
+ * If hdr points to a BGZF member header, return the total size of the
+ * member, otherwise return 0.  We only recognize the header as written
+ * by bgzip and by us, i.e. with no file name or comment and with "BC"
+ * as the only extra subfield.
+ */
+static guint
+bgzf_block_size(const unsigned char *hdr)
+{
+    guint bsize;
+
+    if (hdr[0] != 31 || hdr[1] != 139 || hdr[2] != 8 || hdr[3] != 4)
+        return 0;
+    if (pletoh16(&hdr[10]) != 6 || hdr[12] != 'B' || hdr[13] != 'C' ||
+        pletoh16(&hdr[14]) != 2)
+        return 0;
+    bsize = pletoh16(&hdr[16]) + 1;
+    if (bsize < BGZF_HDR_LEN + BGZF_TRAILER_LEN)
+        return 0;
+    return bsize;
+}
+#endif
+
+#ifdef USE_BGZF_THREADS
+/* inflate a block; called on a worker thread */
+static void
+bgzf_inflate(gpointer data, gpointer user_data)
+{
+    struct bgzf_block *block = (struct bgzf_block *)data;
+    FILE_T state = (FILE_T)user_data;
+    z_stream strm;
+    int ret;
+    int err = 0;
+    const char *err_info = NULL;
+
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in = 0;
+    strm.next_in = Z_NULL;
+    if (inflateInit2(&strm, -15) != Z_OK) {     /* raw inflate */
+        err = ENOMEM;
+    } else {
+        strm.next_in = block->cdata + BGZF_HDR_LEN;
+        strm.avail_in = block->clen - BGZF_HDR_LEN - BGZF_TRAILER_LEN;
+        strm.next_out = block->udata;
+        strm.avail_out = block->ulen;
+        ret = inflate(&strm, Z_FINISH);
+        if (ret == Z_MEM_ERROR) {
+            err = ENOMEM;
+        } else if (ret != Z_STREAM_END) {
+            err = WTAP_ERR_DECOMPRESS;
+            err_info = strm.msg != NULL ? strm.msg : "length field wrong";
+        } else if (strm.total_out != block->ulen) {
+            err = WTAP_ERR_DECOMPRESS;
+            err_info = "length field wrong";
+        } else if (!state->dont_check_crc &&
+                   crc32(0L, block->udata, block->ulen) != pletoh32(block->cdata + block->clen - BGZF_TRAILER_LEN)) {
+            err = WTAP_ERR_DECOMPRESS;
+            err_info = "bad CRC";
+        }
+        inflateEnd(&strm);
+    }
+
+    g_mutex_lock(&state->bgzf_mutex);
+    block->err = err;
+    block->err_info = err_info;
+    block->done = TRUE;
+    g_cond_broadcast(&state->bgzf_cond);
+    g_mutex_unlock(&state->bgzf_mutex);
+}
+
+static void
+bgzf_free_block(struct bgzf_block *block)
+{
+    if (block != NULL) {
+        g_free(block->cdata);
+        g_free(block->udata);
+        g_free(block);
+    }
+}
+
+static void
+bgzf_wait(FILE_T state, struct bgzf_block *block)
+{
+    g_mutex_lock(&state->bgzf_mutex);
+    while (!block->done)
+        g_cond_wait(&state->bgzf_cond, &state->bgzf_mutex);
+    g_mutex_unlock(&state->bgzf_mutex);
+}
+
+/*
+ * Discard everything we've read ahead; done when seeking.
+ */
+static void
+bgzf_reset(FILE_T state)
+{
+    struct bgzf_block *block;
+
+    while ((block = (struct bgzf_block *)g_queue_pop_head(&state->bgzf_blocks)) != NULL) {
+        bgzf_wait(state, block);
+        bgzf_free_block(block);
+    }
+    if (state->bgzf_cur != NULL) {
+        bgzf_free_block(state->bgzf_cur);
+        state->bgzf_cur = NULL;
+        state->next = state->out;
+    }
+    state->bgzf_end = FALSE;
+    state->bgzf_err = 0;
+    state->bgzf_err_info = NULL;
+}
+
+/*
+ * Start the worker threads, if they aren't already running.
+ */
+static gboolean
+bgzf_start(FILE_T state)
+{
+    guint nthreads;
+
+    if (state->bgzf_pool != NULL)
+        return TRUE;
+#if GLIB_CHECK_VERSION(2,36,0)
+    nthreads = g_get_num_processors();
+#else
+    nthreads = 4;
+#endif
+    if (nthreads > BGZF_MAX_THREADS)
+        nthreads = BGZF_MAX_THREADS;
+    state->bgzf_pool = g_thread_pool_new(bgzf_inflate, state, nthreads, FALSE, NULL);
+    if (state->bgzf_pool == NULL)
+        return FALSE;
+    state->bgzf_depth = 2 * nthreads;
+    return TRUE;
+}
+
+/*
+ * Stop reading ahead because of the error in state->err.  It's reported
+ * once the blocks already read ahead have been handed out, as reading
+ * without the worker threads would have handed them out before getting
+ * to the error.
+ */
+static void
+bgzf_hold_error(FILE_T state)
+{
+    state->bgzf_err = state->err;
+    state->bgzf_err_info = state->err_info;
+    state->err = 0;
+    state->err_info = NULL;
+    state->bgzf_end = TRUE;
+}
+
+/*
+ * Read BGZF blocks and hand them to the worker threads until we have
+ * bgzf_depth blocks in flight, hit something that isn't a BGZF block,
+ * or get an error.
+ */
+static void
+bgzf_read_ahead(FILE_T state)
+{
+    struct bgzf_block *block;
+    guint bsize;
+    gint64 in_pos;
+
+    while (!state->bgzf_end &&
+           g_queue_get_length(&state->bgzf_blocks) < state->bgzf_depth) {
+        if (gz_peek(state, BGZF_HDR_LEN) == -1) {
+            bgzf_hold_error(state);
+            return;
+        }
+        if (state->avail_in < BGZF_HDR_LEN ||
+            (bsize = bgzf_block_size(state->next_in)) == 0) {
+            /*
+             * End of file, or not a BGZF block; once we've delivered
+             * what we have, gz_head() deals with whatever this is.
+             */
+            state->bgzf_end = TRUE;
+            break;
+        }
+
+        in_pos = state->raw_pos - state->avail_in;
+        block = g_new(struct bgzf_block, 1);
+        block->cdata = (unsigned char *)g_malloc(bsize);
+        block->clen = bsize;
+        block->udata = NULL;
+        if (gz_read_raw(state, block->cdata, bsize) == -1) {
+            bgzf_free_block(block);
+            bgzf_hold_error(state);
+            return;
+        }
+        block->ulen = pletoh32(block->cdata + bsize - 4);
+        if (block->ulen > BGZF_MAX_BLOCK) {
+            bgzf_free_block(block);
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = "BGZF block too large";
+            bgzf_hold_error(state);
+            return;
+        }
+        /* zlib won't take a null output pointer, even for no output */
+        block->udata = (unsigned char *)g_malloc(block->ulen ? block->ulen : 1);
+        block->in = in_pos + BGZF_HDR_LEN;
+        block->out = state->bgzf_out;
+        block->done = FALSE;
+        state->bgzf_out += block->ulen;
+
+        g_queue_push_tail(&state->bgzf_blocks, block);
+        g_thread_pool_push(state->bgzf_pool, block, NULL);
+    }
+}
+
+/*
+ * Hand out the data from the next inflated block.  If there are no more
+ * BGZF blocks, switch back to looking for a gzip header.
+ */
+static int
+bgzf_fill_out_buffer(FILE_T state)
+{
+    struct bgzf_block *block;
+
+    if (state->bgzf_cur != NULL) {
+        bgzf_free_block(state->bgzf_cur);
+        state->bgzf_cur = NULL;
+        state->next = state->out;
+    }
+    state->have = 0;
+
+    for (;;) {
+        bgzf_read_ahead(state);
+        block = (struct bgzf_block *)g_queue_pop_head(&state->bgzf_blocks);
+        if (block == NULL) {
+            if (state->bgzf_err != 0) {
+                /* everything before the error has been handed out */
+                state->err = state->bgzf_err;
+                state->err_info = state->bgzf_err_info;
+                return -1;
+            }
+            state->compression = UNKNOWN;
+            state->bgzf_end = FALSE;
+            return 0;
+        }
+        /* keep the workers busy while we wait for this one */
+        bgzf_read_ahead(state);
+        bgzf_wait(state, block);
+        if (block->err != 0) {
+            state->err = block->err;
+            state->err_info = block->err_info;
+            bgzf_free_block(block);
+            return -1;
+        }
+        if (block->ulen != 0)
+            break;
+        /* empty block, e.g. the end-of-file marker; skip it */
+        bgzf_free_block(block);
+    }
+
+    if (state->fast_seek)
+        fast_seek_header(state, block->in, block->out, GZIP_AFTER_HEADER);
+    state->bgzf_cur = block;
+    state->next = block->udata;
+    state->have = block->ulen;
+    return 0;
+}
+#endif
+
+#ifdef USE_FRAMED_COMPRESSION
+static const unsigned char lz4_magic[4] = { 0x04, 0x22, 0x4d, 0x18 };
+static const unsigned char zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+#ifdef HAVE_LZ4
+static const unsigned char lz4_legacy_magic[4] = { 0x02, 0x21, 0x4c, 0x18 };
+#endif
+
+/*
+ * Skippable frames, which both formats allow, e.g. the ones pzstd puts
+ * in front of each of its frames, have a little-endian magic number of
+ * 0x184D2A50 through 0x184D2A5F, then a little-endian 4-byte length of
+ * the data that follows.
+ */
+#define SKIPPABLE_MAGIC         0x184D2A50
+#define SKIPPABLE_MAGIC_MASK    0xFFFFFFF0
+#define SKIPPABLE_HDR_LEN       8
+
+/*
+ * Skip a skippable frame at the current input position.  Returns -1,
+ * and sets state->err, on an error or if the file ends in the frame;
+ * returns 0 on success.
+ */
+static int
+frame_skip(FILE_T state)
+{
+    guint32 left;
+    guint n;
+
+    if (gz_peek(state, SKIPPABLE_HDR_LEN) == -1)
+        return -1;
+    if (state->avail_in < SKIPPABLE_HDR_LEN) {
+        state->err = WTAP_ERR_SHORT_READ;
+        state->err_info = NULL;
+        return -1;
+    }
+    left = pletoh32(state->next_in + 4);
+    state->next_in += SKIPPABLE_HDR_LEN;
+    state->avail_in -= SKIPPABLE_HDR_LEN;
+    while (left != 0) {
+        if (state->avail_in == 0) {
+            if (fill_in_buffer(state) == -1)
+                return -1;
+            if (state->avail_in == 0) {
+                state->err = WTAP_ERR_SHORT_READ;
+                state->err_info = NULL;
+                return -1;
+            }
+        }
+        n = state->avail_in < left ? state->avail_in : (guint)left;
+        state->next_in += n;
+        state->avail_in -= n;
+        left -= n;
+    }
+    return 0;
+}
+
+/*
+ * TRUE if a fast seek point is at the start of an LZ4 or Zstandard
+ * frame.
+ */
+static gboolean
+fast_seek_is_frame(const struct fast_seek_point *point)
+{
+#ifdef HAVE_LZ4
+    if (point->compression == LZ4)
+        return TRUE;
+#endif
+#ifdef HAVE_ZSTD
+    if (point->compression == ZSTD)
+        return TRUE;
+#endif
+    return FALSE;
+}
+
+/*
+ * Set up to decompress a frame of the given type, starting at the
+ * current input position.  Returns -1, and sets state->err, on an
+ * error; returns 0 on success.
+ */
+static int
+frame_start(FILE_T state, compression_t compression)
+{
+#ifdef HAVE_LZ4
+    if (compression == LZ4) {
+        LZ4F_errorCode_t ret;
+
+        /*
+         * Start with a fresh context, as we might be abandoning
+         * a frame part-way through after a seek.
+         */
+        if (state->lz4_dctx != NULL)
+            LZ4F_freeDecompressionContext(state->lz4_dctx);
+        ret = LZ4F_createDecompressionContext(&state->lz4_dctx, LZ4F_VERSION);
+        if (LZ4F_isError(ret)) {
+            state->lz4_dctx = NULL;
+            state->err = ENOMEM;
+            state->err_info = NULL;
+            return -1;
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (compression == ZSTD) {
+        size_t ret;
+
+        if (state->zstd_dstream == NULL) {
+            state->zstd_dstream = ZSTD_createDStream();
+            if (state->zstd_dstream == NULL) {
+                state->err = ENOMEM;
+                state->err_info = NULL;
+                return -1;
+            }
+        }
+        ret = ZSTD_initDStream(state->zstd_dstream);
+        if (ZSTD_isError(ret)) {
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = ZSTD_getErrorName(ret);
+            return -1;
+        }
+    }
+#endif
+    state->compression = compression;
+    return 0;
+}
+
+#ifdef HAVE_LZ4
+/*
+ * Decompress as much of the current LZ4 frame as will fit into buf,
+ * going back to looking for a header at the end of the frame.
+ */
+static void
+lz4_read(FILE_T state, unsigned char *buf, unsigned int count)
+{
+    size_t ret = 1;
+    size_t got = 0;
+    size_t dst_size, src_size;
+
+    do {
+        if (state->avail_in == 0 && fill_in_buffer(state) == -1)
+            break;
+        dst_size = count - got;
+        src_size = state->avail_in;
+        ret = LZ4F_decompress(state->lz4_dctx, buf + got, &dst_size,
+                              state->next_in, &src_size, NULL);
+        state->next_in += src_size;
+        state->avail_in -= (guint)src_size;
+        got += dst_size;
+        if (LZ4F_isError(ret)) {
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = LZ4F_getErrorName(ret);
+            break;
+        }
+        if (ret != 0 && got < count && state->avail_in == 0 && state->eof) {
+            /* EOF in the middle of the frame */
+            state->err = WTAP_ERR_SHORT_READ;
+            state->err_info = NULL;
+            break;
+        }
+    } while (ret != 0 && got < count);
+
+    state->next = buf;
+    state->have = (guint)got;
+    if (ret == 0)
+        state->compression = UNKNOWN;   /* ready for next frame, once have is 0 */
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/*
+ * Decompress as much of the current Zstandard frame as will fit into
+ * buf, going back to looking for a header at the end of the frame.
+ */
+static void
+zstd_read(FILE_T state, unsigned char *buf, unsigned int count)
+{
+    size_t ret = 1;
+    ZSTD_inBuffer input;
+    ZSTD_outBuffer output;
+
+    output.dst = buf;
+    output.size = count;
+    output.pos = 0;
+    do {
+        if (state->avail_in == 0 && fill_in_buffer(state) == -1)
+            break;
+        input.src = state->next_in;
+        input.size = state->avail_in;
+        input.pos = 0;
+        ret = ZSTD_decompressStream(state->zstd_dstream, &output, &input);
+        state->next_in += input.pos;
+        state->avail_in -= (guint)input.pos;
+        if (ZSTD_isError(ret)) {
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = ZSTD_getErrorName(ret);
+            break;
+        }
+        if (ret != 0 && output.pos < output.size && state->avail_in == 0 &&
+            state->eof) {
+            /* EOF in the middle of the frame */
+            state->err = WTAP_ERR_SHORT_READ;
+            state->err_info = NULL;
+            break;
+        }
+    } while (ret != 0 && output.pos < output.size);
+
+    state->next = buf;
+    state->have = (guint)output.pos;
+    if (ret == 0)
+        state->compression = UNKNOWN;   /* ready for next frame, once have is 0 */
+}
+#endif
+#endif
+
 static int
 gz_head(FILE_T state)
 {
@@ -571,6 +1351,65 @@ gz_head(FILE_T state)
             return 0;
     }
 
+#ifdef USE_BGZF_THREADS
+    /*
+     * If this is a BGZF block, and we're reading sequentially, inflate
+     * it and the blocks after it on worker threads.
+     */
+    if (!state->random) {
+        if (gz_peek(state, BGZF_HDR_LEN) == -1)
+            return -1;
+        if (state->avail_in >= BGZF_HDR_LEN &&
+            bgzf_block_size(state->next_in) != 0 && bgzf_start(state)) {
+            state->compression = BGZF;
+            state->is_compressed = TRUE;
+            state->bgzf_out = state->pos;
+            state->bgzf_end = FALSE;
+            return 0;
+        }
+    }
+#endif
+
+#ifdef USE_FRAMED_COMPRESSION
+    /* look for the LZ4 frame and Zstandard frame magic numbers */
+    if (gz_peek(state, 4) == -1)
+        return -1;
+    if (state->avail_in >= 4) {
+        compression_t compression = UNKNOWN;
+
+        if ((pletoh32(state->next_in) & SKIPPABLE_MAGIC_MASK) == SKIPPABLE_MAGIC) {
+            /* look again after it, at the next call */
+            if (frame_skip(state) == -1)
+                return -1;
+            state->is_compressed = TRUE;
+            return 0;
+        }
+#ifdef HAVE_LZ4
+        if (memcmp(state->next_in, lz4_legacy_magic, 4) == 0) {
+            /* written by "lz4 -l"; liblz4's frame API can't read it */
+            state->err = WTAP_ERR_DECOMPRESS;
+            state->err_info = "LZ4 legacy format files aren't supported";
+            return -1;
+        }
+        if (memcmp(state->next_in, lz4_magic, 4) == 0)
+            compression = LZ4;
+#endif
+#ifdef HAVE_ZSTD
+        if (memcmp(state->next_in, zstd_magic, 4) == 0)
+            compression = ZSTD;
+#endif
+        if (compression != UNKNOWN) {
+            /* the decompressor wants the whole frame, magic included */
+            if (frame_start(state, compression) == -1)
+                return -1;
+            state->is_compressed = TRUE;
+            if (state->fast_seek)
+                fast_seek_header(state, state->raw_pos - state->avail_in, state->pos, compression);
+            return 0;
+        }
+    }
+#endif
+
     /* look for the gzip magic header bytes 31 and 139 */
 #ifdef HAVE_ZLIB
     if (state->next_in[0] == 31) {
@@ -677,6 +1516,22 @@ gz_head(FILE_T state)
     if (state->fast_seek)
         fast_seek_header(state, state->raw_pos - state->avail_in - state->have, state->pos, UNCOMPRESSED);
 
+#ifdef HAVE_MMAP
+    /*
+     * If the entire file is uncompressed, and it's a regular file, map
+     * it, and deliver data from the mapping, starting over at the
+     * beginning of the data, rather than from our buffers.
+     */
+    if (!state->is_compressed && state->pos == 0 && map_file(state)) {
+        state->raw = state->pos;
+        state->raw_pos = state->start;
+        state->avail_in = 0;
+        state->have = 0;
+        state->compression = UNCOMPRESSED;
+        return map_fill_out_buffer(state);
+    }
+#endif
+
     /* doing raw i/o, save start of raw data for seeking, copy any leftover
        input to output -- this assumes that the output buffer is larger than
        the input buffer, which also assures space for gzungetc() */
@@ -701,6 +1556,10 @@ fill_out_buffer(FILE_T state)
             return 0;
     }
     if (state->compression == UNCOMPRESSED) {           /* straight copy */
+#ifdef HAVE_MMAP
+        if (state->map != NULL)
+            return map_fill_out_buffer(state);
+#endif
         if (raw_read(state, state->out, state->size /* << 1 */, &(state->have)) == -1)
             return -1;
         state->next = state->out;
@@ -709,10 +1568,53 @@ fill_out_buffer(FILE_T state)
     else if (state->compression == ZLIB) {      /* decompress */
         zlib_read(state, state->out, state->size << 1);
     }
+#endif
+#ifdef USE_BGZF_THREADS
+    else if (state->compression == BGZF) {      /* decompress in parallel */
+        if (bgzf_fill_out_buffer(state) == -1)
+            return -1;
+        if (state->compression == UNKNOWN)      /* out of BGZF blocks */
+            return fill_out_buffer(state);
+    }
+#endif
+#ifdef HAVE_LZ4
+    else if (state->compression == LZ4) {       /* decompress an LZ4 frame */
+        lz4_read(state, state->out, state->size << 1);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    else if (state->compression == ZSTD) {      /* decompress a Zstandard frame */
+        zstd_read(state, state->out, state->size << 1);
+    }
 #endif
     return 0;
 }
 
+/*
+ * TRUE if there's no more data to be had from the file other than
+ * what's in the output buffer.
+ */
+static gboolean
+gz_input_exhausted(FILE_T state)
+{
+    if (!state->eof || state->avail_in != 0)
+        return FALSE;
+#ifdef USE_BGZF_THREADS
+    if (!g_queue_is_empty(&state->bgzf_blocks))
+        return FALSE;
+#endif
+#ifdef HAVE_LZ4
+    /* the decompressor may be holding on to data from the frame */
+    if (state->compression == LZ4)
+        return FALSE;
+#endif
+#ifdef HAVE_ZSTD
+    if (state->compression == ZSTD)
+        return FALSE;
+#endif
+    return TRUE;
+}
+
 static int
 gz_skip(FILE_T state, gint64 len)
 {
@@ -735,7 +1637,7 @@ gz_skip(FILE_T state, gint64 len)
                any more data into the output buffer, so
                return an error indication. */
             return -1;
-        } else if (state->eof && state->avail_in == 0) {
+        } else if (gz_input_exhausted(state)) {
             /* We have nothing in the output buffer, and
                we're at the end of the input; just return. */
             break;
@@ -761,6 +1663,9 @@ gz_reset(FILE_T state)
     state->err_info = NULL;
     state->pos = 0;               /* no uncompressed data yet */
     state->avail_in = 0;          /* no input data yet */
+#ifdef USE_BGZF_THREADS
+    bgzf_reset(state);            /* nothing read ahead */
+#endif
 }
 
 FILE_T
@@ -782,6 +1687,28 @@ file_fdopen(int fd)
 
     state->fast_seek_cur = NULL;
     state->fast_seek = NULL;
+    state->fast_seek_loaded = 0;
+#ifdef HAVE_MMAP
+    state->map = NULL;
+    state->map_size = 0;
+#endif
+#ifdef USE_BGZF_THREADS
+    state->random = FALSE;
+    state->bgzf_pool = NULL;
+    g_queue_init(&state->bgzf_blocks);
+    state->bgzf_depth = 0;
+    state->bgzf_cur = NULL;
+    state->bgzf_out = 0;
+    state->bgzf_end = FALSE;
+    state->bgzf_err = 0;
+    state->bgzf_err_info = NULL;
+#endif
+#ifdef HAVE_LZ4
+    state->lz4_dctx = NULL;
+#endif
+#ifdef HAVE_ZSTD
+    state->zstd_dstream = NULL;
+#endif
 
     /* open the file with the appropriate mode (or just use fd) */
     state->fd = fd;
@@ -841,6 +1768,11 @@ file_fdopen(int fd)
 
     /* for now, assume we should check the crc */
     state->dont_check_crc = FALSE;
+#endif
+#ifdef USE_BGZF_THREADS
+    /* nothing after this can fail, so file_close() will clear these */
+    g_mutex_init(&state->bgzf_mutex);
+    g_cond_init(&state->bgzf_cond);
 #endif
     /* return stream */
     return state;
@@ -867,42 +1799,353 @@ file_open(const char *path)
     if ((fd = ws_open(path, O_RDONLY|O_BINARY, 0000)) == -1)
         return NULL;
 
-    /* open file handle */
-    ft = file_fdopen(fd);
-    if (ft == NULL) {
-        ws_close(fd);
-        return NULL;
-    }
+    /* open file handle */
+    ft = file_fdopen(fd);
+    if (ft == NULL) {
+        ws_close(fd);
+        return NULL;
+    }
+
+#ifdef HAVE_ZLIB
+    /*
+     * If this file's name ends in ".caz", it's probably a compressed
+     * Windows Sniffer file.  The compression is gzip, but if we
+     * process the CRC as specified by RFC 1952, the computed CRC
+     * doesn't match the stored CRC.
+     *
+     * Compressed Windows Sniffer files don't all have the same CRC
+     * value; is it just random crap, or are they running the CRC on
+     * a different set of data than you're supposed to (e.g., not
+     * CRCing some of the data), or something such as that?
+     *
+     * For now, we just set a flag to ignore CRC errors.
+     */
+    suffixp = strrchr(path, '.');
+    if (suffixp != NULL) {
+        if (g_ascii_strcasecmp(suffixp, ".caz") == 0)
+            ft->dont_check_crc = TRUE;
+    }
+#endif
+
+    return ft;
+}
+
+void
+#ifdef USE_BGZF_THREADS
+file_set_random_access(FILE_T stream, gboolean random_flag, GPtrArray *seek)
+#else
+file_set_random_access(FILE_T stream, gboolean random_flag _U_, GPtrArray *seek)
+#endif
+{
+    stream->fast_seek = seek;
+#ifdef USE_BGZF_THREADS
+    /* reading ahead is a waste of time if we're jumping around */
+    stream->random = random_flag;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+/*
+ * Persistent fast seek index.
+ *
+ * Building the fast seek points for a compressed file requires
+ * decompressing the entire file, so, optionally, once a file has been
+ * read all the way through, the points are saved in a sidecar file
+ * and loaded from there the next time the file is opened.
+ *
+ * The index is keyed by the size and modification time of the
+ * compressed file and a CRC of its first FSI_HDR_BYTES bytes; if any
+ * of those don't match, the index is ignored (and rewritten when the
+ * file has been read through again).
+ *
+ * All values are stored little-endian.  The header is:
+ *
+ *      magic                   8 bytes
+ *      file size               8 bytes
+ *      file modification time  8 bytes
+ *      header CRC              4 bytes
+ *      number of seek points   4 bytes
+ *
+ * and is followed by the seek points, each of which is:
+ *
+ *      uncompressed offset     8 bytes
+ *      compressed offset       8 bytes
+ *      compression type        1 byte
+ *      bits                    1 byte
+ *      padding                 2 bytes
+ *      adler                   4 bytes
+ *      total_out               4 bytes
+ *
+ * followed, for FSI_ZLIB points, by the ZLIB_WINSIZE-byte window.
+ */
+static const char fsi_magic[8] = { 'W', 'T', 'A', 'P', 'F', 'S', 'I', '1' };
+
+#define FSI_HDR_BYTES   65536
+#define FSI_HDR_LEN     32
+#define FSI_POINT_LEN   28
+
+/* compression types as stored in the index */
+#define FSI_UNCOMPRESSED        0
+#define FSI_ZLIB                1
+#define FSI_GZIP_AFTER_HEADER   2
+#define FSI_LZ4                 3
+#define FSI_ZSTD                4
+
+/*
+ * Get the key identifying the file's contents.  The file position is
+ * left unchanged.
+ */
+static gboolean
+fast_seek_index_key(FILE_T state, guint64 *size, gint64 *mtime, guint32 *crc)
+{
+    ws_statb64 st;
+    unsigned char *buf;
+    gint64 cur;
+    ssize_t ret;
+    guint have;
+
+    if (ws_fstat64(state->fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return FALSE;
+    *size = (guint64)st.st_size;
+    *mtime = (gint64)st.st_mtime;
+
+    cur = ws_lseek64(state->fd, 0, SEEK_CUR);
+    if (cur == -1 || ws_lseek64(state->fd, 0, SEEK_SET) == -1)
+        return FALSE;
+    buf = (unsigned char *)g_malloc(FSI_HDR_BYTES);
+    have = 0;
+    do {
+        ret = ws_read(state->fd, buf + have, FSI_HDR_BYTES - have);
+        if (ret <= 0)
+            break;
+        have += (guint)ret;
+    } while (have < FSI_HDR_BYTES);
+    *crc = (guint32)crc32(0L, buf, have);
+    g_free(buf);
+    if (ws_lseek64(state->fd, cur, SEEK_SET) == -1 || ret < 0)
+        return FALSE;
+    return TRUE;
+}
+
+/*
+ * Load the fast seek points for a file from a previously-written index.
+ * This must be called after file_set_random_access(), before anything
+ * is read from the file.  Returns TRUE if the index was loaded, FALSE
+ * if there's no index or it doesn't match the file.
+ */
+gboolean
+file_read_fast_seek_index(FILE_T stream, const char *index_path)
+{
+    FILE *fp;
+    guint8 hdr[FSI_HDR_LEN];
+    guint8 rec[FSI_POINT_LEN];
+    guint64 size;
+    gint64 mtime;
+    guint32 crc, count, i;
+    struct fast_seek_point *val;
+
+    if (stream->fast_seek == NULL || stream->fast_seek->len != 0)
+        return FALSE;
+    if (!fast_seek_index_key(stream, &size, &mtime, &crc))
+        return FALSE;
+    if ((fp = ws_fopen(index_path, "rb")) == NULL)
+        return FALSE;
+
+    if (fread(hdr, 1, FSI_HDR_LEN, fp) != FSI_HDR_LEN ||
+        memcmp(hdr, fsi_magic, sizeof fsi_magic) != 0 ||
+        pletoh64(&hdr[8]) != size ||
+        (gint64)pletoh64(&hdr[16]) != mtime ||
+        pletoh32(&hdr[24]) != crc) {
+        fclose(fp);
+        return FALSE;
+    }
+    count = pletoh32(&hdr[28]);
+
+    for (i = 0; i < count; i++) {
+        if (fread(rec, 1, FSI_POINT_LEN, fp) != FSI_POINT_LEN)
+            goto bad;
+        /* as in fast_seek_header(), only zlib points get a window */
+        if (rec[16] == FSI_ZLIB)
+            val = g_new(struct fast_seek_point, 1);
+        else
+            val = (struct fast_seek_point *)g_malloc(offsetof(struct fast_seek_point, data));
+        g_ptr_array_add(stream->fast_seek, val);
+        val->out = (gint64)pletoh64(&rec[0]);
+        val->in = (gint64)pletoh64(&rec[8]);
+        if (val->out < 0 || val->in < 0 || (gint64)size < val->in)
+            goto bad;
+        /* the points must be in increasing order for fast_seek_find() */
+        if (i != 0 &&
+            val->out <= ((struct fast_seek_point *)stream->fast_seek->pdata[i - 1])->out)
+            goto bad;
+        switch (rec[16]) {
+
+        case FSI_UNCOMPRESSED:
+            val->compression = UNCOMPRESSED;
+            break;
+
+        case FSI_ZLIB:
+            val->compression = ZLIB;
+#ifdef HAVE_INFLATEPRIME
+            if (rec[17] > 7)
+                goto bad;
+            val->data.zlib.bits = rec[17];
+#else
+            /* we can't resume in the middle of a byte */
+            if (rec[17] != 0)
+                goto bad;
+#endif
+            val->data.zlib.adler = pletoh32(&rec[20]);
+            val->data.zlib.total_out = pletoh32(&rec[24]);
+            if (fread(val->data.zlib.window, 1, ZLIB_WINSIZE, fp) != ZLIB_WINSIZE)
+                goto bad;
+            break;
+
+        case FSI_GZIP_AFTER_HEADER:
+            val->compression = GZIP_AFTER_HEADER;
+            break;
+
+#ifdef HAVE_LZ4
+        case FSI_LZ4:
+            val->compression = LZ4;
+            break;
+#endif
+
+#ifdef HAVE_ZSTD
+        case FSI_ZSTD:
+            val->compression = ZSTD;
+            break;
+#endif
+
+        default:
+            goto bad;
+        }
+    }
+    fclose(fp);
+    stream->fast_seek_loaded = count;
+    return TRUE;
+
+bad:
+    fclose(fp);
+    for (i = 0; i < stream->fast_seek->len; i++)
+        g_free(stream->fast_seek->pdata[i]);
+    g_ptr_array_set_size(stream->fast_seek, 0);
+    return FALSE;
+}
+
+/*
+ * Save the fast seek points for a compressed file to an index, if
+ * we've read through to the end of the file, so that we have points
+ * for all of it, and they didn't all come from the index already.
+ * Returns TRUE if the index was written.
+ */
+gboolean
+file_write_fast_seek_index(FILE_T stream, const char *index_path)
+{
+    FILE *fp;
+    gchar *tmp_path;
+    int fd;
+    guint8 hdr[FSI_HDR_LEN];
+    guint8 rec[FSI_POINT_LEN];
+    guint64 size;
+    gint64 mtime;
+    guint32 crc, i;
+    struct fast_seek_point *item;
+    gboolean ok = TRUE;
+
+    if (stream->fast_seek == NULL || stream->fast_seek->len == 0 ||
+        !stream->is_compressed || !stream->eof || stream->err != 0)
+        return FALSE;
+    /*
+     * If the index we loaded had points for all of the file, reading
+     * it didn't add any, and the index is still good; with a window
+     * for each zlib point, rewriting it would be a lot of I/O for
+     * nothing.
+     */
+    if (stream->fast_seek_loaded == stream->fast_seek->len)
+        return FALSE;
+    if (!fast_seek_index_key(stream, &size, &mtime, &crc))
+        return FALSE;
 
-#ifdef HAVE_ZLIB
     /*
-     * If this file's name ends in ".caz", it's probably a compressed
-     * Windows Sniffer file.  The compression is gzip, but if we
-     * process the CRC as specified by RFC 1952, the computed CRC
-     * doesn't match the stored CRC.
-     *
-     * Compressed Windows Sniffer files don't all have the same CRC
-     * value; is it just random crap, or are they running the CRC on
-     * a different set of data than you're supposed to (e.g., not
-     * CRCing some of the data), or something such as that?
-     *
-     * For now, we just set a flag to ignore CRC errors.
+     * Write to a temporary file and rename it into place, so that
+     * nobody ever sees a partially-written index; the file has a name
+     * of its own, so that other programs writing an index for the same
+     * file don't write to it as well.
      */
-    suffixp = strrchr(path, '.');
-    if (suffixp != NULL) {
-        if (g_ascii_strcasecmp(suffixp, ".caz") == 0)
-            ft->dont_check_crc = TRUE;
+    tmp_path = g_strdup_printf("%s.XXXXXX", index_path);
+    if ((fd = g_mkstemp(tmp_path)) == -1) {
+        g_free(tmp_path);
+        return FALSE;
+    }
+    if ((fp = ws_fdopen(fd, "wb")) == NULL) {
+        ws_close(fd);
+        ws_unlink(tmp_path);
+        g_free(tmp_path);
+        return FALSE;
     }
+
+    memcpy(hdr, fsi_magic, sizeof fsi_magic);
+    phtolell(&hdr[8], size);
+    phtolell(&hdr[16], (guint64)mtime);
+    phtolel(&hdr[24], crc);
+    phtolel(&hdr[28], stream->fast_seek->len);
+    if (fwrite(hdr, 1, FSI_HDR_LEN, fp) != FSI_HDR_LEN)
+        ok = FALSE;
+
+    for (i = 0; ok && i < stream->fast_seek->len; i++) {
+        item = (struct fast_seek_point *)stream->fast_seek->pdata[i];
+        memset(rec, 0, sizeof rec);
+        phtolell(&rec[0], (guint64)item->out);
+        phtolell(&rec[8], (guint64)item->in);
+        switch (item->compression) {
+
+        case ZLIB:
+            rec[16] = FSI_ZLIB;
+#ifdef HAVE_INFLATEPRIME
+            rec[17] = (guint8)item->data.zlib.bits;
 #endif
+            phtolel(&rec[20], item->data.zlib.adler);
+            phtolel(&rec[24], item->data.zlib.total_out);
+            break;
 
-    return ft;
-}
+        case GZIP_AFTER_HEADER:
+            rec[16] = FSI_GZIP_AFTER_HEADER;
+            break;
 
-void
-file_set_random_access(FILE_T stream, gboolean random_flag _U_, GPtrArray *seek)
-{
-    stream->fast_seek = seek;
+#ifdef HAVE_LZ4
+        case LZ4:
+            rec[16] = FSI_LZ4;
+            break;
+#endif
+
+#ifdef HAVE_ZSTD
+        case ZSTD:
+            rec[16] = FSI_ZSTD;
+            break;
+#endif
+
+        default:
+            rec[16] = FSI_UNCOMPRESSED;
+            break;
+        }
+        if (fwrite(rec, 1, FSI_POINT_LEN, fp) != FSI_POINT_LEN)
+            ok = FALSE;
+        else if (item->compression == ZLIB &&
+                 fwrite(item->data.zlib.window, 1, ZLIB_WINSIZE, fp) != ZLIB_WINSIZE)
+            ok = FALSE;
+    }
+
+    if (fclose(fp) == EOF)
+        ok = FALSE;
+    if (ok && ws_rename(tmp_path, index_path) == -1)
+        ok = FALSE;
+    if (!ok)
+        ws_unlink(tmp_path);
+    g_free(tmp_path);
+    return ok;
 }
+#endif /* HAVE_ZLIB */
 
 gint64
 file_seek(FILE_T file, gint64 offset, int whence, int *err)
@@ -935,6 +2178,31 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
         offset += file->skip;
     file->seek_pending = FALSE;
 
+#ifdef HAVE_MMAP
+    /*
+     * If the file is memory-mapped, and we're seeking to a location
+     * within the mapping, just point there.
+     */
+    if (file->map != NULL && file->compression == UNCOMPRESSED) {
+        if (file->pos + offset < 0) {   /* before start of file! */
+            *err = EINVAL;
+            return -1;
+        }
+        if (file->start + file->pos + offset <= file->map_size &&
+            map_check(file)) {
+            file->pos += offset;
+            file->raw_pos = file->start + file->pos;
+            file->next = file->map + file->raw_pos;
+            file->have = 0;
+            file->eof = FALSE;
+            file->err = 0;
+            file->err_info = NULL;
+            file->avail_in = 0;
+            return file->pos;
+        }
+    }
+#endif
+
     /*
      * Are we seeking backwards and, if so, do we have data in the buffer?
      */
@@ -946,7 +2214,14 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
          * To squelch compiler warnings, we cast the
          * result.
          */
-        guint had = (unsigned)(file->next - file->out);
+        guint had;
+
+#ifdef USE_BGZF_THREADS
+        if (file->bgzf_cur != NULL)
+            had = (unsigned)(file->next - file->bgzf_cur->udata);
+        else
+#endif
+            had = (unsigned)(file->next - file->out);
 
         /*
          * Do we have enough data before the current position in
@@ -1002,6 +2277,12 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             off = here->in;
             off2 = here->out;
         } else
+#endif
+#ifdef USE_FRAMED_COMPRESSION
+        if (fast_seek_is_frame(here)) {
+            off = here->in;
+            off2 = here->out;
+        } else
 #endif
         {
             off2 = (file->pos + offset);
@@ -1013,6 +2294,9 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             return -1;
         }
         fast_seek_reset(file);
+#ifdef USE_BGZF_THREADS
+        bgzf_reset(file);
+#endif
 
         file->raw_pos = off;
         file->have = 0;
@@ -1054,6 +2338,14 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             strm->adler = crc32(0L, Z_NULL, 0);
             file->compression = ZLIB;
         } else
+#endif
+#ifdef USE_FRAMED_COMPRESSION
+        if (fast_seek_is_frame(here)) {
+            if (frame_start(file, here->compression) == -1) {
+                *err = file->err;
+                return -1;
+            }
+        } else
 #endif
             file->compression = here->compression;
 
@@ -1223,7 +2515,7 @@ file_read(void *buf, unsigned int len, FILE_T file)
                any more data into the output buffer, so
                return an error indication. */
             return -1;
-        } else if (file->eof && file->avail_in == 0) {
+        } else if (gz_input_exhausted(file)) {
             /* We have nothing in the output buffer, and
                we're at the end of the input; just return
                with what we've gotten so far. */
@@ -1284,7 +2576,7 @@ file_peekc(FILE_T file)
         else if (file->err) {
             return -1;
         }
-        else if (file->eof && file->avail_in == 0) {
+        else if (gz_input_exhausted(file)) {
             return -1;
         }
         else if (fill_out_buffer(file) == -1) {
@@ -1391,7 +2683,7 @@ int
 file_eof(FILE_T file)
 {
     /* return end-of-file state */
-    return (file->eof && file->avail_in == 0 && file->have == 0);
+    return (gz_input_exhausted(file) && file->have == 0);
 }
 
 /*
@@ -1450,6 +2742,25 @@ file_close(FILE_T file)
         g_free(file->in);
     }
     g_free(file->fast_seek_cur);
+#ifdef USE_BGZF_THREADS
+    bgzf_reset(file);
+    if (file->bgzf_pool != NULL)
+        g_thread_pool_free(file->bgzf_pool, FALSE, TRUE);
+    g_mutex_clear(&file->bgzf_mutex);
+    g_cond_clear(&file->bgzf_cond);
+#endif
+#ifdef HAVE_MMAP
+    if (file->map != NULL)
+        munmap(file->map, (size_t)file->map_size);
+#endif
+#ifdef HAVE_LZ4
+    if (file->lz4_dctx != NULL)
+        LZ4F_freeDecompressionContext(file->lz4_dctx);
+#endif
+#ifdef HAVE_ZSTD
+    if (file->zstd_dstream != NULL)
+        ZSTD_freeDStream(file->zstd_dstream);
+#endif
     file->err = 0;
     file->err_info = NULL;
     g_free(file);
@@ -1462,29 +2773,83 @@ file_close(FILE_T file)
         ws_close(fd);
 }
 
+#ifdef CAN_WRITE_COMPRESSED
+/* values for wtap_writer compression */
+typedef enum {
 #ifdef HAVE_ZLIB
-/* internal gzip file state data structure for writing */
+    WRITE_BGZF,    /* gzip, as BGZF blocks */
+#endif
+#ifdef HAVE_LZ4
+    WRITE_LZ4,     /* LZ4 frames */
+#endif
+#ifdef HAVE_ZSTD
+    WRITE_ZSTD,    /* Zstandard frames */
+#endif
+} write_compression_t;
+
+/* what we write if the file name doesn't say; gzip if we can */
+#if defined(HAVE_ZLIB)
+#define WRITE_DEFAULT WRITE_BGZF
+#elif defined(HAVE_ZSTD)
+#define WRITE_DEFAULT WRITE_ZSTD
+#else
+#define WRITE_DEFAULT WRITE_LZ4
+#endif
+
+#ifdef HAVE_ZSTD
+#define WRITE_ZSTD_LEVEL 3  /* libzstd's default; fast enough for live captures */
+#endif
+
+/* internal compressed file state data structure for writing */
 struct wtap_writer {
     int fd;                 /* file descriptor */
     gint64 pos;             /* current position in uncompressed data */
-    guint size;          /* buffer size, zero if not allocated yet */
-    guint want;          /* requested buffer size, default is GZBUFSIZE */
+    guint size;             /* input buffer size, zero if not allocated yet */
+    guint have;             /* amount of data in the input buffer */
     unsigned char *in;      /* input buffer */
-    unsigned char *out;     /* output buffer (double-sized when reading) */
-    unsigned char *next;    /* next output data to deliver or write */
+    unsigned char *out;     /* output buffer, holding one block or frame */
+    guint out_size;         /* output buffer size */
+    write_compression_t compression; /* type of compression */
+    int err;                /* error code */
+#ifdef HAVE_ZLIB
     int level;              /* compression level */
     int strategy;           /* compression strategy */
-    int err;                /* error code */
     /* zlib deflate stream */
     z_stream strm;          /* stream structure in-place (not a pointer) */
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_preferences_t lz4_prefs; /* LZ4 frame parameters */
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd_cctx;   /* Zstandard compression context */
+#endif
+};
+
+#ifdef HAVE_ZLIB
+/*
+ * BGZF end-of-file marker: an empty block, which readers that know
+ * about BGZF use to detect truncated files.
+ */
+static const unsigned char bgzf_eof_block[28] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+    27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
 };
+#endif
 
+/*
+ * Open a file for writing, compressed with gzip, or, if we don't have
+ * zlib, whatever we do have, unless the name ends with the extension
+ * for one of the other types of compression we support.
+ */
 GZWFILE_T
 gzwfile_open(const char *path)
 {
     int fd;
     GZWFILE_T state;
     int save_errno;
+#ifdef USE_FRAMED_COMPRESSION
+    const char *extension;
+#endif
 
     fd = ws_open(path, O_BINARY|O_WRONLY|O_CREAT|O_TRUNC, 0666);
     if (fd == -1)
@@ -1494,7 +2859,21 @@ gzwfile_open(const char *path)
         save_errno = errno;
         ws_close(fd);
         errno = save_errno;
+        return NULL;
     }
+#ifdef USE_FRAMED_COMPRESSION
+    extension = strrchr(path, '.');
+    if (extension != NULL) {
+#ifdef HAVE_LZ4
+        if (g_ascii_strcasecmp(extension, ".lz4") == 0)
+            state->compression = WRITE_LZ4;
+#endif
+#ifdef HAVE_ZSTD
+        if (g_ascii_strcasecmp(extension, ".zst") == 0)
+            state->compression = WRITE_ZSTD;
+#endif
+    }
+#endif
     return state;
 }
 
@@ -1509,32 +2888,92 @@ gzwfile_fdopen(int fd)
         return NULL;
     state->fd = fd;
     state->size = 0;            /* no buffers allocated yet */
-    state->want = GZBUFSIZE;    /* requested buffer size */
+    state->compression = WRITE_DEFAULT;
 
+#ifdef HAVE_ZLIB
     state->level = Z_DEFAULT_COMPRESSION;
     state->strategy = Z_DEFAULT_STRATEGY;
+#endif
 
     /* initialize stream */
-    state->err = Z_OK;              /* clear error */
+    state->err = 0;                 /* clear error */
     state->pos = 0;                 /* no uncompressed data yet */
-    state->strm.avail_in = 0;       /* no input data yet */
+    state->have = 0;                /* no input data yet */
 
     /* return stream */
     return state;
 }
 
-/* Initialize state for writing a gzip file.  Mark initialization by setting
-   state->size to non-zero.  Return -1, and set state->err, on failure;
-   return 0 on success. */
+#ifdef HAVE_LZ4
+/* Set up for writing LZ4 frames.  Return -1, and set state->err, on
+   failure; return 0 on success. */
+static int
+lz4_init(GZWFILE_T state)
+{
+    memset(&state->lz4_prefs, 0, sizeof state->lz4_prefs);
+    state->lz4_prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+    state->out_size = (guint)LZ4F_compressFrameBound(FRAME_MAX_INPUT, &state->lz4_prefs);
+    state->in = (unsigned char *)g_try_malloc(FRAME_MAX_INPUT);
+    state->out = (unsigned char *)g_try_malloc(state->out_size);
+    if (state->in == NULL || state->out == NULL) {
+        g_free(state->out);
+        g_free(state->in);
+        state->err = ENOMEM;
+        return -1;
+    }
+    state->size = FRAME_MAX_INPUT;
+    return 0;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* Set up for writing Zstandard frames.  Return -1, and set state->err,
+   on failure; return 0 on success. */
+static int
+zstd_init(GZWFILE_T state)
+{
+    state->out_size = (guint)ZSTD_compressBound(FRAME_MAX_INPUT);
+    state->in = (unsigned char *)g_try_malloc(FRAME_MAX_INPUT);
+    state->out = (unsigned char *)g_try_malloc(state->out_size);
+    state->zstd_cctx = ZSTD_createCCtx();
+    if (state->in == NULL || state->out == NULL || state->zstd_cctx == NULL) {
+        ZSTD_freeCCtx(state->zstd_cctx);
+        g_free(state->out);
+        g_free(state->in);
+        state->err = ENOMEM;
+        return -1;
+    }
+    state->size = FRAME_MAX_INPUT;
+    return 0;
+}
+#endif
+
+/* Initialize state for writing a compressed file.  Mark initialization
+   by setting state->size to non-zero.  Return -1, and set state->err, on
+   failure; return 0 on success. */
 static int
 gz_init(GZWFILE_T state)
 {
+#ifdef HAVE_ZLIB
     int ret;
     z_streamp strm = &(state->strm);
+#endif
+
+#ifdef HAVE_LZ4
+    if (state->compression == WRITE_LZ4)
+        return lz4_init(state);
+#endif
+#ifdef HAVE_ZSTD
+    if (state->compression == WRITE_ZSTD)
+        return zstd_init(state);
+#endif
+
+#ifdef HAVE_ZLIB
 
     /* allocate input and output buffers */
-    state->in = (unsigned char *)g_try_malloc(state->want);
-    state->out = (unsigned char *)g_try_malloc(state->want);
+    state->in = (unsigned char *)g_try_malloc(BGZF_MAX_INPUT);
+    state->out = (unsigned char *)g_try_malloc(BGZF_MAX_BLOCK);
+    state->out_size = BGZF_MAX_BLOCK;
     if (state->in == NULL || state->out == NULL) {
         g_free(state->out);
         g_free(state->in);
@@ -1542,12 +2981,13 @@ gz_init(GZWFILE_T state)
         return -1;
     }
 
-    /* allocate deflate memory, set up for gzip compression */
+    /* allocate deflate memory, set up for raw deflate; we do the gzip
+       header and trailer ourselves */
     strm->zalloc = Z_NULL;
     strm->zfree = Z_NULL;
     strm->opaque = Z_NULL;
     ret = deflateInit2(strm, state->level, Z_DEFLATED,
-                       15 + 16, 8, state->strategy);
+                       -15, 8, state->strategy);
     if (ret != Z_OK) {
         g_free(state->out);
         g_free(state->in);
@@ -1562,72 +3002,168 @@ gz_init(GZWFILE_T state)
     }
 
     /* mark state as initialized */
-    state->size = state->want;
+    state->size = BGZF_MAX_INPUT;
+    return 0;
+#else
+    /* not reached; there's nothing else to write without zlib */
+    state->err = WTAP_ERR_INTERNAL;
+    return -1;
+#endif
+}
+
+/* Write out all of buf.  Return -1, and set state->err, on failure;
+   return 0 on success. */
+static int
+gz_write_out(GZWFILE_T state, const unsigned char *buf, guint len)
+{
+    ssize_t got;
 
-    /* initialize write buffer */
-    strm->avail_out = state->size;
-    strm->next_out = state->out;
-    state->next = strm->next_out;
+    got = ws_write(state->fd, buf, len);
+    if (got < 0) {
+        state->err = errno;
+        return -1;
+    }
+    if ((guint)got != len) {
+        state->err = WTAP_ERR_SHORT_WRITE;
+        return -1;
+    }
     return 0;
 }
 
-/* Compress whatever is at avail_in and next_in and write to the output file.
-   Return -1, and set state->err, if there is an error writing to the output
-   file; return 0 on success.
-   flush is assumed to be a valid deflate() flush value.  If flush is Z_FINISH,
-   then the deflate() state is reset to start a new gzip stream. */
+#ifdef HAVE_ZLIB
+/* Compress whatever is in the input buffer as a BGZF block, i.e. a
+   complete gzip member whose header records its compressed size, and
+   put its length in *len.  Return -1, and set state->err, if there is
+   an error; return 0 on success. */
 static int
-gz_comp(GZWFILE_T state, int flush)
+bgzf_comp(GZWFILE_T state, guint *len)
 {
     int ret;
-    ssize_t got;
-    ptrdiff_t have;
+    guint bsize;
+    guint32 crc;
     z_streamp strm = &(state->strm);
 
+    /* compress the block; BGZF_MAX_INPUT is small enough that the
+       result is guaranteed to fit in a block */
+    deflateReset(strm);
+#ifdef z_const
+DIAG_OFF(cast-qual)
+    strm->next_in = (z_const Bytef *)state->in;
+DIAG_ON(cast-qual)
+#else
+    strm->next_in = state->in;
+#endif
+    strm->avail_in = state->have;
+    strm->next_out = state->out + BGZF_HDR_LEN;
+    strm->avail_out = BGZF_MAX_BLOCK - BGZF_HDR_LEN - BGZF_TRAILER_LEN;
+    ret = deflate(strm, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        /* This "shouldn't happen". */
+        state->err = WTAP_ERR_INTERNAL;
+        return -1;
+    }
+    bsize = BGZF_HDR_LEN + (guint)strm->total_out + BGZF_TRAILER_LEN;
+    crc = (guint32)crc32(0L, state->in, state->have);
+
+    /* gzip header, with the BGZF "BC" extra subfield */
+    memcpy(state->out, bgzf_eof_block, 16);
+    phtoles(state->out + 16, bsize - 1);
+
+    /* gzip trailer */
+    phtolel(state->out + bsize - 8, crc);
+    phtolel(state->out + bsize - 4, state->have);
+
+    *len = bsize;
+    return 0;
+}
+#endif
+
+#ifdef HAVE_LZ4
+/* Compress whatever is in the input buffer as a complete LZ4 frame, and
+   put its length in *len.  Return -1, and set state->err, if there is
+   an error; return 0 on success. */
+static int
+lz4_comp(GZWFILE_T state, guint *len)
+{
+    size_t ret;
+
+    ret = LZ4F_compressFrame(state->out, state->out_size,
+                             state->in, state->have, &state->lz4_prefs);
+    if (LZ4F_isError(ret)) {
+        /* This "shouldn't happen". */
+        state->err = WTAP_ERR_INTERNAL;
+        return -1;
+    }
+    *len = (guint)ret;
+    return 0;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* Compress whatever is in the input buffer as a complete Zstandard
+   frame, and put its length in *len.  Return -1, and set state->err,
+   if there is an error; return 0 on success. */
+static int
+zstd_comp(GZWFILE_T state, guint *len)
+{
+    size_t ret;
+
+    ret = ZSTD_compressCCtx(state->zstd_cctx, state->out, state->out_size,
+                            state->in, state->have, WRITE_ZSTD_LEVEL);
+    if (ZSTD_isError(ret)) {
+        /* This "shouldn't happen". */
+        state->err = WTAP_ERR_INTERNAL;
+        return -1;
+    }
+    *len = (guint)ret;
+    return 0;
+}
+#endif
+
+/* Compress whatever is in the input buffer as one independent block or
+   frame, and write it to the output file.  Return -1, and set
+   state->err, if there is an error; return 0 on success. */
+static int
+gz_comp(GZWFILE_T state)
+{
+    int ret;
+    guint len = 0;
+
     /* allocate memory if this is the first time through */
     if (state->size == 0 && gz_init(state) == -1)
         return -1;
+    if (state->have == 0)
+        return 0;
 
-    /* run deflate() on provided input until it produces no more output */
-    ret = Z_OK;
-    do {
-        /* write out current buffer contents if full, or if flushing, but if
-           doing Z_FINISH then don't write until we get to Z_STREAM_END */
-        if (strm->avail_out == 0 || (flush != Z_NO_FLUSH &&
-                                     (flush != Z_FINISH || ret == Z_STREAM_END))) {
-            have = strm->next_out - state->next;
-            if (have) {
-                got = ws_write(state->fd, state->next, (unsigned int)have);
-                if (got < 0) {
-                    state->err = errno;
-                    return -1;
-                }
-                if ((ptrdiff_t)got != have) {
-                    state->err = WTAP_ERR_SHORT_WRITE;
-                    return -1;
-                }
-            }
-            if (strm->avail_out == 0) {
-                strm->avail_out = state->size;
-                strm->next_out = state->out;
-            }
-            state->next = strm->next_out;
-        }
+    switch (state->compression) {
 
-        /* compress */
-        have = strm->avail_out;
-        ret = deflate(strm, flush);
-        if (ret == Z_STREAM_ERROR) {
-            /* This "shouldn't happen". */
-            state->err = WTAP_ERR_INTERNAL;
-            return -1;
-        }
-        have -= strm->avail_out;
-    } while (have);
+#ifdef HAVE_LZ4
+    case WRITE_LZ4:
+        ret = lz4_comp(state, &len);
+        break;
+#endif
 
-    /* if that completed a deflate stream, allow another to start */
-    if (flush == Z_FINISH)
-        deflateReset(strm);
+#ifdef HAVE_ZSTD
+    case WRITE_ZSTD:
+        ret = zstd_comp(state, &len);
+        break;
+#endif
+
+#ifdef HAVE_ZLIB
+    case WRITE_BGZF:
+        ret = bgzf_comp(state, &len);
+        break;
+#endif
+
+    default:
+        /* not reached */
+        state->err = WTAP_ERR_INTERNAL;
+        ret = -1;
+        break;
+    }
+    if (ret == -1 || gz_write_out(state, state->out, len) == -1)
+        return -1;
+    state->have = 0;
 
     /* all done, no errors */
     return 0;
@@ -1635,18 +3171,15 @@ gz_comp(GZWFILE_T state, int flush)
 
 /* Write out len bytes from buf.  Return 0, and set state->err, on
    failure or on an attempt to write 0 bytes (in which case state->err
-   is Z_OK); return the number of bytes written on success. */
+   is 0); return the number of bytes written on success. */
 unsigned
 gzwfile_write(GZWFILE_T state, const void *buf, guint len)
 {
     guint put = len;
     guint n;
-    z_streamp strm;
-
-    strm = &(state->strm);
 
     /* check that there's no error */
-    if (state->err != Z_OK)
+    if (state->err != 0)
         return 0;
 
     /* if len is zero, avoid unnecessary operations */
@@ -1657,71 +3190,42 @@ gzwfile_write(GZWFILE_T state, const void *buf, guint len)
     if (state->size == 0 && gz_init(state) == -1)
         return 0;
 
-    /* for small len, copy to input buffer, otherwise compress directly */
-    if (len < state->size) {
-        /* copy to input buffer, compress when full */
-        do {
-            if (strm->avail_in == 0)
-                strm->next_in = state->in;
-            n = state->size - strm->avail_in;
-            if (n > len)
-                n = len;
-#ifdef z_const
-DIAG_OFF(cast-qual)
-            memcpy((Bytef *)strm->next_in + strm->avail_in, buf, n);
-DIAG_ON(cast-qual)
-#else
-            memcpy(strm->next_in + strm->avail_in, buf, n);
-#endif
-            strm->avail_in += n;
-            state->pos += n;
-            buf = (const char *)buf + n;
-            len -= n;
-            if (len && gz_comp(state, Z_NO_FLUSH) == -1)
-                return 0;
-        } while (len);
-    }
-    else {
-        /* consume whatever's left in the input buffer */
-        if (strm->avail_in && gz_comp(state, Z_NO_FLUSH) == -1)
-            return 0;
-
-        /* directly compress user buffer to file */
-        strm->avail_in = len;
-#ifdef z_const
-        strm->next_in = (z_const Bytef *)buf;
-#else
-DIAG_OFF(cast-qual)
-        strm->next_in = (Bytef *)buf;
-DIAG_ON(cast-qual)
-#endif
-        state->pos += len;
-        if (gz_comp(state, Z_NO_FLUSH) == -1)
+    /* copy to input buffer, compress a block when full */
+    do {
+        n = state->size - state->have;
+        if (n > len)
+            n = len;
+        memcpy(state->in + state->have, buf, n);
+        state->have += n;
+        state->pos += n;
+        buf = (const char *)buf + n;
+        len -= n;
+        if (state->have == state->size && gz_comp(state) == -1)
             return 0;
-    }
+    } while (len);
 
     /* input was all buffered or compressed (put will fit in int) */
     return (int)put;
 }
 
-/* Flush out what we've written so far.  Returns -1, and sets state->err,
-   on failure; returns 0 on success. */
+/* Flush out what we've written so far, ending the current block early.
+   Returns -1, and sets state->err, on failure; returns 0 on success. */
 int
 gzwfile_flush(GZWFILE_T state)
 {
     /* check that there's no error */
-    if (state->err != Z_OK)
+    if (state->err != 0)
         return -1;
 
-    /* compress remaining data with Z_SYNC_FLUSH */
-    gz_comp(state, Z_SYNC_FLUSH);
-    if (state->err != Z_OK)
+    /* compress remaining data */
+    gz_comp(state);
+    if (state->err != 0)
         return -1;
     return 0;
 }
 
-/* Flush out all data written, and close the file.  Returns a Wiretap
-   error on failure; returns 0 on success.
+/* Flush out all data written, write the BGZF end-of-file marker if
+   we're writing gzip, and close the file.  Returns a Wiretap error on failure; returns 0 on success.
 
    If is_stdout is true, do all of that except for closing the file
    descriptor, as we don't want to close the standard output file
@@ -1734,12 +3238,42 @@ gzwfile_close(GZWFILE_T state, gboolean is_stdout)
     int ret = 0;
 
     /* flush, free memory, and close file */
-    if (gz_comp(state, Z_FINISH) == -1 && ret == 0)
+    if (state->err != 0)
+        ret = state->err;
+    else if (gz_comp(state) == -1)
         ret = state->err;
-    (void)deflateEnd(&(state->strm));
-    g_free(state->out);
-    g_free(state->in);
-    state->err = Z_OK;
+#ifdef HAVE_ZLIB
+    else if (state->compression == WRITE_BGZF &&
+             gz_write_out(state, bgzf_eof_block, sizeof bgzf_eof_block) == -1)
+        ret = state->err;
+#endif
+    if (state->size != 0) {
+        switch (state->compression) {
+
+#ifdef HAVE_LZ4
+        case WRITE_LZ4:
+            break;
+#endif
+
+#ifdef HAVE_ZSTD
+        case WRITE_ZSTD:
+            ZSTD_freeCCtx(state->zstd_cctx);
+            break;
+#endif
+
+#ifdef HAVE_ZLIB
+        case WRITE_BGZF:
+            (void)deflateEnd(&(state->strm));
+            break;
+#endif
+
+        default:
+            break;
+        }
+        g_free(state->out);
+        g_free(state->in);
+    }
+    state->err = 0;
     if (!is_stdout) {
         if (ws_close(state->fd) == -1 && ret == 0)
             ret = errno;
@@ -1753,7 +3287,7 @@ gzwfile_geterr(GZWFILE_T state)
 {
     return state->err;
 }
-#endif
+#endif /* CAN_WRITE_COMPRESSED */
 
 /*
  * Editor modelines  -  http://www.wireshark.org/tools/modelines.html
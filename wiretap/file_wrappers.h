@@ -29,6 +29,10 @@
 extern FILE_T file_open(const char *path);
 extern FILE_T file_fdopen(int fildes);
 extern void file_set_random_access(FILE_T stream, gboolean random_flag, GPtrArray *seek);
+#ifdef HAVE_ZLIB
+extern gboolean file_read_fast_seek_index(FILE_T stream, const char *index_path);
+extern gboolean file_write_fast_seek_index(FILE_T stream, const char *index_path);
+#endif
 WS_DLL_PUBLIC gint64 file_seek(FILE_T stream, gint64 offset, int whence, int *err);
 extern gboolean file_skip(FILE_T file, gint64 delta, int *err);
 WS_DLL_PUBLIC gint64 file_tell(FILE_T stream);
@@ -46,7 +50,15 @@ extern void file_fdclose(FILE_T file);
 extern int file_fdreopen(FILE_T file, const char *path);
 extern void file_close(FILE_T file);
 
-#ifdef HAVE_ZLIB
+/*
+ * Compressed files are written with gzip, LZ4 or Zstandard, so we can
+ * write them if we have any of zlib, liblz4 or libzstd.
+ */
+#if defined(HAVE_ZLIB) || defined(HAVE_LZ4) || defined(HAVE_ZSTD)
+#define CAN_WRITE_COMPRESSED
+#endif
+
+#ifdef CAN_WRITE_COMPRESSED
 typedef struct wtap_writer *GZWFILE_T;
 
 extern GZWFILE_T gzwfile_open(const char *path);
@@ -55,6 +67,6 @@ extern guint gzwfile_write(GZWFILE_T state, const void *buf, guint len);
 extern int gzwfile_flush(GZWFILE_T state);
 extern int gzwfile_close(GZWFILE_T state, gboolean is_stdout);
 extern int gzwfile_geterr(GZWFILE_T state);
-#endif /* HAVE_ZLIB */
+#endif /* CAN_WRITE_COMPRESSED */
 
 #endif /* __FILE_H__ */
@@ -64,8 +64,12 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
     gint64 *data_offset);
 static gboolean libpcap_seek_read(wtap *wth, gint64 seek_off,
     struct wtap_pkthdr *phdr, Buffer *buf, int *err, gchar **err_info);
+static guint libpcap_read_batch(wtap *wth, wtap_batch_t *batch, int *err,
+    gchar **err_info);
 static gboolean libpcap_read_packet(wtap *wth, FILE_T fh,
     struct wtap_pkthdr *phdr, Buffer *buf, int *err, gchar **err_info);
+static gboolean libpcap_read_packet_header(wtap *wth, FILE_T fh,
+    struct wtap_pkthdr *phdr, int *err, gchar **err_info);
 static gboolean libpcap_dump(wtap_dumper *wdh, const struct wtap_pkthdr *phdr,
     const guint8 *pd, int *err, gchar **err_info);
 static int libpcap_read_header(wtap *wth, FILE_T fh, int *err, gchar **err_info,
@@ -269,6 +273,7 @@ wtap_open_return_val libpcap_open(wtap *wth, int *err, gchar **err_info)
 	wth->priv = (void *)libpcap;
 	wth->subtype_read = libpcap_read;
 	wth->subtype_seek_read = libpcap_seek_read;
+	wth->subtype_read_batch = libpcap_read_batch;
 	wth->subtype_close = libpcap_close;
 	wth->file_encap = file_encap;
 	wth->snapshot_length = hdr.snaplen;
@@ -621,6 +626,39 @@ static gboolean libpcap_read(wtap *wth, int *err, gchar **err_info,
 	    wth->frame_buffer, err, err_info);
 }
 
+/* Read as many packets as will fit in the batch */
+static guint
+libpcap_read_batch(wtap *wth, wtap_batch_t *batch, int *err,
+    gchar **err_info)
+{
+	libpcap_t *libpcap = (libpcap_t *)wth->priv;
+	struct wtap_pkthdr *phdr;
+	guint8 *pd;
+	guint count;
+
+	for (count = 0; count < batch->max_records; count++) {
+		phdr = &batch->phdrs[count];
+		batch->data_offsets[count] = file_tell(wth->fh);
+		if (!libpcap_read_packet_header(wth, wth->fh, phdr, err,
+		    err_info))
+			break;
+
+		/*
+		 * Read the packet data straight into the batch's buffer,
+		 * after the data for the previous packets.
+		 */
+		ws_buffer_assure_space(&batch->arena, phdr->caplen);
+		pd = ws_buffer_end_ptr(&batch->arena);
+		if (!wtap_read_bytes(wth->fh, pd, phdr->caplen, err, err_info))
+			break;
+		pcap_read_post_process(wth->file_type_subtype, wth->file_encap,
+		    phdr, pd, libpcap->byte_swapped, -1);
+		batch->data_starts[count] = ws_buffer_length(&batch->arena);
+		ws_buffer_increase_length(&batch->arena, phdr->caplen);
+	}
+	return count;
+}
+
 static gboolean
 libpcap_seek_read(wtap *wth, gint64 seek_off, struct wtap_pkthdr *phdr,
     Buffer *buf, int *err, gchar **err_info)
@@ -640,6 +678,32 @@ libpcap_seek_read(wtap *wth, gint64 seek_off, struct wtap_pkthdr *phdr,
 static gboolean
 libpcap_read_packet(wtap *wth, FILE_T fh, struct wtap_pkthdr *phdr,
     Buffer *buf, int *err, gchar **err_info)
+{
+	libpcap_t *libpcap;
+
+	libpcap = (libpcap_t *)wth->priv;
+
+	if (!libpcap_read_packet_header(wth, fh, phdr, err, err_info))
+		return FALSE;
+
+	/*
+	 * Read the packet data.
+	 */
+	if (!wtap_read_packet_bytes(fh, buf, phdr->caplen, err, err_info))
+		return FALSE;	/* failed */
+
+	pcap_read_post_process(wth->file_type_subtype, wth->file_encap,
+	    phdr, ws_buffer_start_ptr(buf), libpcap->byte_swapped, -1);
+	return TRUE;
+}
+
+/*
+ * Read the record header, and any pseudo-header, of the next packet,
+ * and fill in phdr; the file is left positioned at the packet data.
+ */
+static gboolean
+libpcap_read_packet_header(wtap *wth, FILE_T fh, struct wtap_pkthdr *phdr,
+    int *err, gchar **err_info)
 {
 	struct pcaprec_ss990915_hdr hdr;
 	guint packet_size;
@@ -722,15 +786,6 @@ libpcap_read_packet(wtap *wth, FILE_T fh, struct wtap_pkthdr *phdr,
 	}
 	phdr->caplen = packet_size;
 	phdr->len = orig_size;
-
-	/*
-	 * Read the packet data.
-	 */
-	if (!wtap_read_packet_bytes(fh, buf, packet_size, err, err_info))
-		return FALSE;	/* failed */
-
-	pcap_read_post_process(wth->file_type_subtype, wth->file_encap,
-	    phdr, ws_buffer_start_ptr(buf), libpcap->byte_swapped, -1);
 	return TRUE;
 }
 
@@ -48,6 +48,26 @@
 #define merge_debug(...)
 #endif
 
+/*
+ * Number of records to read ahead in each input file that's read ahead;
+ * we may have hundreds of input files, so keep it small.
+ */
+#define MERGE_READ_AHEAD_DEPTH  32
+
+/*
+ * Each input file that's read ahead gets its own thread, so only read
+ * ahead on as many files as there are processors.
+ */
+static guint
+merge_max_read_ahead_files(void)
+{
+#if GLIB_CHECK_VERSION(2,36,0)
+    return g_get_num_processors();
+#else
+    return 4;
+#endif
+}
+
 
 static const char* idb_merge_mode_strings[] = {
     /* IDB_MERGE_MODE_NONE */
@@ -130,6 +150,7 @@ merge_open_in_files(guint in_file_count, const char *const *in_file_names,
     size_t files_size = in_file_count * sizeof(merge_in_file_t);
     merge_in_file_t *files;
     gint64 size;
+    guint max_read_ahead_files = merge_max_read_ahead_files();
 
     files = (merge_in_file_t *)g_malloc0(files_size);
     *in_files = files;
@@ -157,6 +178,15 @@ merge_open_in_files(guint in_file_count, const char *const *in_file_names,
         }
         files[i].size = size;
         files[i].idb_index_map = g_array_new(FALSE, FALSE, sizeof(guint));
+
+        /*
+         * Read ahead on a separate thread for each of the first few
+         * files, so that, for example, compressed files are
+         * decompressed in parallel; the rest are read as they're
+         * needed, rather than starting hundreds of threads.
+         */
+        if (i < max_read_ahead_files)
+            wtap_set_read_ahead(files[i].wth, MERGE_READ_AHEAD_DEPTH);
     }
     return TRUE;
 }
@@ -207,21 +237,115 @@ merge_select_frame_type(int in_file_count, merge_in_file_t in_files[])
 }
 
 /*
- * returns TRUE if first argument is earlier than second
+ * The input files that have a packet available are kept in a binary
+ * min-heap ordered by the time stamp of that packet, so that picking
+ * the next packet to write costs O(log N) rather than O(N) for N input
+ * files.
+ */
+typedef struct {
+    nstime_t         ts;        /* time stamp of the file's current packet */
+    merge_in_file_t *in_file;
+} merge_heap_entry_t;
+
+typedef struct {
+    merge_heap_entry_t *entries;
+    guint               count;
+    gboolean            primed; /* TRUE once we've read from every file */
+    merge_in_file_t    *last;   /* file whose packet we returned last, or NULL */
+} merge_heap_t;
+
+static void
+merge_heap_init(merge_heap_t *heap, guint in_file_count)
+{
+    heap->entries = g_new(merge_heap_entry_t, in_file_count);
+    heap->count   = 0;
+    heap->primed  = FALSE;
+    heap->last    = NULL;
+}
+
+static void
+merge_heap_free(merge_heap_t *heap)
+{
+    g_free(heap->entries);
+    heap->entries = NULL;
+}
+
+/*
+ * returns TRUE if the first entry's packet should be written before the
+ * second entry's packet
  */
 static gboolean
-is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
+merge_heap_earlier(const merge_heap_entry_t *l, const merge_heap_entry_t *r)
 {
-    if (l->secs > r->secs) {  /* left is later */
-        return FALSE;
-    } else if (l->secs < r->secs) { /* left is earlier */
+    if (l->ts.secs != r->ts.secs)
+        return l->ts.secs < r->ts.secs;
+    if (l->ts.nsecs != r->ts.nsecs)
+        return l->ts.nsecs < r->ts.nsecs;
+    /*
+     * Same time stamp; pick the file that comes later in the list,
+     * as we always have.
+     */
+    return l->in_file > r->in_file;
+}
+
+static void
+merge_heap_push(merge_heap_t *heap, merge_in_file_t *in_file)
+{
+    merge_heap_entry_t entry;
+    guint i, parent;
+
+    entry.ts      = wtap_phdr(in_file->wth)->ts;
+    entry.in_file = in_file;
+
+    /* Sift the new entry up. */
+    for (i = heap->count++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!merge_heap_earlier(&entry, &heap->entries[parent]))
+            break;
+        heap->entries[i] = heap->entries[parent];
+    }
+    heap->entries[i] = entry;
+}
+
+static merge_in_file_t *
+merge_heap_pop(merge_heap_t *heap)
+{
+    merge_in_file_t *in_file = heap->entries[0].in_file;
+    merge_heap_entry_t entry;
+    guint i, child;
+
+    /* Sift the last entry down from the top. */
+    entry = heap->entries[--heap->count];
+    for (i = 0; (child = 2 * i + 1) < heap->count; i = child) {
+        if (child + 1 < heap->count &&
+            merge_heap_earlier(&heap->entries[child + 1], &heap->entries[child]))
+            child++;
+        if (!merge_heap_earlier(&heap->entries[child], &entry))
+            break;
+        heap->entries[i] = heap->entries[child];
+    }
+    heap->entries[i] = entry;
+    return in_file;
+}
+
+/*
+ * Read the next packet from a file and, if we got one, put the file
+ * in the heap.  Returns FALSE on a read error.
+ */
+static gboolean
+merge_heap_fill(merge_heap_t *heap, merge_in_file_t *in_file, int *err,
+                gchar **err_info)
+{
+    if (!wtap_read(in_file->wth, err, err_info, &in_file->data_offset)) {
+        if (*err != 0) {
+            in_file->state = GOT_ERROR;
+            return FALSE;
+        }
+        in_file->state = AT_EOF;
         return TRUE;
-    } else if (l->nsecs > r->nsecs) { /* tv_sec equal, l.usec later */
-        return FALSE;
     }
-    /* either one < two or one == two
-     * either way, return one
-     */
+    in_file->state = PACKET_PRESENT;
+    merge_heap_push(heap, in_file);
     return TRUE;
 }
 
@@ -239,6 +363,7 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  *
  * @param in_file_count number of entries in in_files
  * @param in_files input file array
+ * @param heap heap of files with a packet available
  * @param err wiretap error, if failed
  * @param err_info wiretap error string, if failed
  * @return pointer to merge_in_file_t for file from which that packet
@@ -246,61 +371,50 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  */
 static merge_in_file_t *
 merge_read_packet(int in_file_count, merge_in_file_t in_files[],
-                  int *err, gchar **err_info)
+                  merge_heap_t *heap, int *err, gchar **err_info)
 {
     int i;
-    int ei = -1;
-    nstime_t tv = { sizeof(time_t) > sizeof(int) ? LONG_MAX : INT_MAX, INT_MAX };
-    struct wtap_pkthdr *phdr;
+    merge_in_file_t *in_file;
 
     /*
      * Make sure we have a packet available from each file, if there are any
-     * packets left in the file in question, and search for the packet
-     * with the earliest time stamp.
+     * packets left in the file in question; only the file whose packet we
+     * returned last needs another one, once we've started.
      */
-    for (i = 0; i < in_file_count; i++) {
-        if (in_files[i].state == PACKET_NOT_PRESENT) {
-            /*
-             * No packet available, and we haven't seen an error or EOF yet,
-             * so try to read the next packet.
-             */
-            if (!wtap_read(in_files[i].wth, err, err_info, &in_files[i].data_offset)) {
-                if (*err != 0) {
-                    in_files[i].state = GOT_ERROR;
-                    return &in_files[i];
-                }
-                in_files[i].state = AT_EOF;
-            } else
-                in_files[i].state = PACKET_PRESENT;
-        }
-
-        if (in_files[i].state == PACKET_PRESENT) {
-            phdr = wtap_phdr(in_files[i].wth);
-            if (is_earlier(&phdr->ts, &tv)) {
-                tv = phdr->ts;
-                ei = i;
-            }
+    if (!heap->primed) {
+        for (i = 0; i < in_file_count; i++) {
+            if (!merge_heap_fill(heap, &in_files[i], err, err_info))
+                return &in_files[i];
         }
+        heap->primed = TRUE;
+    } else if (heap->last != NULL) {
+        in_file = heap->last;
+        heap->last = NULL;
+        if (!merge_heap_fill(heap, in_file, err, err_info))
+            return in_file;
     }
 
-    if (ei == -1) {
+    if (heap->count == 0) {
         /* All the streams are at EOF.  Return an EOF indication. */
         *err = 0;
         return NULL;
     }
 
+    in_file = merge_heap_pop(heap);
+
     /* We'll need to read another packet from this file. */
-    in_files[ei].state = PACKET_NOT_PRESENT;
+    in_file->state = PACKET_NOT_PRESENT;
+    heap->last = in_file;
 
     /* Count this packet. */
-    in_files[ei].packet_num++;
+    in_file->packet_num++;
 
     /*
      * Return a pointer to the merge_in_file_t of the file from which the
      * packet was read.
      */
     *err = 0;
-    return &in_files[ei];
+    return in_file;
 }
 
 /** Read the next packet, in file sequence order, from the set of files
@@ -616,8 +730,8 @@ all_idbs_are_duplicates(const merge_in_file_t *in_files, const guint in_file_cou
         if (other_idb_list_size != first_idb_list_size) {
             merge_debug("merge::all_idbs_are_duplicates: sizes of IDB lists don't match: first=%u, other=%u",
                          first_idb_list_size, other_idb_list_size);
-            g_free(other_idb_list);
-            g_free(first_idb_list);
+            wtap_file_free_idb_info(other_idb_list);
+            wtap_file_free_idb_info(first_idb_list);
             return FALSE;
         }
 
@@ -627,17 +741,17 @@ all_idbs_are_duplicates(const merge_in_file_t *in_files, const guint in_file_cou
 
             if (!is_duplicate_idb(first_file_idb, other_file_idb)) {
                 merge_debug("merge::all_idbs_are_duplicates: IDBs at index %d do not match, returning FALSE", j);
-                g_free(other_idb_list);
-                g_free(first_idb_list);
+                wtap_file_free_idb_info(other_idb_list);
+                wtap_file_free_idb_info(first_idb_list);
                 return FALSE;
             }
         }
-        g_free(other_idb_list);
+        wtap_file_free_idb_info(other_idb_list);
     }
 
     merge_debug("merge::all_idbs_are_duplicates: returning TRUE");
 
-    g_free(first_idb_list);
+    wtap_file_free_idb_info(first_idb_list);
 
     return TRUE;
 }
@@ -741,7 +855,7 @@ generate_merged_idb(merge_in_file_t *in_files, const guint in_file_count, const
             }
         }
 
-        g_free(input_file_idb_list);
+        wtap_file_free_idb_info(input_file_idb_list);
     }
     else {
         for (i = 0; i < in_file_count; i++) {
@@ -773,7 +887,7 @@ generate_merged_idb(merge_in_file_t *in_files, const guint in_file_count, const
                 }
             }
 
-            g_free(input_file_idb_list);
+            wtap_file_free_idb_info(input_file_idb_list);
         }
     }
 
@@ -973,6 +1087,7 @@ merge_files(int out_fd, const gchar* out_filename, const int file_type,
             int *err, gchar **err_info, guint *err_fileno)
 {
     merge_in_file_t    *in_files = NULL, *in_file = NULL;
+    merge_heap_t        heap;
     int                 frame_type = WTAP_ENCAP_PER_PACKET;
     merge_result        status = MERGE_OK;
     wtap_dumper        *pdh;
@@ -1049,6 +1164,7 @@ merge_files(int out_fd, const gchar* out_filename, const int file_type,
     if (cb)
         cb->callback_func(MERGE_EVENT_READY_TO_MERGE, 0, in_files, in_file_count, cb->data);
 
+    merge_heap_init(&heap, in_file_count);
     for (;;) {
         *err = 0;
 
@@ -1057,7 +1173,7 @@ merge_files(int out_fd, const gchar* out_filename, const int file_type,
                                                err_info);
         }
         else {
-            in_file = merge_read_packet(in_file_count, in_files, err,
+            in_file = merge_read_packet(in_file_count, in_files, &heap, err,
                                         err_info);
         }
 
@@ -1118,6 +1234,8 @@ merge_files(int out_fd, const gchar* out_filename, const int file_type,
         }
     }
 
+    merge_heap_free(&heap);
+
     if (cb)
         cb->callback_func(MERGE_EVENT_DONE, count, in_files, in_file_count, cb->data);
 
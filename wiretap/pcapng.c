@@ -50,6 +50,8 @@
 static gboolean
 pcapng_read(wtap *wth, int *err, gchar **err_info,
             gint64 *data_offset);
+static guint
+pcapng_read_batch(wtap *wth, wtap_batch_t *batch, int *err, gchar **err_info);
 static gboolean
 pcapng_seek_read(wtap *wth, gint64 seek_off,
                  struct wtap_pkthdr *phdr, Buffer *buf, int *err, gchar **err_info);
@@ -213,6 +215,14 @@ typedef struct wtapng_block_s {
      */
     struct wtap_pkthdr *packet_header;
     Buffer             *frame_buffer;
+
+    /*
+     * When reading a batch, packet data is added to the end of
+     * frame_buffer, so that it's read straight into the batch, rather
+     * than put at its beginning; data_start is where it was put.
+     */
+    gboolean            append_data;
+    gsize               data_start;
 } wtapng_block_t;
 
 /* Interface data in private struct */
@@ -1006,6 +1016,28 @@ pcapng_read_if_descr_block(wtap *wth, FILE_T fh, pcapng_block_header_t *bh,
     return TRUE;
 }
 
+/*
+ * Read a packet's data into the block's frame buffer, at its beginning
+ * or, if we're reading a batch, at its end.
+ */
+static gboolean
+pcapng_read_packet_data(FILE_T fh, wtapng_block_t *wblock, guint length,
+                        int *err, gchar **err_info)
+{
+    Buffer *buf = wblock->frame_buffer;
+
+    if (!wblock->append_data) {
+        wblock->data_start = 0;
+        return wtap_read_packet_bytes(fh, buf, length, err, err_info);
+    }
+
+    ws_buffer_assure_space(buf, length);
+    wblock->data_start = ws_buffer_length(buf);
+    if (!wtap_read_bytes(fh, ws_buffer_end_ptr(buf), length, err, err_info))
+        return FALSE;
+    ws_buffer_increase_length(buf, length);
+    return TRUE;
+}
 
 static gboolean
 pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wtapng_block_t *wblock, int *err, gchar **err_info, gboolean enhanced)
@@ -1220,8 +1252,8 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
     wblock->packet_header->ts.nsecs = (int)(((ts % iface_info.time_units_per_second) * 1000000000) / iface_info.time_units_per_second);
 
     /* "(Enhanced) Packet Block" read capture data */
-    if (!wtap_read_packet_bytes(fh, wblock->frame_buffer,
-                                packet.cap_len - pseudo_header_len, err, err_info))
+    if (!pcapng_read_packet_data(fh, wblock,
+                                 packet.cap_len - pseudo_header_len, err, err_info))
         return FALSE;
     block_read += packet.cap_len - pseudo_header_len;
 
@@ -1359,7 +1391,8 @@ pcapng_read_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *pn, wta
     }
 
     pcap_read_post_process(WTAP_FILE_TYPE_SUBTYPE_PCAPNG, iface_info.wtap_encap,
-                           wblock->packet_header, ws_buffer_start_ptr(wblock->frame_buffer),
+                           wblock->packet_header,
+                           ws_buffer_start_ptr(wblock->frame_buffer) + wblock->data_start,
                            pn->byte_swapped, fcslen);
     return TRUE;
 }
@@ -1512,8 +1545,8 @@ pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *
     memset((void *)&wblock->packet_header->pseudo_header, 0, sizeof(union wtap_pseudo_header));
 
     /* "Simple Packet Block" read capture data */
-    if (!wtap_read_packet_bytes(fh, wblock->frame_buffer,
-                                simple_packet.cap_len, err, err_info))
+    if (!pcapng_read_packet_data(fh, wblock,
+                                 simple_packet.cap_len, err, err_info))
         return FALSE;
 
     /* jump over potential padding bytes at end of the packet data */
@@ -1523,7 +1556,8 @@ pcapng_read_simple_packet_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *
     }
 
     pcap_read_post_process(WTAP_FILE_TYPE_SUBTYPE_PCAPNG, iface_info.wtap_encap,
-                           wblock->packet_header, ws_buffer_start_ptr(wblock->frame_buffer),
+                           wblock->packet_header,
+                           ws_buffer_start_ptr(wblock->frame_buffer) + wblock->data_start,
                            pn->byte_swapped, pn->if_fcslen);
     return TRUE;
 }
@@ -2221,8 +2255,8 @@ pcapng_read_sysdig_event_block(FILE_T fh, pcapng_block_header_t *bh, pcapng_t *p
     wblock->packet_header->len = wblock->packet_header->pseudo_header.sysdig_event.event_len;
 
     /* "Sysdig Event Block" read event data */
-    if (!wtap_read_packet_bytes(fh, wblock->frame_buffer,
-                                block_read, err, err_info))
+    if (!pcapng_read_packet_data(fh, wblock,
+                                 block_read, err, err_info))
         return FALSE;
 
     /* XXX Read comment? */
@@ -2462,6 +2496,7 @@ pcapng_open(wtap *wth, int *err, gchar **err_info)
     /* we don't expect any packet blocks yet */
     wblock.frame_buffer = NULL;
     wblock.packet_header = NULL;
+    wblock.append_data = FALSE;
 
     pcapng_debug("pcapng_open: opening file");
     /* read first block */
@@ -2516,6 +2551,7 @@ pcapng_open(wtap *wth, int *err, gchar **err_info)
     pcapng->interfaces = g_array_new(FALSE, FALSE, sizeof(interface_info_t));
 
     wth->subtype_read = pcapng_read;
+    wth->subtype_read_batch = pcapng_read_batch;
     wth->subtype_seek_read = pcapng_seek_read;
     wth->subtype_close = pcapng_close;
     wth->file_type_subtype = WTAP_FILE_TYPE_SUBTYPE_PCAPNG;
@@ -2568,9 +2604,16 @@ pcapng_open(wtap *wth, int *err, gchar **err_info)
 }
 
 
-/* classic wtap: read packet */
+/*
+ * Read blocks until we get a packet, processing the other blocks we
+ * find along the way; fill in phdr and buf for the packet.  If
+ * data_start isn't NULL, the packet data is added to the end of buf,
+ * and *data_start is set to where it starts.
+ */
 static gboolean
-pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+pcapng_read_next_packet(wtap *wth, struct wtap_pkthdr *phdr, Buffer *buf,
+                        gsize *data_start, int *err, gchar **err_info,
+                        gint64 *data_offset)
 {
     pcapng_t *pcapng = (pcapng_t *)wth->priv;
     wtapng_block_t wblock;
@@ -2579,8 +2622,9 @@ pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
     wtapng_if_stats_mandatory_t *if_stats_mand_block, *if_stats_mand;
     wtapng_if_descr_mandatory_t *wtapng_if_descr_mand;
 
-    wblock.frame_buffer  = wth->frame_buffer;
-    wblock.packet_header = &wth->phdr;
+    wblock.frame_buffer  = buf;
+    wblock.packet_header = phdr;
+    wblock.append_data   = (data_start != NULL);
 
     pcapng->add_new_ipv4 = wth->add_new_ipv4;
     pcapng->add_new_ipv6 = wth->add_new_ipv6;
@@ -2658,6 +2702,12 @@ pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
                 pcapng_debug("pcapng_read: Unknown block type 0x%08x", wblock.type);
                 break;
         }
+
+        /*
+         * The packet index only records packets, so a first pass
+         * done with it would skip this block.
+         */
+        wth->packet_index_unusable = TRUE;
     }
 
 got_packet:
@@ -2665,9 +2715,37 @@ got_packet:
     /*pcapng_debug("Read length: %u Packet length: %u", bytes_read, wth->phdr.caplen);*/
     pcapng_debug("pcapng_read: data_offset is finally %" G_GINT64_MODIFIER "d", *data_offset);
 
+    if (data_start != NULL)
+        *data_start = wblock.data_start;
+
     return TRUE;
 }
 
+/* classic wtap: read packet */
+static gboolean
+pcapng_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+    return pcapng_read_next_packet(wth, &wth->phdr, wth->frame_buffer,
+                                   NULL, err, err_info, data_offset);
+}
+
+/* classic wtap: read as many packets as will fit in the batch, reading
+   their data straight into the batch's buffer */
+static guint
+pcapng_read_batch(wtap *wth, wtap_batch_t *batch, int *err, gchar **err_info)
+{
+    guint count;
+
+    for (count = 0; count < batch->max_records; count++) {
+        if (!pcapng_read_next_packet(wth, &batch->phdrs[count],
+                                     &batch->arena, &batch->data_starts[count],
+                                     err, err_info,
+                                     &batch->data_offsets[count]))
+            break;
+    }
+    return count;
+}
+
 
 /* classic wtap: seek to file position and read packet */
 static gboolean
@@ -2688,6 +2766,7 @@ pcapng_seek_read(wtap *wth, gint64 seek_off,
 
     wblock.frame_buffer = buf;
     wblock.packet_header = phdr;
+    wblock.append_data = FALSE;
 
     /* read the block */
     ret = pcapng_read_block(wth, wth->random_fh, pcapng, &wblock, err, err_info);
@@ -40,6 +40,8 @@ typedef gboolean (*subtype_read_func)(struct wtap*, int*, char**, gint64*);
 typedef gboolean (*subtype_seek_read_func)(struct wtap*, gint64,
                                            struct wtap_pkthdr *, Buffer *buf,
                                            int *, char **);
+typedef guint (*subtype_read_batch_func)(struct wtap*, wtap_batch_t *,
+                                         int *, char **);
 
 /**
  * Struct holding data of the currently read file.
@@ -60,6 +62,7 @@ struct wtap {
 
     subtype_read_func           subtype_read;
     subtype_seek_read_func      subtype_seek_read;
+    subtype_read_batch_func     subtype_read_batch;     /**< NULL if records are read one at a time */
     void                        (*subtype_sequential_close)(struct wtap*);
     void                        (*subtype_close)(struct wtap*);
     int                         file_encap;    /* per-file, for those
@@ -81,6 +84,22 @@ struct wtap {
     wtap_new_ipv4_callback_t    add_new_ipv4;
     wtap_new_ipv6_callback_t    add_new_ipv6;
     GPtrArray                   *fast_seek;
+    gchar                       *fast_seek_index;       /**< Path of the persistent fast seek index, or NULL */
+    gchar                       *packet_index;          /**< Path of the packet index, or NULL */
+    gchar                       *packet_index_tmp;      /**< Path of the packet index being written, or NULL */
+    FILE                        *packet_index_fp;       /**< Packet index being read or written, or NULL */
+    gboolean                    packet_index_loaded;    /**< TRUE if we're reading packet_index_fp */
+    gboolean                    packet_index_complete;  /**< TRUE if wtap_read() got to the end of the file */
+    gboolean                    packet_index_unusable;  /**< TRUE if the read routine saw blocks the index can't record */
+    guint32                     packet_index_count;     /**< Number of records in, or written to, the index */
+    guint32                     packet_index_next_rec;  /**< Number of records wtap_packet_index_next() has returned */
+    gchar                       *packet_index_comment;  /**< Comment for the last record from the index */
+    gint64                      packet_index_file_size; /**< Size of the file the index is for */
+    gint64                      packet_index_last_offset; /**< Offset of the last record from the index, or -1 */
+    guint                       read_ahead_depth;       /**< Number of records to read ahead, or 0 */
+    struct wtap_read_ahead      *read_ahead;            /**< Read-ahead state, or NULL if not started */
+    int                         batch_err;              /**< Error to return from the next wtap_read_batch(), or 0 */
+    gchar                       *batch_err_info;        /**< Error information for batch_err */
 };
 
 struct wtap_dumper;
@@ -255,6 +274,13 @@ extern gint wtap_num_file_types;
  */
 extern const char *compressed_file_extension_table[];
 
+/*
+ * Load the packet index for a file we've just opened, or, if it
+ * doesn't have a valid one, start writing one.
+ */
+void
+wtap_open_packet_index(wtap *wth, const char *filename);
+
 /*
  * Read a given number of bytes from a file.
  *
@@ -35,6 +35,24 @@
 #include <wsutil/file_util.h>
 #include <wsutil/buffer.h>
 
+/*
+ * Records can be read ahead on a separate thread; see below.  The
+ * thread holds a lock while it's in the read routine, which can add
+ * to the section header, interface description and name resolution
+ * arrays, so anything that looks at those arrays takes it as well.
+ */
+#if GLIB_CHECK_VERSION(2,32,0)
+#define USE_READ_AHEAD
+#endif
+
+#ifdef USE_READ_AHEAD
+static void read_ahead_lock(wtap *wth);
+static void read_ahead_unlock(wtap *wth);
+#else
+#define read_ahead_lock(wth)
+#define read_ahead_unlock(wth)
+#endif
+
 #ifdef HAVE_PLUGINS
 
 #include <wsutil/plugins.h>
@@ -164,10 +182,19 @@ wtap_file_tsprec(wtap *wth)
 wtap_block_t
 wtap_file_get_shb(wtap *wth)
 {
-	if ((wth == NULL) || (wth->shb_hdrs == NULL) || (wth->shb_hdrs->len == 0))
+	wtap_block_t shb_hdr;
+
+	if (wth == NULL)
 		return NULL;
 
-	return g_array_index(wth->shb_hdrs, wtap_block_t, 0);
+	read_ahead_lock(wth);
+	if ((wth->shb_hdrs == NULL) || (wth->shb_hdrs->len == 0))
+		shb_hdr = NULL;
+	else
+		shb_hdr = g_array_index(wth->shb_hdrs, wtap_block_t, 0);
+	read_ahead_unlock(wth);
+
+	return shb_hdr;
 }
 
 GArray*
@@ -177,9 +204,15 @@ wtap_file_get_shb_for_new_file(wtap *wth)
 	wtap_block_t shb_hdr_src, shb_hdr_dest;
 	GArray* shb_hdrs;
 
-	if ((wth == NULL) || (wth->shb_hdrs == NULL) || (wth->shb_hdrs->len == 0))
+	if (wth == NULL)
 		return NULL;
 
+	read_ahead_lock(wth);
+	if ((wth->shb_hdrs == NULL) || (wth->shb_hdrs->len == 0)) {
+		read_ahead_unlock(wth);
+		return NULL;
+	}
+
 	shb_hdrs = g_array_new(FALSE, FALSE, sizeof(wtap_block_t));
 
 	for (shb_count = 0; shb_count < wth->shb_hdrs->len; shb_count++) {
@@ -188,6 +221,7 @@ wtap_file_get_shb_for_new_file(wtap *wth)
 		wtap_block_copy(shb_hdr_dest, shb_hdr_src);
 		g_array_append_val(shb_hdrs, shb_hdr_dest);
 	}
+	read_ahead_unlock(wth);
 
 	return shb_hdrs;
 }
@@ -198,9 +232,14 @@ wtap_file_get_shb_for_new_file(wtap *wth)
 void
 wtap_write_shb_comment(wtap *wth, gchar *comment)
 {
-	if ((wth != NULL) && (wth->shb_hdrs != NULL) && (wth->shb_hdrs->len > 0)) {
+	if (wth == NULL)
+		return;
+
+	read_ahead_lock(wth);
+	if ((wth->shb_hdrs != NULL) && (wth->shb_hdrs->len > 0)) {
 		wtap_block_set_nth_string_option_value(g_array_index(wth->shb_hdrs, wtap_block_t, 0), OPT_COMMENT, 0, comment, (gsize)(comment ? strlen(comment) : 0));
 	}
+	read_ahead_unlock(wth);
 }
 
 wtapng_iface_descriptions_t *
@@ -210,11 +249,31 @@ wtap_file_get_idb_info(wtap *wth)
 
 	idb_info = g_new(wtapng_iface_descriptions_t,1);
 
-	idb_info->interface_data	= wth->interface_data;
+	/*
+	 * Copy the array, rather than the descriptions in it, so that
+	 * it can be looked at while the read-ahead thread adds to the
+	 * wtap's array.
+	 */
+	read_ahead_lock(wth);
+	idb_info->interface_data = g_array_sized_new(FALSE, FALSE,
+	    sizeof(wtap_block_t), wth->interface_data->len);
+	g_array_append_vals(idb_info->interface_data,
+	    wth->interface_data->data, wth->interface_data->len);
+	read_ahead_unlock(wth);
 
 	return idb_info;
 }
 
+void
+wtap_file_free_idb_info(wtapng_iface_descriptions_t *idb_info)
+{
+	if (idb_info == NULL)
+		return;
+
+	g_array_free(idb_info->interface_data, TRUE);
+	g_free(idb_info);
+}
+
 
 void
 wtap_free_idb_info(wtapng_iface_descriptions_t *idb_info)
@@ -341,10 +400,19 @@ wtap_get_debug_if_descr(const wtap_block_t if_descr,
 wtap_block_t
 wtap_file_get_nrb(wtap *wth)
 {
-	if ((wth == NULL) || (wth->nrb_hdrs == NULL) || (wth->nrb_hdrs->len == 0))
+	wtap_block_t nrb_hdr;
+
+	if (wth == NULL)
 		return NULL;
 
-	return g_array_index(wth->nrb_hdrs, wtap_block_t, 0);
+	read_ahead_lock(wth);
+	if ((wth->nrb_hdrs == NULL) || (wth->nrb_hdrs->len == 0))
+		nrb_hdr = NULL;
+	else
+		nrb_hdr = g_array_index(wth->nrb_hdrs, wtap_block_t, 0);
+	read_ahead_unlock(wth);
+
+	return nrb_hdr;
 }
 
 GArray*
@@ -354,8 +422,14 @@ wtap_file_get_nrb_for_new_file(wtap *wth)
 	wtap_block_t nrb_hdr_src, nrb_hdr_dest;
 	GArray* nrb_hdrs;
 
-	if ((wth == NULL || wth->nrb_hdrs == NULL) || (wth->nrb_hdrs->len == 0))
+	if (wth == NULL)
+		return NULL;
+
+	read_ahead_lock(wth);
+	if ((wth->nrb_hdrs == NULL) || (wth->nrb_hdrs->len == 0)) {
+		read_ahead_unlock(wth);
 		return NULL;
+	}
 
 	nrb_hdrs = g_array_new(FALSE, FALSE, sizeof(wtap_block_t));
 
@@ -365,6 +439,7 @@ wtap_file_get_nrb_for_new_file(wtap *wth)
 		wtap_block_copy(nrb_hdr_dest, nrb_hdr_src);
 		g_array_append_val(nrb_hdrs, nrb_hdr_dest);
 	}
+	read_ahead_unlock(wth);
 
 	return nrb_hdrs;
 }
@@ -1127,6 +1202,684 @@ wtap_strerror(int err)
 		return g_strerror(err);
 }
 
+/*
+ * Packet index.
+ *
+ * The first pass through a file, done with wtap_read(), is, for
+ * programs that don't need to dissect packets on that pass, done
+ * only to find out where each record is and what its length and time
+ * stamp are.  Optionally, when a file opened for random access has
+ * been read all the way through, that information is saved in a
+ * sidecar file, which is loaded the next time the file is opened,
+ * so that the first pass can be done with wtap_packet_index_next()
+ * rather than by reading the file.
+ *
+ * The index is keyed by the size and modification time of the file
+ * and by its file type; if any of those don't match, it's ignored
+ * (and rewritten when the file has been read through again).
+ *
+ * Only records are in the index.  A file in which the sequential read
+ * routine comes across anything else, such as a pcapng interface
+ * description or name resolution block, doesn't get an index, as
+ * skipping those blocks on the first pass would lose them; the read
+ * routine sets packet_index_unusable when that happens.
+ *
+ * Only file types whose random-access read routine needs nothing set up
+ * by the sequential one get an index; see packet_index_supported().
+ * The records in a loaded index are checked against the file before
+ * they're used, as the index might have been damaged or replaced.
+ *
+ * All values are stored little-endian.  The header is:
+ *
+ *      magic                   8 bytes
+ *      file size               8 bytes
+ *      file modification time  8 bytes
+ *      file type/subtype       4 bytes
+ *      number of records       4 bytes
+ *
+ * and is followed by the records, each of which is:
+ *
+ *      data offset             8 bytes
+ *      time stamp seconds      8 bytes
+ *      time stamp nanoseconds  4 bytes
+ *      record type             4 bytes
+ *      presence flags          4 bytes
+ *      captured length         4 bytes
+ *      packet length           4 bytes
+ *      encapsulation           4 bytes
+ *      time stamp precision    4 bytes
+ *      comment length          4 bytes
+ *
+ * followed by the comment, if any.
+ */
+static const char pidx_magic[8] = { 'W', 'T', 'A', 'P', 'P', 'I', 'X', '2' };
+
+#define PIDX_HDR_LEN    32
+#define PIDX_REC_LEN    48
+
+/*
+ * Can a file of this type be read randomly, with the offsets in the
+ * index, without the sequential read having been done?  Some types'
+ * random-access read routines need state built up by the sequential
+ * one, such as ngsniffer's table of compressed blocks, so the index is
+ * only used for the types known not to.
+ */
+static gboolean
+packet_index_supported(int file_type_subtype)
+{
+	switch (file_type_subtype) {
+
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAPNG:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_NSEC:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_AIX:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_SS991029:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_NOKIA:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_SS990417:
+	case WTAP_FILE_TYPE_SUBTYPE_PCAP_SS990915:
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Get the key identifying the file's contents.
+ */
+static gboolean
+packet_index_key(wtap *wth, guint8 *hdr)
+{
+	ws_statb64 st;
+	int err;
+
+	if (file_fstat(wth->fh, &st, &err) == -1 || !S_ISREG(st.st_mode))
+		return FALSE;
+	memcpy(hdr, pidx_magic, sizeof pidx_magic);
+	phtolell(&hdr[8], (guint64)st.st_size);
+	phtolell(&hdr[16], (guint64)st.st_mtime);
+	phtolel(&hdr[24], (guint32)wth->file_type_subtype);
+	return TRUE;
+}
+
+/*
+ * Give up on the packet index we're writing.
+ */
+static void
+packet_index_discard(wtap *wth)
+{
+	if (wth->packet_index_fp != NULL) {
+		fclose(wth->packet_index_fp);
+		wth->packet_index_fp = NULL;
+	}
+	ws_unlink(wth->packet_index_tmp);
+	g_free(wth->packet_index_tmp);
+	wth->packet_index_tmp = NULL;
+}
+
+/*
+ * Load the packet index for a file, if it has one that matches the
+ * file; otherwise, start writing one, to be put in place if the file
+ * is read all the way through.  Called when the file has been opened.
+ */
+void
+wtap_open_packet_index(wtap *wth, const char *filename)
+{
+	guint8 key[PIDX_HDR_LEN];
+	guint8 hdr[PIDX_HDR_LEN];
+	int fd;
+
+	if (!packet_index_supported(wth->file_type_subtype))
+		return;
+	if (!packet_index_key(wth, key))
+		return;
+	wth->packet_index = g_strdup_printf("%s.pidx", filename);
+	wth->packet_index_file_size = (gint64)pletoh64(&key[8]);
+	wth->packet_index_last_offset = -1;
+
+	wth->packet_index_fp = ws_fopen(wth->packet_index, "rb");
+	if (wth->packet_index_fp != NULL) {
+		if (fread(hdr, 1, PIDX_HDR_LEN, wth->packet_index_fp) == PIDX_HDR_LEN &&
+		    memcmp(hdr, key, 28) == 0) {
+			wth->packet_index_loaded = TRUE;
+			wth->packet_index_count = pletoh32(&hdr[28]);
+			return;
+		}
+		fclose(wth->packet_index_fp);
+	}
+
+	/*
+	 * No usable index.  Write to a temporary file, with a name of
+	 * its own so that other programs writing an index for the same
+	 * file don't write to it as well, and rename it into place, so
+	 * that nobody ever sees a partially-written index; the number of
+	 * records is filled in at the end.
+	 */
+	wth->packet_index_tmp = g_strdup_printf("%s.XXXXXX", wth->packet_index);
+	fd = g_mkstemp(wth->packet_index_tmp);
+	if (fd == -1) {
+		g_free(wth->packet_index_tmp);
+		wth->packet_index_tmp = NULL;
+		wth->packet_index_fp = NULL;
+		return;
+	}
+	wth->packet_index_fp = ws_fdopen(fd, "wb");
+	if (wth->packet_index_fp == NULL) {
+		ws_close(fd);
+		packet_index_discard(wth);
+		return;
+	}
+	wth->packet_index_count = 0;
+	if (fwrite(key, 1, PIDX_HDR_LEN, wth->packet_index_fp) != PIDX_HDR_LEN)
+		packet_index_discard(wth);
+}
+
+/*
+ * Add the record we just read to the packet index we're writing.
+ */
+static void
+packet_index_add(wtap *wth, const struct wtap_pkthdr *phdr, gint64 data_offset)
+{
+	guint8 rec[PIDX_REC_LEN];
+	guint32 comment_len;
+
+	comment_len = phdr->opt_comment != NULL ? (guint32)strlen(phdr->opt_comment) : 0;
+	phtolell(&rec[0], (guint64)data_offset);
+	phtolell(&rec[8], (guint64)(gint64)phdr->ts.secs);
+	phtolel(&rec[16], (guint32)phdr->ts.nsecs);
+	phtolel(&rec[20], phdr->rec_type);
+	phtolel(&rec[24], phdr->presence_flags);
+	phtolel(&rec[28], phdr->caplen);
+	phtolel(&rec[32], phdr->len);
+	phtolel(&rec[36], (guint32)phdr->pkt_encap);
+	phtolel(&rec[40], (guint32)phdr->pkt_tsprec);
+	phtolel(&rec[44], comment_len);
+	if (fwrite(rec, 1, PIDX_REC_LEN, wth->packet_index_fp) != PIDX_REC_LEN ||
+	    (comment_len != 0 &&
+	     fwrite(phdr->opt_comment, 1, comment_len, wth->packet_index_fp) != comment_len)) {
+		packet_index_discard(wth);
+		return;
+	}
+	wth->packet_index_count++;
+}
+
+/*
+ * Finish with the packet index; if we were writing one, and we've
+ * read all the way through the file, put it in place.
+ */
+static void
+packet_index_close(wtap *wth)
+{
+	guint8 count[4];
+	gboolean ok;
+
+	if (wth->packet_index_fp == NULL)
+		return;
+	if (wth->packet_index_loaded) {
+		fclose(wth->packet_index_fp);
+		wth->packet_index_fp = NULL;
+		return;
+	}
+
+	phtolel(count, wth->packet_index_count);
+	ok = wth->packet_index_complete && !wth->packet_index_unusable &&
+	    fseek(wth->packet_index_fp, 28, SEEK_SET) == 0 &&
+	    fwrite(count, 1, sizeof count, wth->packet_index_fp) == sizeof count;
+	if (fclose(wth->packet_index_fp) == EOF)
+		ok = FALSE;
+	wth->packet_index_fp = NULL;
+	if (!ok || ws_rename(wth->packet_index_tmp, wth->packet_index) == -1)
+		ws_unlink(wth->packet_index_tmp);
+	g_free(wth->packet_index_tmp);
+	wth->packet_index_tmp = NULL;
+}
+
+guint32
+wtap_packet_index_count(wtap *wth)
+{
+	return wth->packet_index_loaded ? wth->packet_index_count : 0;
+}
+
+/*
+ * Read a given number of bytes from the packet index; an EOF before
+ * all of them have been read means the index is cut short.
+ */
+static gboolean
+packet_index_read(wtap *wth, void *buf, size_t count, int *err,
+    gchar **err_info)
+{
+	if (fread(buf, 1, count, wth->packet_index_fp) != count) {
+		if (ferror(wth->packet_index_fp)) {
+			*err = errno;
+		} else {
+			*err = WTAP_ERR_SHORT_READ;
+			*err_info = g_strdup_printf("packet index %s is cut short",
+			    wth->packet_index);
+		}
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Report a record in the packet index that can't be right for the file.
+ */
+static gboolean
+packet_index_bad_record(wtap *wth, int *err, gchar **err_info)
+{
+	*err = WTAP_ERR_BAD_FILE;
+	*err_info = g_strdup_printf("packet index %s has a bad record %u",
+	    wth->packet_index, wth->packet_index_next_rec);
+	return FALSE;
+}
+
+gboolean
+wtap_packet_index_next(wtap *wth, struct wtap_pkthdr *phdr, gint64 *data_offset,
+    int *err, gchar **err_info)
+{
+	guint8 rec[PIDX_REC_LEN];
+	guint32 comment_len;
+
+	*err = 0;
+	*err_info = NULL;
+	if (!wth->packet_index_loaded || wth->packet_index_fp == NULL)
+		return FALSE;
+	if (wth->packet_index_next_rec >= wth->packet_index_count)
+		return FALSE;	/* end of the index */
+	if (!packet_index_read(wth, rec, PIDX_REC_LEN, err, err_info))
+		return FALSE;
+	*data_offset = (gint64)pletoh64(&rec[0]);
+	phdr->ts.secs = (time_t)(gint64)pletoh64(&rec[8]);
+	phdr->ts.nsecs = (int)pletoh32(&rec[16]);
+	phdr->rec_type = pletoh32(&rec[20]);
+	phdr->presence_flags = pletoh32(&rec[24]);
+	phdr->caplen = pletoh32(&rec[28]);
+	phdr->len = pletoh32(&rec[32]);
+	phdr->pkt_encap = (int)pletoh32(&rec[36]);
+	phdr->pkt_tsprec = (int)pletoh32(&rec[40]);
+	comment_len = pletoh32(&rec[44]);
+
+	/*
+	 * The records must be in the order they're in the file, and, if
+	 * the file isn't compressed, so that the offsets are offsets in
+	 * the file we have, within it.
+	 */
+	if (*data_offset <= wth->packet_index_last_offset ||
+	    (!file_iscompressed(wth->fh) &&
+	     *data_offset + phdr->caplen > wth->packet_index_file_size) ||
+	    phdr->caplen > WTAP_MAX_PACKET_SIZE ||
+	    comment_len > G_MAXUINT16)
+		return packet_index_bad_record(wth, err, err_info);
+	wth->packet_index_last_offset = *data_offset;
+
+	g_free(wth->packet_index_comment);
+	wth->packet_index_comment = NULL;
+	if (comment_len != 0) {
+		wth->packet_index_comment = (gchar *)g_malloc(comment_len + 1);
+		if (!packet_index_read(wth, wth->packet_index_comment, comment_len,
+		    err, err_info))
+			return FALSE;
+		wth->packet_index_comment[comment_len] = '\0';
+	}
+	phdr->opt_comment = wth->packet_index_comment;
+	wth->packet_index_next_rec++;
+	return TRUE;
+}
+
+/*
+ * Read-ahead.
+ *
+ * If read-ahead has been turned on with wtap_set_read_ahead(),
+ * wtap_read() starts a thread that reads records with the subtype's
+ * read routine and puts them into a ring of slots, stopping when the
+ * ring is full and picking up again when wtap_read() has taken a record
+ * from it, so that the next records are being read while the caller
+ * is processing the current one.  The thread stops when it gets an
+ * end-of-file or error indication, which is passed on to wtap_read()'s
+ * caller in the next slot; if wtap_read() is called again, another
+ * thread is started, just as, without read-ahead, the subtype's read
+ * routine would be called again.
+ *
+ * The slot for the record wtap_read() last returned is still in the
+ * ring, so the thread doesn't overwrite it; wtap_phdr() and
+ * wtap_buf_ptr() return the record in that slot.
+ *
+ * The subtype's routines aren't necessarily safe to call at the same
+ * time from two threads, so the thread holds read_mutex while it's
+ * calling the read routine, and wtap_seek_read(), and the routines that
+ * change or copy state the read routine changes, hold it as well.
+ *
+ * The name resolution callbacks are called from the read routine;
+ * rather than calling them on the thread, before the caller has seen
+ * the records preceding the name resolution information, the thread
+ * saves the names with the next record, and wtap_read() hands them to
+ * the callbacks before returning that record.
+ */
+#ifdef USE_READ_AHEAD
+typedef struct {
+	gboolean	ipv6;		/* TRUE for IPv6, FALSE for IPv4 */
+	guint8		addr[16];
+	gchar		*name;
+} read_ahead_name_t;
+
+typedef struct {
+	gboolean	ok;		/* FALSE for the end-of-file or error indication */
+	int		err;
+	gchar		*err_info;
+	gint64		data_offset;
+	gint64		read_so_far;	/* file_tell_raw() after the record was read */
+	struct wtap_pkthdr phdr;
+	Buffer		*buf;
+	GSList		*names;		/* names to add before the record, last first */
+} read_ahead_slot_t;
+
+struct wtap_read_ahead {
+	guint		nslots;		/* depth + 1, for the current record */
+	read_ahead_slot_t *slots;
+	guint		head;		/* first filled slot */
+	guint		count;		/* number of filled slots */
+	read_ahead_slot_t *cur;		/* slot for the record wtap_read() last returned */
+	gint64		read_so_far;
+	GThread		*thread;	/* NULL if not running */
+	gboolean	stop;		/* TRUE if the thread has been asked to stop */
+	GMutex		ring_mutex;	/* protects head, count and stop */
+	GCond		filled;		/* signalled when a slot is filled */
+	GCond		freed;		/* signalled when a slot is freed or stop is set */
+	GMutex		read_mutex;	/* held while calling the subtype's routines */
+	GSList		*names;		/* names saved by the thread for the next record */
+};
+
+static GPrivate read_ahead_current = G_PRIVATE_INIT(NULL);
+
+static gboolean wtap_read_record(wtap *wth, int *err, gchar **err_info,
+    gint64 *data_offset);
+
+static void
+read_ahead_lock(wtap *wth)
+{
+	if (wth->read_ahead != NULL)
+		g_mutex_lock(&wth->read_ahead->read_mutex);
+}
+
+static void
+read_ahead_unlock(wtap *wth)
+{
+	if (wth->read_ahead != NULL)
+		g_mutex_unlock(&wth->read_ahead->read_mutex);
+}
+
+static void
+read_ahead_add_ipv4(const guint addr, const gchar *name)
+{
+	struct wtap_read_ahead *ra = (struct wtap_read_ahead *)g_private_get(&read_ahead_current);
+	read_ahead_name_t *entry;
+
+	entry = g_new(read_ahead_name_t, 1);
+	entry->ipv6 = FALSE;
+	memcpy(entry->addr, &addr, sizeof addr);
+	entry->name = g_strdup(name);
+	ra->names = g_slist_prepend(ra->names, entry);
+}
+
+static void
+read_ahead_add_ipv6(const void *addrp, const gchar *name)
+{
+	struct wtap_read_ahead *ra = (struct wtap_read_ahead *)g_private_get(&read_ahead_current);
+	read_ahead_name_t *entry;
+
+	entry = g_new(read_ahead_name_t, 1);
+	entry->ipv6 = TRUE;
+	memcpy(entry->addr, addrp, 16);
+	entry->name = g_strdup(name);
+	ra->names = g_slist_prepend(ra->names, entry);
+}
+
+static void
+read_ahead_name_free(gpointer data)
+{
+	read_ahead_name_t *entry = (read_ahead_name_t *)data;
+
+	g_free(entry->name);
+	g_free(entry);
+}
+
+static gpointer
+read_ahead_thread(gpointer data)
+{
+	wtap *wth = (wtap *)data;
+	struct wtap_read_ahead *ra = wth->read_ahead;
+	read_ahead_slot_t *slot;
+	wtap_new_ipv4_callback_t add_new_ipv4;
+	wtap_new_ipv6_callback_t add_new_ipv6;
+	Buffer ft_specific_data;
+	Buffer *buf;
+	gboolean ok;
+
+	g_private_set(&read_ahead_current, ra);
+	do {
+		/* Wait for a free slot. */
+		g_mutex_lock(&ra->ring_mutex);
+		while (ra->count == ra->nslots - 1 && !ra->stop)
+			g_cond_wait(&ra->freed, &ra->ring_mutex);
+		if (ra->stop) {
+			g_mutex_unlock(&ra->ring_mutex);
+			break;
+		}
+		slot = &ra->slots[(ra->head + ra->count) % ra->nslots];
+		g_mutex_unlock(&ra->ring_mutex);
+
+		g_mutex_lock(&ra->read_mutex);
+		add_new_ipv4 = wth->add_new_ipv4;
+		add_new_ipv6 = wth->add_new_ipv6;
+		if (add_new_ipv4 != NULL)
+			wth->add_new_ipv4 = read_ahead_add_ipv4;
+		if (add_new_ipv6 != NULL)
+			wth->add_new_ipv6 = read_ahead_add_ipv6;
+		ok = wtap_read_record(wth, &slot->err, &slot->err_info,
+		    &slot->data_offset);
+		wth->add_new_ipv4 = add_new_ipv4;
+		wth->add_new_ipv6 = add_new_ipv6;
+		if (ok) {
+			/*
+			 * Copy the record header to the slot, keeping
+			 * the slot's own file-type-specific data buffer,
+			 * and swap buffers, so the data isn't copied.
+			 */
+			ft_specific_data = slot->phdr.ft_specific_data;
+			slot->phdr = wth->phdr;
+			slot->phdr.ft_specific_data = ft_specific_data;
+			buf = slot->buf;
+			slot->buf = wth->frame_buffer;
+			wth->frame_buffer = buf;
+		}
+		slot->read_so_far = file_tell_raw(wth->fh);
+		g_mutex_unlock(&ra->read_mutex);
+		slot->ok = ok;
+		slot->names = ra->names;
+		ra->names = NULL;
+
+		g_mutex_lock(&ra->ring_mutex);
+		ra->count++;
+		g_cond_signal(&ra->filled);
+		g_mutex_unlock(&ra->ring_mutex);
+	} while (ok);
+	return NULL;
+}
+
+/*
+ * Ask the thread to stop and wait for it; records it's already read
+ * stay in the ring.
+ */
+static void
+read_ahead_stop(wtap *wth)
+{
+	struct wtap_read_ahead *ra = wth->read_ahead;
+
+	if (ra == NULL || ra->thread == NULL)
+		return;
+	g_mutex_lock(&ra->ring_mutex);
+	ra->stop = TRUE;
+	g_cond_signal(&ra->freed);
+	g_mutex_unlock(&ra->ring_mutex);
+	g_thread_join(ra->thread);
+	ra->thread = NULL;
+}
+
+static void
+read_ahead_free(wtap *wth)
+{
+	struct wtap_read_ahead *ra = wth->read_ahead;
+	guint i;
+
+	if (ra == NULL)
+		return;
+	read_ahead_stop(wth);
+	for (i = 0; i < ra->nslots; i++) {
+		g_slist_free_full(ra->slots[i].names, read_ahead_name_free);
+		wtap_phdr_cleanup(&ra->slots[i].phdr);
+		ws_buffer_free(ra->slots[i].buf);
+		g_free(ra->slots[i].buf);
+	}
+	/* An error indication nobody has seen yet. */
+	for (i = 0; i < ra->count; i++) {
+		if (!ra->slots[(ra->head + i) % ra->nslots].ok)
+			g_free(ra->slots[(ra->head + i) % ra->nslots].err_info);
+	}
+	g_free(ra->slots);
+	g_slist_free_full(ra->names, read_ahead_name_free);
+	g_mutex_clear(&ra->ring_mutex);
+	g_cond_clear(&ra->filled);
+	g_cond_clear(&ra->freed);
+	g_mutex_clear(&ra->read_mutex);
+	g_free(ra);
+	wth->read_ahead = NULL;
+}
+
+static struct wtap_read_ahead *
+read_ahead_new(guint depth)
+{
+	struct wtap_read_ahead *ra;
+	guint i;
+
+	ra = g_new0(struct wtap_read_ahead, 1);
+	ra->nslots = depth + 1;
+	ra->slots = g_new0(read_ahead_slot_t, ra->nslots);
+	for (i = 0; i < ra->nslots; i++) {
+		wtap_phdr_init(&ra->slots[i].phdr);
+		ra->slots[i].buf = g_new(Buffer, 1);
+		ws_buffer_init(ra->slots[i].buf, 1500);
+	}
+	g_mutex_init(&ra->ring_mutex);
+	g_cond_init(&ra->filled);
+	g_cond_init(&ra->freed);
+	g_mutex_init(&ra->read_mutex);
+	return ra;
+}
+
+static gboolean
+read_ahead_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+	struct wtap_read_ahead *ra = wth->read_ahead;
+	read_ahead_slot_t *slot;
+	GSList *names, *entry;
+	read_ahead_name_t *name;
+	guint addr;
+
+	if (ra != NULL) {
+		g_mutex_lock(&ra->ring_mutex);
+		if (ra->cur != NULL) {
+			/* We're done with the current record; free its slot. */
+			ra->cur = NULL;
+			ra->head = (ra->head + 1) % ra->nslots;
+			ra->count--;
+			g_cond_signal(&ra->freed);
+		}
+		g_mutex_unlock(&ra->ring_mutex);
+
+		/*
+		 * If the thread isn't running, and we've returned
+		 * everything it read, we can change the depth.
+		 */
+		if (ra->thread == NULL && ra->count == 0 &&
+		    ra->nslots != wth->read_ahead_depth + 1) {
+			read_ahead_free(wth);
+			ra = NULL;
+		}
+	}
+	if (ra == NULL) {
+		if (wth->read_ahead_depth == 0)
+			return wtap_read_record(wth, err, err_info, data_offset);
+		ra = wth->read_ahead = read_ahead_new(wth->read_ahead_depth);
+	}
+	if (ra->thread == NULL && ra->count == 0) {
+		ra->stop = FALSE;
+		ra->thread = g_thread_try_new("wtap read-ahead",
+		    read_ahead_thread, wth, NULL);
+		if (ra->thread == NULL) {
+			/* Just read the record ourselves. */
+			read_ahead_free(wth);
+			return wtap_read_record(wth, err, err_info, data_offset);
+		}
+	}
+
+	g_mutex_lock(&ra->ring_mutex);
+	while (ra->count == 0)
+		g_cond_wait(&ra->filled, &ra->ring_mutex);
+	slot = &ra->slots[ra->head];
+	g_mutex_unlock(&ra->ring_mutex);
+
+	if (slot->names != NULL) {
+		names = g_slist_reverse(slot->names);
+		slot->names = NULL;
+		g_mutex_lock(&ra->read_mutex);
+		for (entry = names; entry != NULL; entry = g_slist_next(entry)) {
+			name = (read_ahead_name_t *)entry->data;
+			if (name->ipv6) {
+				if (wth->add_new_ipv6 != NULL)
+					wth->add_new_ipv6(name->addr, name->name);
+			} else {
+				if (wth->add_new_ipv4 != NULL) {
+					memcpy(&addr, name->addr, sizeof addr);
+					wth->add_new_ipv4(addr, name->name);
+				}
+			}
+		}
+		g_mutex_unlock(&ra->read_mutex);
+		g_slist_free_full(names, read_ahead_name_free);
+	}
+	ra->read_so_far = slot->read_so_far;
+
+	if (!slot->ok) {
+		/*
+		 * End of file or error; the thread has stopped.
+		 */
+		*err = slot->err;
+		*err_info = slot->err_info;
+		g_thread_join(ra->thread);
+		ra->thread = NULL;
+		g_mutex_lock(&ra->ring_mutex);
+		ra->head = (ra->head + 1) % ra->nslots;
+		ra->count--;
+		g_mutex_unlock(&ra->ring_mutex);
+		return FALSE;
+	}
+	*err = 0;
+	*err_info = NULL;
+	*data_offset = slot->data_offset;
+	ra->cur = slot;
+	return TRUE;
+}
+#else /* USE_READ_AHEAD */
+#define read_ahead_stop(wth)
+#define read_ahead_free(wth)
+#endif /* USE_READ_AHEAD */
+
+void
+wtap_set_read_ahead(wtap *wth, guint depth)
+{
+	wth->read_ahead_depth = depth;
+}
+
 /* Close only the sequential side, freeing up memory it uses.
 
    Note that we do *not* want to call the subtype's close function,
@@ -1138,10 +1891,22 @@ wtap_strerror(int err)
 void
 wtap_sequential_close(wtap *wth)
 {
+	read_ahead_free(wth);
+
 	if (wth->subtype_sequential_close != NULL)
 		(*wth->subtype_sequential_close)(wth);
 
 	if (wth->fh != NULL) {
+#ifdef HAVE_ZLIB
+		/*
+		 * If we read all the way through a compressed file, we
+		 * have a complete set of fast seek points for it; save
+		 * them if we've been asked to.
+		 */
+		if (wth->fast_seek_index != NULL)
+			file_write_fast_seek_index(wth->fh, wth->fast_seek_index);
+#endif
+		packet_index_close(wth);
 		file_close(wth->fh);
 		wth->fh = NULL;
 	}
@@ -1168,6 +1933,7 @@ g_fast_seek_item_free(gpointer data, gpointer user_data _U_)
 void
 wtap_fdclose(wtap *wth)
 {
+	read_ahead_stop(wth);
 	if (wth->fh != NULL)
 		file_fdclose(wth->fh);
 	if (wth->random_fh != NULL)
@@ -1192,6 +1958,11 @@ wtap_close(wtap *wth)
 		g_ptr_array_foreach(wth->fast_seek, g_fast_seek_item_free, NULL);
 		g_ptr_array_free(wth->fast_seek, TRUE);
 	}
+	g_free(wth->fast_seek_index);
+	g_free(wth->packet_index);
+	g_free(wth->packet_index_tmp);
+	g_free(wth->packet_index_comment);
+	g_free(wth->batch_err_info);
 
 	wtap_block_array_free(wth->shb_hdrs);
 	wtap_block_array_free(wth->nrb_hdrs);
@@ -1207,17 +1978,23 @@ wtap_cleareof(wtap *wth) {
 }
 
 void wtap_set_cb_new_ipv4(wtap *wth, wtap_new_ipv4_callback_t add_new_ipv4) {
-	if (wth)
+	if (wth) {
+		read_ahead_lock(wth);
 		wth->add_new_ipv4 = add_new_ipv4;
+		read_ahead_unlock(wth);
+	}
 }
 
 void wtap_set_cb_new_ipv6(wtap *wth, wtap_new_ipv6_callback_t add_new_ipv6) {
-	if (wth)
+	if (wth) {
+		read_ahead_lock(wth);
 		wth->add_new_ipv6 = add_new_ipv6;
+		read_ahead_unlock(wth);
+	}
 }
 
-gboolean
-wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+static gboolean
+wtap_read_record(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 {
 	/*
 	 * Set the packet encapsulation to the file's encapsulation
@@ -1246,6 +2023,8 @@ wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 		 */
 		if (*err == 0)
 			*err = file_error(wth->fh, err_info);
+		if (*err == 0)
+			wth->packet_index_complete = TRUE;
 		return FALSE;	/* failure */
 	}
 
@@ -1264,9 +2043,148 @@ wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
 	 */
 	g_assert(wth->phdr.pkt_encap != WTAP_ENCAP_PER_PACKET);
 
+	if (wth->packet_index_fp != NULL && !wth->packet_index_loaded)
+		packet_index_add(wth, &wth->phdr, *data_offset);
+
 	return TRUE;	/* success */
 }
 
+gboolean
+wtap_read(wtap *wth, int *err, gchar **err_info, gint64 *data_offset)
+{
+#ifdef USE_READ_AHEAD
+	if (wth->read_ahead_depth != 0 || wth->read_ahead != NULL)
+		return read_ahead_read(wth, err, err_info, data_offset);
+#endif
+	return wtap_read_record(wth, err, err_info, data_offset);
+}
+
+wtap_batch_t *
+wtap_batch_new(guint max_records)
+{
+	wtap_batch_t *batch;
+	guint i;
+
+	batch = g_new(wtap_batch_t, 1);
+	batch->max_records = max_records;
+	batch->count = 0;
+	batch->phdrs = g_new(struct wtap_pkthdr, max_records);
+	for (i = 0; i < max_records; i++)
+		wtap_phdr_init(&batch->phdrs[i]);
+	batch->data_offsets = g_new(gint64, max_records);
+	batch->data_starts = g_new(gsize, max_records);
+	ws_buffer_init(&batch->arena, 64 * 1024);
+	return batch;
+}
+
+void
+wtap_batch_free(wtap_batch_t *batch)
+{
+	guint i;
+
+	for (i = 0; i < batch->max_records; i++)
+		wtap_phdr_cleanup(&batch->phdrs[i]);
+	g_free(batch->phdrs);
+	g_free(batch->data_offsets);
+	g_free(batch->data_starts);
+	ws_buffer_free(&batch->arena);
+	g_free(batch);
+}
+
+guint8 *
+wtap_batch_data(wtap_batch_t *batch, guint i)
+{
+	return ws_buffer_start_ptr(&batch->arena) + batch->data_starts[i];
+}
+
+/*
+ * Read a batch of records one at a time with wtap_read(), copying
+ * them into the batch.
+ */
+static guint
+read_batch_by_record(wtap *wth, wtap_batch_t *batch, int *err,
+    gchar **err_info)
+{
+	struct wtap_pkthdr *phdr;
+	Buffer ft_specific_data;
+	guint count;
+
+	for (count = 0; count < batch->max_records; count++) {
+		if (!wtap_read(wth, err, err_info, &batch->data_offsets[count]))
+			break;
+		phdr = &batch->phdrs[count];
+		ft_specific_data = phdr->ft_specific_data;
+		*phdr = *wtap_phdr(wth);
+		phdr->ft_specific_data = ft_specific_data;
+		batch->data_starts[count] = ws_buffer_length(&batch->arena);
+		ws_buffer_append(&batch->arena, wtap_buf_ptr(wth), phdr->caplen);
+	}
+	return count;
+}
+
+guint
+wtap_read_batch(wtap *wth, wtap_batch_t *batch, int *err, gchar **err_info)
+{
+	struct wtap_pkthdr *phdr;
+	guint count, i;
+
+	ws_buffer_clean(&batch->arena);
+	batch->count = 0;
+	*err = 0;
+	*err_info = NULL;
+	if (wth->batch_err != 0) {
+		/*
+		 * We got an error after reading the records in the
+		 * last batch; report it now.
+		 */
+		*err = wth->batch_err;
+		*err_info = wth->batch_err_info;
+		wth->batch_err = 0;
+		wth->batch_err_info = NULL;
+		return 0;
+	}
+
+	if (wth->subtype_read_batch == NULL || wth->read_ahead_depth != 0 ||
+	    wth->read_ahead != NULL) {
+		count = read_batch_by_record(wth, batch, err, err_info);
+	} else {
+		/*
+		 * As in wtap_read_record(), start out with the file's
+		 * encapsulation and time stamp precision.
+		 */
+		for (i = 0; i < batch->max_records; i++) {
+			batch->phdrs[i].pkt_encap = wth->file_encap;
+			batch->phdrs[i].pkt_tsprec = wth->file_tsprec;
+		}
+		count = wth->subtype_read_batch(wth, batch, err, err_info);
+		for (i = 0; i < count; i++) {
+			phdr = &batch->phdrs[i];
+			if (phdr->caplen > phdr->len)
+				phdr->caplen = phdr->len;
+			g_assert(phdr->pkt_encap != WTAP_ENCAP_PER_PACKET);
+			if (wth->packet_index_fp != NULL && !wth->packet_index_loaded)
+				packet_index_add(wth, phdr, batch->data_offsets[i]);
+		}
+		if (count < batch->max_records) {
+			/* See wtap_read_record(). */
+			if (*err == 0)
+				*err = file_error(wth->fh, err_info);
+			if (*err == 0)
+				wth->packet_index_complete = TRUE;
+		}
+	}
+
+	if (count != 0 && *err != 0) {
+		/* Return the records we got; report the error next time. */
+		wth->batch_err = *err;
+		wth->batch_err_info = *err_info;
+		*err = 0;
+		*err_info = NULL;
+	}
+	batch->count = count;
+	return count;
+}
+
 /*
  * Read a given number of bytes from a file.
  *
@@ -1351,18 +2269,30 @@ wtap_read_packet_bytes(FILE_T fh, Buffer *buf, guint length, int *err,
 gint64
 wtap_read_so_far(wtap *wth)
 {
+#ifdef USE_READ_AHEAD
+	if (wth->read_ahead != NULL)
+		return wth->read_ahead->read_so_far;
+#endif
 	return file_tell_raw(wth->fh);
 }
 
 struct wtap_pkthdr *
 wtap_phdr(wtap *wth)
 {
+#ifdef USE_READ_AHEAD
+	if (wth->read_ahead != NULL && wth->read_ahead->cur != NULL)
+		return &wth->read_ahead->cur->phdr;
+#endif
 	return &wth->phdr;
 }
 
 guint8 *
 wtap_buf_ptr(wtap *wth)
 {
+#ifdef USE_READ_AHEAD
+	if (wth->read_ahead != NULL && wth->read_ahead->cur != NULL)
+		return ws_buffer_start_ptr(wth->read_ahead->cur->buf);
+#endif
 	return ws_buffer_start_ptr(wth->frame_buffer);
 }
 
@@ -1393,11 +2323,15 @@ wtap_seek_read(wtap *wth, gint64 seek_off,
 	 *
 	 * Do the same for the packet time stamp resolution.
 	 */
+	read_ahead_lock(wth);
 	phdr->pkt_encap = wth->file_encap;
 	phdr->pkt_tsprec = wth->file_tsprec;
 
-	if (!wth->subtype_seek_read(wth, seek_off, phdr, buf, err, err_info))
+	if (!wth->subtype_seek_read(wth, seek_off, phdr, buf, err, err_info)) {
+		read_ahead_unlock(wth);
 		return FALSE;
+	}
+	read_ahead_unlock(wth);
 
 	/*
 	 * It makes no sense for the captured data length to be bigger
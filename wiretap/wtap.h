@@ -1546,6 +1546,80 @@ WS_DLL_PUBLIC
 gboolean wtap_read(wtap *wth, int *err, gchar **err_info,
     gint64 *data_offset);
 
+/** Have wtap_read() read up to depth records ahead of the caller, on a
+ * separate thread, so that reading the file overlaps with processing
+ * the records; a depth of 0 turns read-ahead off.  The thread is started
+ * by the next wtap_read() call.  The record returned by wtap_phdr() and
+ * wtap_buf_ptr() remains valid until the next wtap_read() call, as it
+ * does without read-ahead.  Records from name resolution blocks are still
+ * handed to the wtap_set_cb_new_ipv4() and wtap_set_cb_new_ipv6()
+ * callbacks on the caller's thread, before the record that follows them.
+ * Read-ahead should not be used when tailing a file that is still being
+ * written, and has no effect if GLib doesn't support threads. */
+WS_DLL_PUBLIC
+void wtap_set_read_ahead(wtap *wth, guint depth);
+
+/** A read-ahead depth that keeps the reader well ahead of the caller
+ * without using much memory for typical packet sizes. */
+#define WTAP_READ_AHEAD_DEFAULT_DEPTH   256
+
+/**
+ * A batch of records read with wtap_read_batch(); the data for all of
+ * the records is in one buffer, at data_starts[i] from its start.
+ */
+typedef struct wtap_batch {
+    guint               max_records;    /**< number of records the batch can hold */
+    guint               count;          /**< number of records read into it */
+    struct wtap_pkthdr  *phdrs;         /**< the records' headers */
+    gint64              *data_offsets;  /**< the records' offsets, as from wtap_read() */
+    gsize               *data_starts;   /**< offsets of the records' data in arena */
+    Buffer              arena;          /**< the records' data */
+} wtap_batch_t;
+
+/** Allocate a batch that can hold up to max_records records. */
+WS_DLL_PUBLIC
+wtap_batch_t *wtap_batch_new(guint max_records);
+
+/** Free a batch allocated with wtap_batch_new(). */
+WS_DLL_PUBLIC
+void wtap_batch_free(wtap_batch_t *batch);
+
+/** Return a pointer to the data for the i'th record in a batch. */
+WS_DLL_PUBLIC
+guint8 *wtap_batch_data(wtap_batch_t *batch, guint i);
+
+/** Read the next records, up to the size of the batch, as wtap_read()
+ * would, replacing whatever was in the batch.  Returns the number of
+ * records read, which is also put in batch->count; 0 means that there
+ * are no more records, in which case *err is 0 at the end of the file
+ * and an error code otherwise.  If an error occurs after some records
+ * have been read, those records are returned, and the error is returned
+ * by the next call.  File types that can read a batch of records at a
+ * time do so; for other file types, the records are read one at a time.
+ * Name resolution callbacks are called as records are read, so names
+ * may be added before the caller gets to earlier records in the batch. */
+WS_DLL_PUBLIC
+guint wtap_read_batch(wtap *wth, wtap_batch_t *batch, int *err,
+    gchar **err_info);
+
+/** If the file was opened for random access and a packet index for it
+ * was found, return the number of records in the index; otherwise return
+ * 0.  Packet indices are only used if the WIRESHARK_PACKET_INDEX
+ * environment variable is set; a file that doesn't have one gets one
+ * once it's been read all the way through with wtap_read(). */
+WS_DLL_PUBLIC
+guint32 wtap_packet_index_count(wtap *wth);
+
+/** Get the next record from the packet index instead of reading it with
+ * wtap_read().  Fills in everything in phdr that's needed to build a
+ * frame_data for the record, and sets data_offset as wtap_read() would;
+ * the packet data itself must be read with wtap_seek_read().  Returns
+ * FALSE, with *err set to 0, at the end of the index, and FALSE, with
+ * *err and *err_info set, if the index couldn't be read. */
+WS_DLL_PUBLIC
+gboolean wtap_packet_index_next(wtap *wth, struct wtap_pkthdr *phdr,
+    gint64 *data_offset, int *err, gchar **err_info);
+
 WS_DLL_PUBLIC
 gboolean wtap_seek_read (wtap *wth, gint64 seek_off,
         struct wtap_pkthdr *phdr, Buffer *buf, int *err, gchar **err_info);
@@ -1629,17 +1703,27 @@ void wtap_write_shb_comment(wtap *wth, gchar *comment);
 
 /**
  * @brief Gets existing interface descriptions.
- * @details Returns a new struct containing a pointer to the existing
- *          description, without creating new descriptions internally.
- * @note The returned pointer must be g_free'd, but its internal
- *       interface_data must not.
+ * @details Returns a new struct containing a new array of pointers to the
+ *          existing descriptions, without creating new descriptions
+ *          internally.  The array is a copy, so that it doesn't change
+ *          if records read ahead add interfaces.
+ * @note The returned pointer must be freed with wtap_file_free_idb_info().
  *
  * @param wth The wiretap session.
- * @return A new struct of the existing section descriptions, which must be g_free'd.
+ * @return A new struct of the existing interface descriptions, which must
+ *         be freed with wtap_file_free_idb_info().
  */
 WS_DLL_PUBLIC
 wtapng_iface_descriptions_t *wtap_file_get_idb_info(wtap *wth);
 
+/**
+ * @brief Frees the struct returned by wtap_file_get_idb_info().
+ * @details Frees the struct and its array, but not the interface
+ *          descriptions, which belong to the wiretap session.
+ */
+WS_DLL_PUBLIC
+void wtap_file_free_idb_info(wtapng_iface_descriptions_t *idb_info);
+
 /**
  * @brief Free's a interface description block and all of its members.
  *
@@ -1649,8 +1733,7 @@ wtapng_iface_descriptions_t *wtap_file_get_idb_info(wtap *wth);
  *
  * @warning Do not use this for the struct returned by
  *     wtap_file_get_idb_info(), as that one did not create the internal
- *     interface descriptions; for that case you can simply g_free() the new
- *     struct.
+ *     interface descriptions; for that case use wtap_file_free_idb_info().
  */
 WS_DLL_PUBLIC
 void wtap_free_idb_info(wtapng_iface_descriptions_t *idb_info);
@@ -1760,7 +1843,9 @@ wtap_dumper* wtap_dump_open(const char *filename, int file_type_subtype, int enc
  * @param file_type_subtype The WTAP_FILE_TYPE_SUBTYPE_XXX file type.
  * @param encap The WTAP_ENCAP_XXX encapsulation type (WTAP_ENCAP_PER_PACKET for multi)
  * @param snaplen The maximum packet capture length.
- * @param compressed True if file should be compressed.
+ * @param compressed True if file should be compressed.  The file is
+ *     compressed with gzip unless its name ends in ".lz4" or ".zst" and
+ *     we were built with LZ4 or Zstandard support, respectively.
  * @param shb_hdrs The section header block(s) information, or NULL.
  * @param idb_inf The interface description information, or NULL.
  * @param nrb_hdrs The name resolution blocks(s) comment/custom_opts information, or NULL.
@@ -28,11 +28,14 @@
 #define SMALL_BUFFER_SIZE (2 * 1024) /* Everyone still uses 1500 byte frames, right? */
 static GPtrArray *small_buffers = NULL; /* Guaranteed to be at least SMALL_BUFFER_SIZE */
 /* XXX - Add medium and large buffers? */
+/* Buffers can be set up and freed on more than one thread, e.g. by wiretap's read-ahead thread */
+G_LOCK_DEFINE_STATIC(small_buffers);
 
 /* Initializes a buffer with a certain amount of allocated space */
 void
 ws_buffer_init(Buffer* buffer, gsize space)
 {
+	G_LOCK(small_buffers);
 	if G_UNLIKELY(!small_buffers) small_buffers = g_ptr_array_sized_new(1024);
 
 	if (space <= SMALL_BUFFER_SIZE) {
@@ -46,6 +49,7 @@ ws_buffer_init(Buffer* buffer, gsize space)
 		buffer->data = (guint8*)g_malloc(space);
 		buffer->allocated = space;
 	}
+	G_UNLOCK(small_buffers);
 	buffer->start = 0;
 	buffer->first_free = 0;
 }
@@ -55,7 +59,9 @@ void
 ws_buffer_free(Buffer* buffer)
 {
 	if (buffer->allocated == SMALL_BUFFER_SIZE) {
+		G_LOCK(small_buffers);
 		g_ptr_array_add(small_buffers, buffer->data);
+		G_UNLOCK(small_buffers);
 	} else {
 		g_free(buffer->data);
 	}